@@ -4,6 +4,7 @@
 
 #include <time.h>
 
+//sockname è il socket AF_UNIX del server oppure "host:port" per connettersi via TCP
 int openConnection(const char* sockname, int msec, struct timespec abstime);
 
 int closeConnection(const char* sockname);
@@ -12,10 +13,26 @@ int openFile(const char* pathname, int flags);
 
 int readFile(const char* pathname, void** buf, size_t* size);
 
+//come openFile, readFile e closeFile in sequenza, ma le tre richieste vengono inviate insieme.
+//Il contenuto è una mappatura in sola lettura (i file grandi sono condivisi dal server senza copie)
+//e va rilasciato con unmapFile
+int fetchFile(const char* pathname, void** buf, size_t* size);
+
+void unmapFile(void* buf, size_t size);
+
 int readNFiles(int N, const char* dirname);
 
 int writeFile(const char* pathname, const char* dirname);
 
+//come writeFile, ma il contenuto è nel memfd fd, che il server adotta senza copiarlo. Il memfd deve essere
+//sigillato con F_SEAL_WRITE, F_SEAL_SHRINK e F_SEAL_GROW e resta del chiamante, che può chiuderlo al ritorno
+int writeMemfd(const char* pathname, int fd, const char* dirname);
+
+//come openFile con O_CREATE | O_LOCK, writeFile, unlockFile e closeFile in sequenza, ma con un'unica richiesta
+//che il server esegue atomicamente: al ritorno il file esiste già scritto e chiuso. Con flags O_LOCK il file
+//resta in lock al client (non viene eseguita unlockFile), con O_NORMAL no. Fallisce con EEXIST se il file esiste già
+int putFile(const char* pathname, int flags, const char* dirname);
+
 int appendToFile(const char* pathname, void* buf, size_t size, const char* dirname);
 
 int lockFile(const char* pathname);
@@ -26,6 +43,47 @@ int closeFile(const char* pathname);
 
 int removeFile(const char* pathname);
 
+/**
+ * @struct batchop_t
+ * @brief operazione di batchFiles
+ *
+ * @var code    OPEN, READ, LOCK, UNLOCK, CLOSE o REMOVE (vedi protocol.h)
+ * @var flags   OPEN: flag di apertura
+ * @var result  esito dell'operazione: 0 in caso di successo, altrimenti il codice d'errore
+ * @var buf     READ: contenuto letto, va liberato con free
+ */
+typedef struct batchop {
+    int code;
+    int flags;
+    const char *pathname;
+    int result;
+    void *buf;
+    size_t size;
+} batchop_t;
+
+//esegue le n operazioni nell'ordine dato, con un'unica richiesta per ogni gruppo di BATCH_OPS operazioni,
+//e ne riporta gli esiti in ops. Una LOCK su un file in lock ad un altro client non attende ma fallisce con EBUSY,
+//una READ il cui contenuto non sta nel budget della richiesta (BATCH_READ_BUDGET) fallisce con EFBIG e il file
+//va letto con readFile o fetchFile.
+//Restituisce 0 se tutte le operazioni hanno avuto successo, altrimenti -1 e errno è l'esito della prima fallita
+int batchFiles(int n, batchop_t *ops);
+
+int setTTL(long msec);
+
+//da chiamare prima di openConnection: chiede al server di scambiare i messaggi attraverso anelli in memoria
+//condivisa invece che sul socket. Se il server non lo consente la connessione resta sul socket
+int setSharedMemory(int enable);
+
+//da chiamare prima di openConnection: chiede al server di comprimere i contenuti letti e scritti più grandi di
+//LZ_MIN_SIZE byte (vedi protocol.h). Se il server non lo consente, o la connessione passa alla memoria condivisa,
+//i contenuti viaggiano non compressi
+int setCompression(int enable);
+
+//cosa ricevere dei file espulsi per fare spazio alle scritture: EVICT_FULL (default) nome e contenuto,
+//EVICT_NAMES solo nome e dimensione, EVICT_NONE nulla. Con EVICT_FULL, le scritture senza una directory
+//in cui memorizzare i file espulsi ne ricevono comunque solo nome e dimensione
+int setEvictionMode(int mode);
+
 int readfile(const char *pathname, void **file_content, size_t *file_size);
 int storefile(const char *dirname, char *filename, void *data, size_t data_size);
 int verbose(const char * restrict format, ...);
@@ -1,8 +1,40 @@
 #ifndef FILE_STORAGE_SERVER_PROTOCOL_H
 #define FILE_STORAGE_SERVER_PROTOCOL_H
 
+#include <stdint.h>
+#include <sys/socket.h>
+
 #include <conn.h>
 #include <util.h>
+#include <shmring.h>
+#include <sockio.h>
+#include <msgpool.h>
+#include <lz.h>
+
+#define PROTOCOL_VERSION 7
+#define BATCH_MSGS 32           //messaggi spediti al massimo con un'unica scrittura
+#define BATCH_BUDGET (1 << 20)  //byte accumulati oltre i quali un batch viene spedito
+#define STREAM_CHUNK (1 << 20)  //dimensione massima del payload di un messaggio nei trasferimenti a chunk
+#define REQUEST_MAX_DATA STREAM_CHUNK //payload massimo di una richiesta: i contenuti più grandi viaggiano a chunk o in un memfd
+#define MEMFD_MIN_SIZE (1 << 20) //dimensione minima dei contenuti scambiati tramite memfd invece che sul socket
+#define PACK_FILES 512          //file al massimo in una risposta impacchettata (READN)
+#define PACK_BUDGET (1 << 20)   //byte di contenuto oltre i quali una risposta impacchettata viene chiusa
+#define BATCH_OPS 256           //operazioni al massimo in una richiesta BATCH
+#define BATCH_READ_BUDGET (64 << 10) //byte di contenuto letti al massimo dalle READ di un'unica richiesta BATCH
+#define LZ_MIN_SIZE 4096        //dimensione minima dei payload che il client comprime, se concordato con HELLO
+
+//flag dei messaggi
+#define FLAG_MORE   0x1 //il payload prosegue nel messaggio successivo con lo stesso id
+#define FLAG_CHUNK  0x2 //il messaggio prosegue il payload del precedente con lo stesso id
+#define FLAG_STREAM 0x4 //READ: il client accetta che il contenuto gli venga spedito a chunk
+#define FLAG_MEMFD  0x8 //i data_size byte del contenuto non seguono l'header ma sono in un memfd sigillato
+                        //passato con SCM_RIGHTS (READ: il client accetta di riceverlo così,
+                        //WRITE: il client lo passa dopo il via libera del server, vedi wire_header)
+#define FLAG_SHM    0x10 //HELLO: il client chiede di scambiare i messaggi successivi in memoria condivisa (vedi shmring.h),
+                         //la risposta lo conferma e porta il memfd degli anelli
+#define FLAG_LOCK   0x20 //PUT: il file resta in lock al client, come dopo OPEN con O_LOCK e CLOSE
+#define FLAG_LZ     0x40 //HELLO: il client chiede di comprimere i payload, la risposta lo conferma.
+                        //Negli altri messaggi il payload è compresso (vedi compressmsg)
 
 typedef struct header {
     char pathname[MAX_PATH];
@@ -10,8 +42,36 @@ typedef struct header {
     size_t data_size;
     int code;
     int arg;
+    long ttl; //tempo di vita in millisecondi del file (OPEN con O_CREATE e WRITE), 0 se non scade
+    unsigned int id; //identificativo scelto dal client per la richiesta, ripetuto in tutte le risposte
+    int flags; //FLAG_*
 } msg_header;
 
+/**
+ * @struct wire_header
+ * @brief header trasmesso sul socket: campi fissi seguiti da pathlen byte di pathname (senza terminatore)
+ * e da data_size byte di dati. L'username non viene trasmesso ad ogni messaggio ma una sola volta per
+ * connessione con la richiesta HELLO.
+ * Il client può inviare più richieste senza attendere le risposte: il server le serve nell'ordine di
+ * invio e ogni risposta riporta l'id della richiesta a cui si riferisce.
+ * Il payload di WRITE, APPEND e READ può essere diviso in più messaggi (chunk) con lo stesso id,
+ * collegati dai flag FLAG_MORE e FLAG_CHUNK, oppure, sui socket AF_UNIX, trovarsi in un memfd
+ * passato insieme al primo byte dell'header (FLAG_MEMFD).
+ * Una WRITE con FLAG_MEMFD non trasporta il memfd: il server risponde con FLAG_MEMFD se è disposto ad
+ * adottarlo e solo allora il client lo passa con un messaggio WRITE, FLAG_MEMFD | FLAG_CHUNK e lo stesso id.
+ * Così il reactor, che legge le richieste senza ricevere i fd, non può consumare il messaggio che lo trasporta
+ */
+typedef struct wire_header {
+    uint8_t version;   // PROTOCOL_VERSION
+    uint8_t flags;     // FLAG_*
+    uint16_t pathlen;
+    int32_t code;
+    int32_t arg;
+    uint32_t id;
+    int64_t ttl;
+    uint64_t data_size;
+} wire_header;
+
 typedef struct message {
     msg_header *header;
     void *data;
@@ -27,7 +87,11 @@ typedef enum request_code {
     UNLOCK,
     CLOSE,
     REMOVE,
-    FIN
+    FIN,
+    HELLO, //handshake: il pathname contiene l'username del client, arg la versione del protocollo
+    PUT,   //OPEN con O_CREATE | O_LOCK, WRITE, UNLOCK (se non c'è FLAG_LOCK) e CLOSE eseguite atomicamente:
+           //stessi campi e risposte di WRITE
+    BATCH  //più operazioni OPEN, READ, LOCK, UNLOCK, CLOSE e REMOVE eseguite in ordine con un'unica risposta (vedi BATCHOP)
 } request_c;
 
 typedef enum open_flag {
@@ -36,41 +100,462 @@ typedef enum open_flag {
     O_LOCK
 } flag ;
 
+//arg di WRITE e APPEND: cosa spedire al client dei file espulsi per fare spazio
+typedef enum evict_mode {
+    EVICT_FULL,  //nome e contenuto, un messaggio per file
+    EVICT_NAMES, //solo nome e dimensione, tutti nel payload dell'unica risposta (vedi packentry)
+    EVICT_NONE   //nulla, la risposta riporta solo l'esito
+} evict_m;
+
+/*
+ * Le risposte a READN sono impacchettate: ogni messaggio porta in arg il numero dei suoi file e nel payload
+ * l'indice delle loro voci (packentry) seguito dai contenuti concatenati nello stesso ordine. Se i file non
+ * stanno in un messaggio (PACK_FILES, PACK_BUDGET) il messaggio ha FLAG_MORE e l'elenco prosegue nel successivo
+ */
+//voce di un elenco di file nel payload: dimensione e lunghezza del pathname, seguite dal pathname senza terminatore
+#define ENTRY_HEADER (sizeof(uint64_t) + sizeof(uint16_t))
+
+static inline size_t entrysize(const char *pathname) {
+    return ENTRY_HEADER + strnlen(pathname, MAX_PATH - 1);
+}
+
+/**
+ * Scrive in buf la voce di pathname, che deve avere spazio per entrysize(pathname) byte
+ * @return il puntatore al byte successivo alla voce
+ */
+static inline char *packentry(char *buf, const char *pathname, uint64_t size) {
+    uint16_t pathlen = (uint16_t) strnlen(pathname, MAX_PATH - 1);
+    memcpy(buf, &size, sizeof(uint64_t));
+    memcpy(buf + sizeof(uint64_t), &pathlen, sizeof(uint16_t));
+    memcpy(buf + ENTRY_HEADER, pathname, pathlen);
+    return buf + ENTRY_HEADER + pathlen;
+}
+
+/**
+ * Legge da buf la voce scritta da packentry, senza superare end
+ * @return il puntatore alla voce successiva, NULL se la voce è malformata (setta errno)
+ */
+static inline const char *unpackentry(const char *buf, const char *end, char pathname[MAX_PATH], uint64_t *size) {
+    uint16_t pathlen;
+    if (!buf || end - buf < (long) ENTRY_HEADER) {
+        errno = EPROTO;
+        return NULL;
+    }
+    memcpy(size, buf, sizeof(uint64_t));
+    memcpy(&pathlen, buf + sizeof(uint64_t), sizeof(uint16_t));
+    if (pathlen >= MAX_PATH || end - buf - (long) ENTRY_HEADER < pathlen) {
+        errno = EPROTO;
+        return NULL;
+    }
+    memcpy(pathname, buf + ENTRY_HEADER, pathlen);
+    pathname[pathlen] = '\0';
+    return buf + ENTRY_HEADER + pathlen;
+}
+
+/*
+ * Una richiesta BATCH porta in arg il numero di operazioni e nel payload una voce (packentry) per operazione,
+ * con il pathname su cui opera e come valore BATCHOP(codice, argomento). La risposta porta in arg lo stesso numero,
+ * nel payload l'esito di ogni operazione (packresult) seguito dai contenuti letti dalle READ, concatenati nello
+ * stesso ordine. Una LOCK su un file in lock ad un altro client non attende: il suo esito è EBUSY. Una READ il cui
+ * contenuto supererebbe, insieme a quelli già letti, BATCH_READ_BUDGET non spedisce nulla: il suo esito è EFBIG
+ * e il file va letto con una READ singola, che può usare i chunk o un memfd (MEMFD_MIN_SIZE > BATCH_READ_BUDGET)
+ */
+#define BATCHOP(code, arg) (((uint64_t) (uint32_t) (arg) << 32) | (uint32_t) (code))
+#define BATCHOP_CODE(op) ((int) (uint32_t) (op))
+#define BATCHOP_ARG(op) ((int) (uint32_t) ((op) >> 32))
+//esito di un'operazione di BATCH: codice di ritorno seguito dai byte di contenuto letti
+#define RESULT_SIZE (sizeof(int32_t) + sizeof(uint64_t))
+
+static inline char *packresult(char *buf, int code, uint64_t size) {
+    int32_t rescode = code;
+    memcpy(buf, &rescode, sizeof(int32_t));
+    memcpy(buf + sizeof(int32_t), &size, sizeof(uint64_t));
+    return buf + RESULT_SIZE;
+}
+
+/**
+ * Legge da buf l'esito scritto da packresult, senza superare end
+ * @return il puntatore all'esito successivo, NULL se l'esito è troncato (setta errno)
+ */
+static inline const char *unpackresult(const char *buf, const char *end, int *code, uint64_t *size) {
+    int32_t rescode;
+    if (!buf || end - buf < (long) RESULT_SIZE) {
+        errno = EPROTO;
+        return NULL;
+    }
+    memcpy(&rescode, buf, sizeof(int32_t));
+    memcpy(size, buf + sizeof(int32_t), sizeof(uint64_t));
+    *code = rescode;
+    return buf + RESULT_SIZE;
+}
+
+/*
+ * Il payload compresso di un messaggio con FLAG_LZ è la dimensione originale (uint64_t) seguita dal blocco
+ * prodotto da lz_compress. Header e pathname non vengono mai compressi, data_size è la dimensione compressa
+ */
+/**
+ * Comprime il payload del messaggio se si riduce di almeno 1/16: il messaggio riceve un nuovo payload
+ * (ottenuto con pool_alloc) e quello originale viene staccato e restituito al chiamante, che ne resta responsabile
+ * @return il payload originale, NULL se il messaggio non è stato compresso
+ */
+static inline void *compressmsg(msg_t *message) {
+    size_t size = message->header->data_size;
+    if (size == 0 || (message->header->flags & (FLAG_MEMFD | FLAG_LZ))) return NULL;
+    size_t capacity = size - size / 16;
+    char *packed = pool_alloc(sizeof(uint64_t) + capacity);
+    if (!packed) return NULL;
+    size_t packedsize = lz_compress(message->data, size, packed + sizeof(uint64_t), capacity);
+    if (packedsize == 0) {
+        pool_free(packed);
+        return NULL;
+    }
+    uint64_t rawsize = size;
+    memcpy(packed, &rawsize, sizeof(uint64_t));
+    void *raw = message->data;
+    message->data = packed;
+    message->header->data_size = sizeof(uint64_t) + packedsize;
+    message->header->flags |= FLAG_LZ;
+    return raw;
+}
+
+/**
+ * Sostituisce il payload compresso del messaggio con quello originale
+ * @param maxdata  dimensione massima del payload originale, oltre la quale il messaggio viene rifiutato (EMSGSIZE)
+ * @return 0 in caso di successo, -1 in caso di errore (setta errno)
+ */
+static inline int decompressmsg(msg_t *message, size_t maxdata) {
+    uint64_t rawsize;
+    size_t size = message->header->data_size;
+    if (size < sizeof(uint64_t)) {
+        errno = EPROTO;
+        return -1;
+    }
+    memcpy(&rawsize, message->data, sizeof(uint64_t));
+    //un blocco LZ produce al massimo 255 byte per ogni byte letto
+    if (rawsize == 0 || rawsize > (uint64_t) (size - sizeof(uint64_t)) * 255 + 255) {
+        errno = EPROTO;
+        return -1;
+    }
+    //vale lo stesso limite dei payload non compressi, un blocco piccolo non può far allocare 255 volte tanto
+    if (rawsize > maxdata) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+    void *raw = pool_alloc((size_t) rawsize);
+    if (!raw) return -1;
+    if (lz_decompress((char *) message->data + sizeof(uint64_t), size - sizeof(uint64_t), raw, (size_t) rawsize) == -1) {
+        pool_free(raw);
+        return -1;
+    }
+    pool_free(message->data);
+    message->data = raw;
+    message->header->data_size = (size_t) rawsize;
+    message->header->flags &= ~FLAG_LZ;
+    return 0;
+}
+
+/** Spedisce i buffer sul socket (vedi sockio.h) o, se la connessione è passata alla memoria condivisa, nel suo anello
+ *  \retval come writevn
+ */
+static inline int msgwritev(int to, struct iovec *iov, int iovcnt) {
+    shmchan_t *chan = shmchan_lookup(to);
+    if (chan) return shmchan_writev(chan, iov, iovcnt);
+    return sockio_writevn(to, iov, iovcnt);
+}
+
+/** Legge dal socket (vedi sockio.h) o, se la connessione è passata alla memoria condivisa, dal suo anello
+ *  \retval come readn
+ */
+static inline int msgreadn(int from, void *buf, size_t size) {
+    shmchan_t *chan = shmchan_lookup(from);
+    if (chan) return shmchan_readn(chan, buf, size);
+    return sockio_readn(from, buf, size);
+}
+
+/**
+ * Prepara l'header da trasmettere e i buffer (header, pathname, dati) da spedire con un'unica writev
+ * @return il numero di buffer in iov, -1 in caso di errore (setta errno)
+ */
+static inline int packmsg(wire_header *wire, struct iovec iov[3], int code, int arg, long ttl, unsigned int id,
+                          int flags, const char *pathname, size_t data_size, void *data) {
+    size_t pathlen = pathname ? strnlen(pathname, MAX_PATH) : 0;
+    if (pathlen == MAX_PATH) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    memset(wire, 0, sizeof(wire_header));
+    wire->version = PROTOCOL_VERSION;
+    wire->flags = (uint8_t) flags;
+    wire->pathlen = (uint16_t) pathlen;
+    wire->code = code;
+    wire->arg = arg;
+    wire->ttl = ttl;
+    wire->id = id;
+    wire->data_size = data_size;
+
+    int iovcnt = 0;
+    iov[iovcnt].iov_base = wire;
+    iov[iovcnt++].iov_len = sizeof(wire_header);
+    if (pathlen > 0) {
+        iov[iovcnt].iov_base = (void *) pathname;
+        iov[iovcnt++].iov_len = pathlen;
+    }
+    if (data_size > 0 && !(flags & FLAG_MEMFD)) {
+        iov[iovcnt].iov_base = data;
+        iov[iovcnt++].iov_len = data_size;
+    }
+    return iovcnt;
+}
+
 static inline int writemsg(int to, msg_t* message) {
     if (to < 0 || !message) {
         errno = EINVAL;
         return -1;
     }
 
-    int wres;
-    if ((wres = writen(to, message->header, sizeof(msg_header))) == -1) return -1;
-    if (message->header->data_size > 0) {
-        if ((wres = writen(to, message->data, message->header->data_size)) == -1) return -1;
+    //header, pathname e dati vengono spediti con un'unica scrittura
+    wire_header wire;
+    struct iovec iov[3];
+    msg_header *header = message->header;
+    int iovcnt = packmsg(&wire, iov, header->code, header->arg, header->ttl, header->id,
+                         header->flags, header->pathname, header->data_size, message->data);
+    if (iovcnt == -1) return -1;
+    return msgwritev(to, iov, iovcnt);
+}
+
+/**
+ * @struct msgbatch_t
+ * @brief messaggi accumulati per essere spediti con un'unica writev, usato per le risposte composte
+ * da più file (file espulsi). Il batch viene spedito quando si riempie o supera BATCH_BUDGET byte
+ */
+typedef struct msgbatch {
+    int to;
+    int count;
+    int iovcnt;
+    size_t bytes;
+    wire_header headers[BATCH_MSGS];
+    struct iovec iov[3 * BATCH_MSGS];
+} msgbatch_t;
+
+static inline void initbatch(msgbatch_t *batch, int to) {
+    batch->to = to;
+    batch->count = 0;
+    batch->iovcnt = 0;
+    batch->bytes = 0;
+}
+
+/** Spedisce i messaggi accumulati nel batch
+ *
+ *   \retval -1   errore (errno settato)
+ *   \retval  0   se durante la scrittura la writev ritorna 0
+ *   \retval  1   se la scrittura termina con successo (anche se il batch è vuoto)
+ */
+static inline int flushbatch(msgbatch_t *batch) {
+    int res = 1;
+    if (batch->iovcnt > 0) res = msgwritev(batch->to, batch->iov, batch->iovcnt);
+    batch->count = 0;
+    batch->iovcnt = 0;
+    batch->bytes = 0;
+    return res;
+}
+
+/**
+ * Aggiunge un messaggio al batch, spedendolo se raggiunge il limite di messaggi o di byte.
+ * pathname e data non vengono copiati e devono restare validi fino alla spedizione
+ * @return come flushbatch
+ */
+static inline int batchmsg(msgbatch_t *batch, int code, int arg, unsigned int id, const char *pathname, size_t data_size, void *data) {
+    int n = packmsg(&batch->headers[batch->count], &batch->iov[batch->iovcnt], code, arg, 0, id, 0, pathname, data_size, data);
+    if (n == -1) return -1;
+    batch->iovcnt += n;
+    batch->count++;
+    for (int i = batch->iovcnt - n; i < batch->iovcnt; i++) batch->bytes += batch->iov[i].iov_len;
+
+    if (batch->count == BATCH_MSGS || batch->bytes >= BATCH_BUDGET) return flushbatch(batch);
+    return 1;
+}
+
+/** Come readn, ma consuma prima i byte già ricevuti in *prefetch (avanzando il puntatore)
+ *
+ *   \retval -1   errore (errno settato)
+ *   \retval  0   se durante la lettura da fd leggo EOF
+ *   \retval size se termina con successo
+ */
+static inline int readn_prefetched(int from, void *buf, size_t size, const char **prefetch, size_t *prefetched) {
+    size_t copied = 0;
+    if (prefetch && prefetched && *prefetched > 0) {
+        copied = size < *prefetched ? size : *prefetched;
+        memcpy(buf, *prefetch, copied);
+        *prefetch += copied;
+        *prefetched -= copied;
     }
+    if (copied == size) return (int) size;
 
-    return wres;
+    int r;
+    if ((r = msgreadn(from, (char *) buf + copied, size - copied)) <= 0) return r;
+    return (int) size;
 }
 
-static inline int readmsg(int from, msg_t *message) {
+/**
+ * Legge un messaggio, consumando prima gli eventuali byte già ricevuti in *prefetch.
+ * Al ritorno *prefetch e *prefetched indicano i byte non appartenenti al messaggio letto
+ * @param maxdata  payload massimo accettato: un messaggio più grande viene rifiutato (EMSGSIZE) dopo averne letto
+ *                 l'header, senza allocare né leggere il payload. Vale anche per il payload decompresso
+ * @param lz       la compressione è stata concordata: altrimenti un payload con FLAG_LZ viene rifiutato (EPROTO)
+ */
+static inline int readmsg_prefetched(int from, msg_t *message, const char **prefetch, size_t *prefetched, size_t maxdata,
+                                     bool lz) {
     if (from < 0 || !message) {
         errno = EINVAL;
         return -1;
     }
 
-    int read = 0;
-    if ((read += readn(from, message->header, sizeof(msg_header))) == -1) return -1;
+    wire_header wire;
+    int r, read = 0;
+    if ((r = readn_prefetched(from, &wire, sizeof(wire_header), prefetch, prefetched)) <= 0) return r;
+    read += r;
+    if (wire.version != PROTOCOL_VERSION || wire.pathlen >= MAX_PATH) {
+        errno = EPROTO;
+        return -1;
+    }
+    message->header->code = wire.code;
+    message->header->arg = wire.arg;
+    message->header->ttl = (long) wire.ttl;
+    message->header->id = wire.id;
+    message->header->flags = wire.flags;
+    message->header->data_size = (size_t) wire.data_size;
+    if (wire.pathlen > 0) {
+        if ((r = readn_prefetched(from, message->header->pathname, wire.pathlen, prefetch, prefetched)) <= 0) return r;
+        read += r;
+    }
+    message->header->pathname[wire.pathlen] = '\0';
+
     message->data = NULL;
-    if (message->header->data_size > 0) {
-        message->data = malloc(message->header->data_size);
-        if (!message->data) return -1;
-        if ((read += readn(from, message->data, message->header->data_size)) == -1) {
-            free(message->data);
+    if (message->header->data_size > 0 && !(message->header->flags & FLAG_MEMFD)) {
+        if (message->header->data_size > maxdata) {
+            errno = EMSGSIZE;
+            return -1;
+        }
+        if ((message->header->flags & FLAG_LZ) && !lz) {
+            errno = EPROTO;
             return -1;
         }
+        message->data = pool_alloc(message->header->data_size);
+        if (!message->data) return -1;
+        if ((r = readn_prefetched(from, message->data, message->header->data_size, prefetch, prefetched)) <= 0) {
+            pool_free(message->data);
+            message->data = NULL;
+            return r;
+        }
+        read += r;
+        if ((message->header->flags & FLAG_LZ) && decompressmsg(message, maxdata) == -1) return -1;
     }
     return read;
 }
 
+static inline int readmsg(int from, msg_t *message) {
+    return readmsg_prefetched(from, message, NULL, NULL, SIZE_MAX, true);
+}
+
+/**
+ * Come writemsg, ma passa fd al destinatario (SCM_RIGHTS) insieme al primo byte del messaggio.
+ * Scrive sempre sul socket, anche se la connessione è passata alla memoria condivisa.
+ * Con FLAG_MEMFD il contenuto non viene spedito: il destinatario lo trova in fd
+ * @return come writevn
+ */
+static inline int writemsg_fd(int to, msg_t *message, int fd) {
+    if (to < 0 || !message || fd < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    wire_header wire;
+    struct iovec iovbuf[3], *iov = iovbuf;
+    msg_header *header = message->header;
+    int iovcnt = packmsg(&wire, iov, header->code, header->arg, header->ttl, header->id,
+                         header->flags, header->pathname, header->data_size, message->data);
+    if (iovcnt == -1) return -1;
+
+    union {
+        struct cmsghdr align;
+        char buf[CMSG_SPACE(sizeof(int))];
+    } control;
+    memset(&control, 0, sizeof(control));
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = iovcnt;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+
+    ssize_t r;
+    if ((r = sockio_sendmsg(to, &msg, 0)) == -1) return -1;
+    if (r == 0) return 0;
+    //il fd viaggia con i primi byte, il resto del messaggio viene spedito normalmente
+    advanceiov(&iov, &iovcnt, (size_t) r);
+    return iovcnt > 0 ? sockio_writevn(to, iov, iovcnt) : 1;
+}
+
+/**
+ * Come readmsg, ma riceve anche l'eventuale fd passato con il messaggio (vedi writemsg_fd).
+ * Il fd va letto insieme al primo byte dell'header, quindi il messaggio precedente deve essere
+ * stato letto esattamente. Legge sempre dal socket, come writemsg_fd
+ * @param fd  fd ricevuto, -1 se il messaggio non ne trasporta uno
+ * @param maxdata, lz  come in readmsg_prefetched
+ */
+static inline int readmsg_fd(int from, msg_t *message, int *fd, size_t maxdata, bool lz) {
+    if (from < 0 || !message || !fd) {
+        errno = EINVAL;
+        return -1;
+    }
+    *fd = -1;
+
+    wire_header wire;
+    struct iovec iov = {&wire, sizeof(wire_header)};
+    union {
+        struct cmsghdr align;
+        char buf[CMSG_SPACE(sizeof(int))];
+    } control;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    ssize_t r;
+    if ((r = sockio_recvmsg(from, &msg, MSG_CMSG_CLOEXEC)) == -1) return -1;
+    if (r == 0) return 0;
+    struct cmsghdr *cmsg;
+    for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+            memcpy(fd, CMSG_DATA(cmsg), sizeof(int));
+    }
+    //il resto dell'header e il messaggio vengono letti normalmente
+    if ((size_t) r < sizeof(wire_header)) {
+        int rr;
+        if ((rr = sockio_readn(from, (char *) &wire + r, sizeof(wire_header) - r)) <= 0) goto error;
+    }
+    const char *prefetch = (const char *) &wire;
+    size_t prefetched = sizeof(wire_header);
+    int res;
+    if ((res = readmsg_prefetched(from, message, &prefetch, &prefetched, maxdata, lz)) <= 0) goto error;
+    return res;
+
+    error: {
+        int errnosv = errno;
+        if (*fd != -1) close(*fd);
+        *fd = -1;
+        errno = errnosv;
+        return -1;
+    }
+}
+
 static inline msg_t *buildmsg(char *username, int code, int arg, const char *pathname, size_t data_size, void *data) {
 
     if (pathname && strlen(pathname) >= MAX_PATH) {
@@ -82,11 +567,10 @@ static inline msg_t *buildmsg(char *username, int code, int arg, const char *pat
         return NULL;
     }
 
-    msg_t *message = calloc(1, sizeof(msg_t));
+    //messaggi e payload vengono riutilizzati dal thread invece di passare ogni volta dall'allocatore
+    msg_t *message = pool_getmsg();
     if (!message) return NULL;
-    message->header = calloc(1, sizeof(msg_header));
-    if (!message->header) return NULL;
-
+    message->data = NULL;
     memset(message->header, 0, sizeof(msg_header));
     if(pathname) {
         strncpy(message->header->pathname, pathname, strlen(pathname));
@@ -99,33 +583,36 @@ static inline msg_t *buildmsg(char *username, int code, int arg, const char *pat
     message->header->arg = arg;
     message->header->data_size = data_size;
     if (data_size > 0) {
-        message->data = malloc(data_size);
-        if (!message->data) return NULL;
+        if ((message->data = pool_alloc(data_size)) == NULL) {
+            pool_putmsg(message);
+            return NULL;
+        }
         memcpy(message->data, data, data_size);
     }
     return message;
 }
 
 static inline msg_t* initmsg() {
-    msg_t *message = malloc(sizeof(msg_t));
+    msg_t *message = pool_getmsg();
     if (!message) return NULL;
-    message->header = malloc(sizeof(msg_header));
-    if (!message->header) return NULL;
 
     message->header->code = -1;
     message->header->arg = -1;
     memset(message->header->username, 0, MAX_USERNAME);
     memset(message->header->pathname, 0, MAX_PATH);
     message->header->data_size = 0;
+    message->header->ttl = 0;
+    message->header->id = 0;
+    message->header->flags = 0;
     message->data = NULL;
 
     return message;
 }
 
 static inline void destroymsg(msg_t *message) {
-    free(message->header);
-    if (message->data) free(message->data);
-    free(message);
+    //il payload può essere stato allocato altrove, pool_free accetta qualsiasi buffer ottenuto con malloc
+    pool_free(message->data);
+    pool_putmsg(message);
 }
 
 #endif //FILE_STORAGE_SERVER_PROTOCOL_H
@@ -1,15 +1,36 @@
 #ifndef FILE_STORAGE_SERVER_MANAGER_H
 #define FILE_STORAGE_SERVER_MANAGER_H
 
+#include <reactor.h>
+
 #define PENDING_SIZE 50
+#define MAX_EVENTS 64
+#define DEFAULT_IO_THREADS 1
+#define DEFAULT_SPAWN_DELAY 20   //ms di attesa in coda oltre cui il pool elastico aggiunge un worker
+#define DEFAULT_IDLE_TIMEOUT 30  //s dopo cui il pool elastico ritira i worker aggiunti che non servono
+#define DEFAULT_MAX_CONNECTIONS 4096 //client connessi contemporaneamente al massimo
+#define RESERVED_FDS 64          //descrittori lasciati liberi oltre ai client: log, socket di ascolto, pipe, memfd
 
 typedef struct confArgs {
     char *sktname;
     char *logfile;
     int nworkers;
+    int iothreads;
+    io_backend_t iobackend;
     int storagecapacity;
     int filelimit;
     int replace_mode;
+    size_t shmringsize; //capacità degli anelli delle connessioni in memoria condivisa, 0 se disabilitate
+    char *tcpaddress;   //indirizzo su cui accettare le connessioni TCP, NULL per tutte le interfacce
+    int tcpport;        //porta delle connessioni TCP, 0 se disabilitate
+    int tcpsndbuf;      //dimensione dei buffer di invio e ricezione dei socket TCP, 0 per quella del kernel
+    int tcprcvbuf;
+    size_t compressmin; //dimensione minima dei payload compressi per i client che lo chiedono, 0 se disabilitata
+    poolkind_t scheduler; //organizzazione del threadpool, vedi SCHEDULER
+    int maxworkers;     //worker al massimo del pool elastico, 0 se il pool ha N_WORKERS worker fissi
+    int spawndelay;     //ms di attesa in coda oltre cui si aggiunge un worker
+    int idletimeout;    //s di inattività dopo cui i worker aggiunti vengono ritirati
+    int maxconnections; //client connessi contemporaneamente al massimo, vedi MAX_CONNECTIONS
 } configArgs;
 
 int parse_config(const char *config_filename, configArgs *cargs);
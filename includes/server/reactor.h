@@ -0,0 +1,268 @@
+#ifndef FILE_STORAGE_SERVER_REACTOR_H
+#define FILE_STORAGE_SERVER_REACTOR_H
+
+#include <pthread.h>
+#include <stdbool.h>
+
+#include <threadpool.h>
+#include <protocol.h>
+#if defined(IO_URING)
+#include <uring.h>
+#endif
+
+#define URING_ENTRIES 256  //dimensione della coda di sottomissione di ogni reactor
+#define URING_BUFFERS 64   //buffer forniti al kernel da ogni reactor per ricevere le richieste
+#define CONN_BLOCK 256     //connessioni per blocco della tabella delle connessioni
+#define PREFETCH_SIZE (sizeof(wire_header) + MAX_PATH) //header e pathname di qualsiasi richiesta
+#define BULK_SIZE (64 << 10)  //payload oltre il quale una scrittura è un trasferimento grande (BULK_TASK)
+#define BULK_OPS BATCH_MSGS   //operazioni oltre le quali una BATCH è un trasferimento grande
+
+//le READ di una BATCH sono limitate da BATCH_READ_BUDGET: con al più BULK_OPS operazioni la risposta
+//non supera la dimensione di un trasferimento grande, per cui la richiesta si può classificare dal solo header
+#if BATCH_READ_BUDGET > BULK_SIZE
+#error "BATCH_READ_BUDGET oltre BULK_SIZE: una BATCH breve potrebbe rispondere con un trasferimento grande"
+#endif
+
+/**
+ * @file reactor.h
+ * @brief Interfaccia per il pool di reactor che gestiscono le connessioni dei client
+ */
+
+struct reactorpool_;
+
+typedef enum io_backend {
+    EPOLL_BACKEND,
+    URING_BACKEND
+} io_backend_t;
+
+/**
+ * @struct clienttask_t
+ * @brief richiesta di un client passata al threadpool
+ *
+ * @var prefetch    byte già ricevuti dal reactor (solo io_uring), NULL se assenti
+ * @var prefetched  numero di byte in prefetch
+ * @var bid         indice del buffer del reactor che contiene prefetch,
+ *                  -1 se prefetch è una copia allocata dinamicamente (vedi holdPending)
+ * @var pool        pool che ha generato il task
+ * @var class       classe della richiesta, ricavata dal suo header se il threadpool la usa (vedi requestClass)
+ * @var next        task successivo tra quelli sospesi perché la coda del threadpool è piena
+ */
+typedef struct clienttask_ {
+    int fd;
+    char *prefetch;
+    size_t prefetched;
+    int bid;
+    struct reactorpool_ *pool;
+    taskclass_t class;
+    struct clienttask_ *next;
+} clienttask_t;
+
+/**
+ * @struct reactor_t
+ * @brief thread di I/O che attende le richieste di un sottoinsieme dei client connessi
+ *
+ * @var epollfd    istanza epoll su cui sono registrati i client assegnati al reactor
+ * @var closepipe  pipe su cui i worker scrivono i fd dei client da chiudere (-1 termina il reactor)
+ * @var connected  numero di client assegnati al reactor
+ * @var ring       istanza io_uring del reactor, al posto di epollfd con il backend io_uring
+ * @var buffers    buffer forniti al kernel in cui vengono ricevute le richieste
+ * @var closeval   destinazione della lettura dalla closepipe con il backend io_uring
+ * @var inflight   operazioni di I/O dei worker sottomesse all'anello e non ancora completate (vedi sockio.h)
+ * @var stopping   il reactor è in chiusura: attende solo il completamento delle operazioni dei worker,
+ *                 quelle successive vengono eseguite dai worker con le system call bloccanti
+ */
+typedef struct reactor_ {
+    int id;
+    int epollfd;
+    int closepipe[2];
+    int connected;
+    pthread_t thread;
+    bool activated;
+    struct reactorpool_ *pool;
+#if defined(IO_URING)
+    uring_t *ring;
+    char *buffers;
+    int closeval;
+    int inflight;
+    bool stopping;
+#endif
+} reactor_t;
+
+/**
+ * @struct connection_t
+ * @brief stato di una connessione
+ *
+ * @var owner     reactor a cui è assegnato il client
+ * @var username  username inviato dal client con HELLO, stringa vuota prima dell'handshake
+ * @var pending   richieste già ricevute ma non ancora servite di un client sospeso, NULL se assenti
+ * @var npending  numero di byte in pending
+ * @var stream    id del trasferimento a chunk in corso sulla connessione, 0 se nessuno
+ * @var remote    connessione TCP, su cui non possono viaggiare descrittori
+ * @var compress  dimensione minima dei payload compressi nelle risposte, 0 se la compressione non è stata concordata
+ */
+typedef struct connection_ {
+    reactor_t *owner;
+    char username[MAX_USERNAME];
+    char *pending;
+    size_t npending;
+    unsigned int stream;
+    bool remote;
+    size_t compress;
+} connection_t;
+
+/**
+ * @struct reactorpool_t
+ * @brief insieme dei reactor, i nuovi client vengono assegnati al reactor meno carico
+ *
+ * @var next       reactor da cui iniziare la ricerca del meno carico (round robin in caso di parità)
+ * @var connected  numero totale di client connessi
+ * @var conns      stato delle connessioni, indicizzato per fd, in blocchi di CONN_BLOCK: un blocco viene allocato
+ *                 quando vi cade il primo client e non viene più spostato, così i worker lo consultano senza lock
+ * @var tpool      threadpool a cui vengono passate le richieste dei client
+ * @var handler    funzione eseguita dal threadpool, riceve un clienttask_t allocato dinamicamente
+ * @var backend    meccanismo usato dai reactor per attendere le richieste
+ * @var deferred   richieste sospese in ordine di arrivo perché la coda del threadpool era piena, una lista per
+ *                 classe: i loro client non vengono riattivati finché un worker non libera un posto nella coda
+ * @var classdeferred numero di richieste sospese per classe, letto senza lock dai reactor
+ * @var ndeferred  numero totale di richieste sospese, letto senza lock dai worker
+ * @var maxdeferred massimo numero di richieste sospese contemporaneamente
+ * @var throttled  numero di richieste sospese dall'avvio
+ */
+typedef struct reactorpool_ {
+    reactor_t *reactors;
+    int nreactors;
+    int next;
+    int connected;
+    connection_t **conns;
+    int maxfd;
+    threadpool_t *tpool;
+    void (*handler)(void *);
+    io_backend_t backend;
+    clienttask_t *deferred[TASK_CLASSES], *lastdeferred[TASK_CLASSES];
+    int classdeferred[TASK_CLASSES];
+    int ndeferred;
+    int maxdeferred;
+    unsigned long throttled;
+    bool stopped;
+    pthread_mutex_t mutex;
+    pthread_cond_t drained;  // segnalata quando non ci sono più client connessi
+} reactorpool_t;
+
+/**
+ * @brief Crea il pool e avvia i thread reactor
+ * @param nreactors  numero di reactor
+ * @param maxfd      limite superiore (escluso) dei fd che possono essere assegnati
+ * @param backend    backend richiesto, se io_uring non è disponibile viene usato epoll (vedi pool->backend).
+ *                   Con io_uring anche le letture e le scritture dei worker sul socket dei client passano
+ *                   dagli anelli dei reactor (vedi sockio.h)
+ * @param tpool      threadpool a cui passare le richieste
+ * @param handler    funzione da eseguire per ogni richiesta
+ * @return il pool creato, NULL in caso di errore (setta errno)
+ */
+reactorpool_t *createReactorPool(int nreactors, int maxfd, io_backend_t backend, threadpool_t *tpool, void (*handler)(void *));
+
+/**
+ * @brief Assegna un nuovo client al reactor con meno connessioni
+ * @param remote  true se il client è connesso via TCP
+ * @return 0 in caso di successo, -1 in caso di errore (setta errno)
+ */
+int addToReactorPool(reactorpool_t *pool, int clientfd, bool remote);
+
+/**
+ * @brief Restituisce il numero di richieste in attesa di un worker: quelle nella coda del threadpool
+ * e quelle sospese perché la coda era piena
+ * @return la profondità della coda, -1 in caso di errore (setta errno)
+ */
+int queueDepth(reactorpool_t *pool);
+
+/**
+ * @brief Riattiva il client sul suo reactor per la prossima richiesta. Se il client ha richieste
+ * già ricevute in sospeso (vedi holdPending) viene invece passato direttamente al threadpool
+ * @return 0 in caso di successo, -1 in caso di errore (setta errno)
+ */
+int rearmClient(reactorpool_t *pool, int clientfd);
+
+/**
+ * @brief Restituisce la classe della richiesta che inizia con i size byte di data, ricavata dal suo header.
+ * Con i pool che non usano le classi, o se l'header non è ancora stato ricevuto per intero, la richiesta è NORMAL_TASK
+ */
+taskclass_t requestClass(reactorpool_t *pool, const char *data, size_t size);
+
+/**
+ * @brief Conserva una copia delle richieste già ricevute da un client che viene sospeso senza
+ * essere riattivato (ad esempio in attesa di una lock) o che deve ripassare dal threadpool (vedi rearmClient):
+ * con più richieste in volo sulla stessa connessione non verrebbero più notificate dal reactor
+ * @return 0 in caso di successo, -1 in caso di errore (setta errno)
+ */
+int holdPending(reactorpool_t *pool, int clientfd, const char *data, size_t size);
+
+/**
+ * @brief Chiede al reactor del client di chiudere la connessione
+ * @return 0 in caso di successo, -1 in caso di errore (setta errno)
+ */
+int releaseClient(reactorpool_t *pool, int clientfd);
+
+/**
+ * @brief Restituisce l'username con cui si è presentato il client, stringa vuota se non ha ancora fatto l'handshake
+ */
+const char *clientName(reactorpool_t *pool, int clientfd);
+
+/**
+ * @brief Registra l'username con cui si è presentato il client
+ * @return 0 in caso di successo, -1 in caso di errore (setta errno)
+ */
+int setClientName(reactorpool_t *pool, int clientfd, const char *username);
+
+/**
+ * @brief Restituisce true se il client è connesso via TCP
+ */
+bool clientRemote(reactorpool_t *pool, int clientfd);
+
+/**
+ * @brief Restituisce l'id del trasferimento a chunk in corso sulla connessione, 0 se nessuno
+ */
+unsigned int clientStream(reactorpool_t *pool, int clientfd);
+
+/**
+ * @brief Registra l'id del trasferimento a chunk in corso sulla connessione (0 se terminato o fallito)
+ * @return 0 in caso di successo, -1 in caso di errore (setta errno)
+ */
+int setClientStream(reactorpool_t *pool, int clientfd, unsigned int stream);
+
+/**
+ * @brief Restituisce la dimensione minima dei payload da comprimere nelle risposte al client, 0 se non vanno compressi
+ */
+size_t clientCompress(reactorpool_t *pool, int clientfd);
+
+/**
+ * @brief Registra la dimensione minima dei payload da comprimere nelle risposte al client (0 per non comprimerli)
+ * @return 0 in caso di successo, -1 in caso di errore (setta errno)
+ */
+int setClientCompress(reactorpool_t *pool, int clientfd, size_t minsize);
+
+/**
+ * @brief Restituisce al reactor il buffer in cui è stata ricevuta la richiesta, se presente.
+ * Con io_uring la restituzione viene sottomessa insieme alla successiva riattivazione del client
+ * @return 0 in caso di successo, -1 in caso di errore (setta errno)
+ */
+int recycleBuffer(reactorpool_t *pool, clienttask_t *task);
+
+/**
+ * @brief Attende che tutti i client si siano disconnessi
+ * @return 0 in caso di successo, -1 in caso di errore
+ */
+int drainReactorPool(reactorpool_t *pool);
+
+/**
+ * @brief Termina i thread reactor, dopo la chiamata non vengono più passate richieste al threadpool.
+ * Le istanze epoll o io_uring restano valide finché il pool non viene distrutto.
+ * @return 0 in caso di successo, -1 in caso di errore (setta errno)
+ */
+int stopReactorPool(reactorpool_t *pool);
+
+/**
+ * @brief Termina i thread reactor se ancora attivi e libera le risorse del pool
+ */
+void destroyReactorPool(reactorpool_t *pool);
+
+#endif //FILE_STORAGE_SERVER_REACTOR_H
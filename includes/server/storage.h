@@ -6,6 +6,11 @@
 
 #include <icl_hash.h>
 #include <list.h>
+#include <timerwheel.h>
+
+#if !defined(TTL_TICK_MSEC)
+#define TTL_TICK_MSEC 100
+#endif
 
 typedef struct file_{
     char *filename;
@@ -14,6 +19,8 @@ typedef struct file_{
     char *client_locker;
     list_t *who_opened;
     pthread_rwlock_t *mutex;
+    unsigned long expiration; //tick della ruota dei timer a cui scade il file, 0 se non ha scadenza
+    int memfd; //memfd sigillato che contiene il contenuto (mappato in sola lettura in content), -1 se il contenuto è nello heap
 }file_t;
 
 typedef struct storage_{
@@ -26,12 +33,15 @@ typedef struct storage_{
     list_t* filenames_queue;
     pthread_rwlock_t *mutex;
     list_t *clients_awaiting;
+    timerwheel_t *expirations;  //scadenze dei file con time-to-live
+    list_t *files_expired;      //file scaduti rimossi e non ancora notificati
 
     //Statistiche
     int max_files_number;
     size_t max_occupied_memory;
     int replace_mode;
     int times_replacement_algorithm;
+    int times_expired;
 
 }storage_t;
 
@@ -57,9 +67,10 @@ void fs_destroy(storage_t* storage);
  * @param filename  nome del file da aprire
  * @param flags     flag che indicano come si vuole aprire il file (O_NORMAL, O_CREATE, O_LOCK)
  * @param client    id del client che ha richiesto l'operzione
+ * @param ttl       tempo di vita in millisecondi del file creato (considerato solo con O_CREATE), 0 se non scade
  * @return un intero che indica se l'operazione è stata completata con successo oppure il tipo di errore verficatosi
  */
-int fs_openFile(storage_t* storage, char* filename, int flags, char *client);
+int fs_openFile(storage_t* storage, char* filename, int flags, char *client, long ttl);
 
 /**
  * @brief Legge un file dallo storage se esiste e se l'utente ha i permessi richiesti.
@@ -73,6 +84,28 @@ int fs_openFile(storage_t* storage, char* filename, int flags, char *client);
  */
 int fs_readFile(storage_t *storage, char *pathname, char *client, void **buf, size_t *bytes_read);
 
+/**
+ * @brief Come fs_readFile, ma legge al più maxsize byte del contenuto a partire da offset. Usata per spedire
+ * i file grandi a chunk senza copiarne l'intero contenuto
+ * @param offset      posizione da cui iniziare la lettura, se oltre la fine del file non viene letto nulla
+ * @param maxsize     numero massimo di byte da leggere
+ * @param file_size   se diverso da NULL, dimensione attuale del file
+ * @return un intero che indica se l'operazione è stata completata con successo oppure il tipo di errore verficatosi
+ */
+int fs_readFileChunk(storage_t *storage, char *pathname, char *client, size_t offset, size_t maxsize,
+                     void **buf, size_t *bytes_read, size_t *file_size);
+
+/**
+ * @brief Come fs_readFile, ma invece di copiare il contenuto restituisce un descrittore del memfd sigillato
+ * che lo contiene, da passare al client. Il contenuto dei file di almeno MEMFD_MIN_SIZE byte viene spostato
+ * in un memfd alla prima richiesta e ci resta finché il file non viene modificato
+ * @param fd    descrittore (duplicato, va chiuso dal chiamante) del memfd, -1 se il file è troppo piccolo
+ *              e va letto con fs_readFile
+ * @param size  dimensione del contenuto
+ * @return un intero che indica se l'operazione è stata completata con successo oppure il tipo di errore verficatosi
+ */
+int fs_shareFile(storage_t *storage, char *pathname, char *client, int *fd, size_t *size);
+
 /**
  * @brief Legge N file qualsiasi dallo storage (che hanno un contenuto > 0), se N <= 0 vengono letti tutti quelli
  * presenti nello storage.
@@ -92,12 +125,37 @@ int fs_readNFiles(storage_t *storage, char *client, int N, list_t *files_to_send
  * @param storage       storage su cui effettuare l'operazione
  * @param filename      nome del file da scrivere
  * @param file_size     dimensione del contenuto da scrivere
- * @param file_content  contenuto
+ * @param file_content  buffer allocato dinamicamente con il contenuto: in caso di successo viene adottato dal file
+ *                      (senza copiarlo) e *file_content viene messo a NULL
+ * @param memfd         se diverso da NULL e da -1, memfd da cui proviene il contenuto, mappato in *file_content
+ *                      da fs_mapMemfd: in caso di successo viene adottato insieme alla mappatura e messo a -1
  * @param client        username del client
+ * @param ttl           tempo di vita in millisecondi del file a partire dalla scrittura, 0 per mantenere quello attuale
  * @param filesEjected  lista in cui memorizzare eventuali file espulsi
  * @return un intero che indica se l'operazione è stata completata con successo oppure il tipo di errore verficatosi
  */
-int fs_writeFile(storage_t* storage, char *filename, size_t file_size, void* file_content, char *client, list_t *filesEjected);
+int fs_writeFile(storage_t* storage, char *filename, size_t file_size, void** file_content, int *memfd, char *client, long ttl, list_t *filesEjected);
+
+/**
+ * @brief Crea il file filename e ne effettua la prima scrittura, lasciandolo chiuso: equivale a fs_openFile con
+ * O_CREATE | O_LOCK, fs_writeFile, fs_unlockFile (se flags non contiene O_LOCK) e fs_closeFile in sequenza, ma nessun
+ * altro client può vedere il file prima che sia stato scritto. Con file_size 0 il file viene solo creato.
+ * Può causare l'espulsione di altri file che vengono memorizzati nella lista filesEjected.
+ * I parametri sono quelli di fs_writeFile
+ * @param flags  O_LOCK se il file deve restare in modalità "locked" da parte del client, O_NORMAL altrimenti
+ * @return un intero che indica se l'operazione è stata completata con successo oppure il tipo di errore verficatosi
+ */
+int fs_putFile(storage_t* storage, char *filename, size_t file_size, void** file_content, int *memfd, char *client, long ttl,
+               int flags, list_t *filesEjected);
+
+/**
+ * @brief Mappa in sola lettura il memfd ricevuto da un client, che deve essere sigillato contro scritture e
+ * ridimensionamenti e lungo esattamente size byte: il contenuto non può più cambiare e viene adottato da
+ * fs_writeFile senza copiarlo
+ * @param content  mappatura del contenuto, da rilasciare con munmap se non viene adottata
+ * @return un intero che indica se l'operazione è stata completata con successo oppure il tipo di errore verficatosi
+ */
+int fs_mapMemfd(int memfd, size_t size, void **content);
 
 /**
  * @brief Effettua una scrittura in append al file. Può causare l'espulsione di altri file che vengono
@@ -105,12 +163,13 @@ int fs_writeFile(storage_t* storage, char *filename, size_t file_size, void* fil
  * @param storage       storage su cui effettuare l'operazione
  * @param filename      nome del file da scrivere
  * @param size          dimensione del contenuto da aggiungere in bytes
- * @param data          contenuto da aggiungere al file
+ * @param data          buffer allocato dinamicamente con il contenuto da aggiungere: se il file è vuoto viene adottato
+ *                      (senza copiarlo) e *data viene messo a NULL, altrimenti viene copiato in coda al file
  * @param client        username del client
  * @param filesEjected  lista in cui memorizzare i file espulsi
  * @return un intero che indica se l'operazione è stata completata con successo oppure il tipo di errore verficatosi
  */
-int fs_appendToFile(storage_t* storage, char* filename, size_t size, void* data, char *client, list_t *filesEjected);
+int fs_appendToFile(storage_t* storage, char* filename, size_t size, void** data, char *client, list_t *filesEjected);
 
 /**
  * @brief Tenta di acquisire la mutua esclusione sul file filename. Se la lock sul file
@@ -151,6 +210,16 @@ int fs_closeFile(storage_t* storage, char* filename, char *client);
  */
 int fs_removeFile(storage_t* storage, char* filename, char *client, size_t *deleted_bytes);
 
+/**
+ * @brief Rimuove dallo storage i file il cui tempo di vita è scaduto, con la stessa contabilità
+ * dell'espulsione ma senza restituirne il contenuto. In filesExpired vengono memorizzati nome e dimensione
+ * dei file rimossi (anche di quelli scaduti e recuperati durante una scrittura).
+ * @param storage       storage su cui effettuare l'operazione
+ * @param filesExpired  lista in cui memorizzare i file rimossi (senza contenuto)
+ * @return un intero che indica se l'operazione è stata completata con successo oppure il tipo di errore verficatosi
+ */
+int fs_expireFiles(storage_t *storage, list_t *filesExpired);
+
 /**
  * @brief Dealloca un file
  * @param file - puntatore al file da deallocare
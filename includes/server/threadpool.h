@@ -20,6 +20,59 @@ typedef struct taskfun_t {
     void *arg;
 } taskfun_t;
 
+/**
+ *  @enum poolkind_t
+ *  @brief organizzazione dei task pendenti di un pool, scelta dalla funzione che lo crea
+ */
+typedef enum poolkind {
+    FIFO_POOL,      // coda circolare condivisa, protetta da lock (createThreadPool)
+    STEALING_POOL,  // deque per worker con work stealing (createStealingPool)
+    LOCKFREE_POOL,  // anello MPMC senza lock (createLockfreePool)
+    PRIORITY_POOL   // una coda per classe di task, servite a turno con pesi (createPriorityPool)
+} poolkind_t;
+
+/**
+ *  @enum taskclass_t
+ *  @brief classe di un task per il pool con priorità, dalla più urgente. Gli altri pool le ignorano
+ */
+typedef enum taskclass {
+    SHORT_TASK,     // operazioni brevi, che non devono aspettare dietro ai trasferimenti
+    NORMAL_TASK,
+    BULK_TASK       // trasferimenti grandi
+} taskclass_t;
+#define TASK_CLASSES 3
+
+#define SHORT_WEIGHT 8   // task fatti partire in ogni turno da ciascuna classe del pool con priorità
+#define NORMAL_WEIGHT 4
+#define BULK_WEIGHT 1
+#define SHORT_RESERVED 4 // 1/SHORT_RESERVED della coda e dei worker è riservato ai task brevi
+
+struct wsdeque_;  //deque di un worker del pool con work stealing, vedi threadpool.c
+struct mpmcring_; //anello del pool senza lock, vedi threadpool.c
+struct elastic_;  //stato del pool elastico, vedi threadpool.c
+struct classqueue_; //coda di una classe del pool con priorità, vedi threadpool.c
+
+#define POOL_SAMPLES 64 //campioni della dimensione del pool conservati nelle statistiche
+
+/**
+ *  @struct poolstats_t
+ *  @brief dimensione di un pool nel tempo, vedi getPoolStats
+ *
+ *  @var samples  massimo numero di worker in ogni intervallo di samplesec secondi, dal più vecchio. Quando i
+ *                campioni finiscono vengono fusi a coppie e l'intervallo raddoppia, così coprono tutta l'esecuzione
+ */
+typedef struct poolstats {
+    int minthreads;             // worker sempre presenti
+    int maxthreads;             // worker al massimo
+    int threads;                // worker attuali
+    int peak;                   // massimo numero di worker raggiunto
+    unsigned long spawned;      // worker aggiunti per il carico
+    unsigned long retired;      // worker aggiunti e poi ritirati perche' inattivi
+    int samplesec;
+    int nsamples;
+    int samples[POOL_SAMPLES];
+} poolstats_t;
+
 /**
  *  @struct threadpool
  *  @brief Rappresentazione dell'oggetto threadpool
@@ -34,7 +87,17 @@ typedef struct threadpool_t {
     int taskonthefly;         // numero di task attualmente in esecuzione 
     int head, tail;           // riferimenti della coda
     int count;                // numero di task nella coda dei task pendenti
+    int maxcount;             // massimo numero di task pendenti raggiunto
     int exiting;              // se > 0 e' iniziato il protocollo di uscita, se 1 il thread aspetta che non ci siano piu' lavori in coda
+    poolkind_t kind;          // organizzazione dei task pendenti
+    struct wsdeque_ *deques;  // (work stealing) deque dei worker, una per thread
+    pthread_key_t selfkey;    // (work stealing) deque del worker chiamante, NULL per i thread esterni al pool
+    int pending;              // (work stealing) task in attesa, nella coda globale e nelle deque, compresi quelli in inserimento
+    int ready;                // (work stealing) task in attesa gia' inseriti, che i worker possono prelevare
+    int idle;                 // (work stealing) worker addormentati in attesa di un task
+    struct mpmcring_ *ring;   // (senza lock) anello dei task pendenti
+    struct elastic_ *elastic; // worker aggiunti e ritirati secondo il carico, NULL se il pool ha dimensione fissa
+    struct classqueue_ *classes; // (priorità) code dei task pendenti, una per classe
 } threadpool_t;
 
 /**
@@ -47,6 +110,69 @@ typedef struct threadpool_t {
  */
 threadpool_t *createThreadPool(int numthreads, int pending_size);
 
+/**
+ * @function createElasticPool
+ * @brief Crea un thread pool come createThreadPool, che aggiunge worker quando quelli presenti sono tutti
+ * occupati (anche bloccati su un client lento) e il task pendente più vecchio aspetta da almeno waitmsec
+ * millisecondi, e ritira quelli aggiunti quando per idlemsec millisecondi non sono serviti
+ * @param minthreads   numero di thread sempre presenti
+ * @param maxthreads   numero massimo di thread
+ * @param pending_size numero massimo di task pendenti, che deve essere > 0
+ * @param waitmsec     attesa in coda oltre la quale si aggiunge un worker
+ * @param idlemsec     intervallo dopo cui i worker aggiunti che non sono serviti vengono ritirati
+ *
+ * @return un nuovo thread pool oppure NULL ed errno settato opportunamente
+ */
+threadpool_t *createElasticPool(int minthreads, int maxthreads, int pending_size, int waitmsec, int idlemsec);
+
+/**
+ * @function getPoolStats
+ * @brief copia in stats la dimensione del pool nel tempo. Per i pool di dimensione fissa non ci sono campioni
+ * @return 0 se successo, -1 in caso di fallimento, errno viene settato opportunamente.
+ */
+int getPoolStats(threadpool_t *pool, poolstats_t *stats);
+
+/**
+ * @function createStealingPool
+ * @brief Crea un thread pool con work stealing, usabile con le stesse funzioni di quello creato da createThreadPool.
+ * Ogni worker ha una propria deque (di Chase-Lev) in cui finiscono i task aggiunti dal worker stesso, che li
+ * preleva senza lock; i task aggiunti dagli altri thread entrano in una coda globale, da cui i worker li
+ * prendono a gruppi. Un worker senza lavoro ruba dalle deque degli altri prima di addormentarsi, e chi
+ * aggiunge un task sveglia un worker solo se qualcuno dorme.
+ * @param numthreads è il numero di thread del pool
+ * @param pending_size è il numero massimo di task pendenti, che deve essere > 0
+ *
+ * @return un nuovo thread pool oppure NULL ed errno settato opportunamente
+ */
+threadpool_t *createStealingPool(int numthreads, int pending_size);
+
+/**
+ * @function createLockfreePool
+ * @brief Crea un thread pool senza lock, usabile con le stesse funzioni di quello creato da createThreadPool.
+ * I task pendenti stanno in un anello limitato a più produttori e più consumatori (di Vyukov): inserimento e
+ * prelievo prenotano una posizione con una CAS e la pubblicano con un numero di sequenza, senza mutex.
+ * I worker senza lavoro dormono su un eventcount (un futex), che chi aggiunge un task incrementa solo se
+ * qualcuno dorme.
+ * @param numthreads è il numero di thread del pool
+ * @param pending_size è il numero massimo di task pendenti, che deve essere > 0
+ *
+ * @return un nuovo thread pool oppure NULL ed errno settato opportunamente
+ */
+threadpool_t *createLockfreePool(int numthreads, int pending_size);
+
+/**
+ * @function createPriorityPool
+ * @brief Crea un thread pool che tiene i task pendenti in una coda per classe (vedi addToThreadPoolClass).
+ * In ogni turno ogni classe fa partire fino a SHORT_WEIGHT, NORMAL_WEIGHT e BULK_WEIGHT task, a partire dalla
+ * più urgente. Una parte della coda e dei worker (1/SHORT_RESERVED) è riservata ai task brevi: gli altri non
+ * possono occuparla, così un'operazione breve trova sempre posto e un worker anche durante i trasferimenti grandi
+ * @param numthreads è il numero di thread del pool
+ * @param pending_size è il numero massimo di task pendenti, che deve essere > 0
+ *
+ * @return un nuovo thread pool oppure NULL ed errno settato opportunamente
+ */
+threadpool_t *createPriorityPool(int numthreads, int pending_size);
+
 /**
  * @function destroyThreadPool
  * @brief stoppa tutti i thread e distrugge l'oggetto pool
@@ -67,6 +193,22 @@ int destroyThreadPool(threadpool_t *pool, int force);
  */
 int addToThreadPool(threadpool_t *pool, void (*fun)(void *),void *arg);
 
+/**
+ * @function addToThreadPoolClass
+ * @brief come addToThreadPool, indicando la classe del task. Solo il pool creato con createPriorityPool la
+ * usa, per gli altri equivale ad addToThreadPool; addToThreadPool aggiunge i task come NORMAL_TASK
+ * @return 0 se successo, 1 se la coda (o la parte non riservata, per i task non brevi) è piena, -1 in caso di fallimento
+ */
+int addToThreadPoolClass(threadpool_t *pool, void (*fun)(void *), void *arg, taskclass_t class);
+
+
+/**
+ * @function countPendingTasks
+ * @brief restituisce il numero di task nella coda dei task pendenti, in attesa di un thread libero
+ * @param pool oggetto thread pool
+ * @return numero di task pendenti, -1 in caso di fallimento, errno viene settato opportunamente.
+ */
+int countPendingTasks(threadpool_t *pool);
 
 /**
  * @function spawnThread
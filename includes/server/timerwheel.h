@@ -0,0 +1,79 @@
+#ifndef FILE_STORAGE_SERVER_TIMERWHEEL_H
+#define FILE_STORAGE_SERVER_TIMERWHEEL_H
+
+#include <pthread.h>
+
+#include <list.h>
+
+#define TW_LEVELS 4
+#define TW_SLOT_BITS 6
+#define TW_SLOTS (1 << TW_SLOT_BITS)
+#define TW_SLOT_MASK (TW_SLOTS - 1)
+
+/**
+ * @struct tw_timer_t
+ * @brief timer registrato nella ruota
+ *
+ * @var expire tick a cui scade il timer
+ * @var data   dato associato al timer (di proprietà della ruota finché il timer non scade)
+ */
+typedef struct tw_timer_ {
+    unsigned long expire;
+    void *data;
+} tw_timer_t;
+
+/**
+ * @struct timerwheel_t
+ * @brief ruota dei timer gerarchica a TW_LEVELS livelli da TW_SLOTS slot ciascuno.
+ * Il livello l contiene i timer che scadono entro TW_SLOTS^(l+1) tick dal tick corrente,
+ * quando il livello inferiore compie un giro completo lo slot corrispondente del livello
+ * superiore viene ridistribuito (cascade) sui livelli inferiori.
+ */
+typedef struct timerwheel_ {
+    list_t *slots[TW_LEVELS][TW_SLOTS];
+    unsigned long current;      // prossimo tick da processare
+    long tick_msec;             // durata di un tick in millisecondi
+    unsigned long start_msec;   // istante (CLOCK_MONOTONIC) corrispondente al tick 0
+    int ntimers;                // numero di timer registrati
+    pthread_mutex_t mutex;
+} timerwheel_t;
+
+/**
+ * @brief Crea una ruota dei timer
+ * @param tick_msec  durata di un tick in millisecondi, deve essere > 0
+ * @return puntatore alla ruota creata, NULL in caso di errore (setta errno)
+ */
+timerwheel_t *tw_create(long tick_msec);
+
+/**
+ * @brief Dealloca la ruota e tutti i timer ancora registrati
+ * @param tw         ruota da deallocare
+ * @param free_data  funzione usata per deallocare i dati associati ai timer (può essere NULL)
+ */
+void tw_destroy(timerwheel_t *tw, void (*free_data)(void *));
+
+/**
+ * @brief Registra un timer che scade dopo timeout_msec millisecondi
+ * @param tw            ruota su cui registrare il timer
+ * @param timeout_msec  tempo di vita in millisecondi, deve essere > 0
+ * @param data          dato associato al timer
+ * @param expire        se diverso da NULL, vi viene memorizzato il tick di scadenza del timer
+ * @return 0 in caso di successo, -1 in caso di errore (setta errno)
+ */
+int tw_add(timerwheel_t *tw, long timeout_msec, void *data, unsigned long *expire);
+
+/**
+ * @brief Porta la ruota all'istante corrente, spostando i timer scaduti nella lista expired.
+ * I timer inseriti nella lista (e i loro dati) diventano di proprietà del chiamante.
+ * @param tw       ruota da far avanzare
+ * @param expired  lista in cui memorizzare i timer scaduti (tw_timer_t)
+ * @return 0 in caso di successo, -1 in caso di errore (setta errno)
+ */
+int tw_advance(timerwheel_t *tw, list_t *expired);
+
+/**
+ * @brief Restituisce il tick corrispondente all'istante corrente
+ */
+unsigned long tw_now(timerwheel_t *tw);
+
+#endif //FILE_STORAGE_SERVER_TIMERWHEEL_H
@@ -0,0 +1,76 @@
+#ifndef FILE_STORAGE_SERVER_URING_H
+#define FILE_STORAGE_SERVER_URING_H
+
+/**
+ * @file uring.h
+ * @brief Interfaccia minima verso io_uring tramite le system call, senza liburing.
+ * Compilata solo con IO_URING definito (make IO_URING=1)
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <linux/io_uring.h>
+
+/**
+ * @struct uring_t
+ * @brief istanza io_uring con le code di sottomissione (SQ) e di completamento (CQ) mappate in memoria.
+ * La SQ può essere riempita da più thread (serializzati dalla mutex), la CQ ha un solo consumatore.
+ */
+typedef struct uring_ {
+    int fd;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_entries, *sq_array;
+    struct io_uring_sqe *sqes;
+    unsigned sqe_tail;      // prossimo elemento libero della SQ, pubblicato al kernel da uring_enter
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_cqe *cqes;
+    void *sq_ptr, *cq_ptr;
+    size_t sq_len, cq_len, sqes_len;
+    pthread_mutex_t mutex;  // mutua esclusione tra i produttori della SQ
+} uring_t;
+
+/**
+ * @brief Crea un'istanza io_uring
+ * @param entries  dimensione della coda di sottomissione
+ * @return l'istanza creata, NULL in caso di errore o se il kernel non supporta le operazioni usate (setta errno)
+ */
+uring_t *uring_create(unsigned entries);
+
+/**
+ * @brief Chiude l'istanza, le operazioni ancora in corso vengono cancellate
+ */
+void uring_destroy(uring_t *ring);
+
+/**
+ * @brief Restituisce il prossimo elemento libero della SQ azzerato, va chiamata con la mutex acquisita
+ * e l'elemento va riempito prima di rilasciarla. Diventa visibile al kernel alla prossima uring_enter.
+ * @return l'elemento, NULL se la coda è piena
+ */
+struct io_uring_sqe *uring_getsqe(uring_t *ring);
+
+/**
+ * @brief Sottomette tutti gli elementi in coda e, se wait > 0, attende almeno wait completamenti.
+ * Va chiamata senza la mutex acquisita
+ * @return 0 in caso di successo, -1 in caso di errore (setta errno)
+ */
+int uring_enter(uring_t *ring, unsigned wait);
+
+/**
+ * @brief Restituisce il primo completamento non ancora consumato, NULL se non ce ne sono
+ */
+struct io_uring_cqe *uring_peekcqe(uring_t *ring);
+
+/**
+ * @brief Segnala al kernel che il completamento restituito da uring_peekcqe è stato consumato
+ */
+void uring_cqeseen(uring_t *ring);
+
+void uring_prep_accept(struct io_uring_sqe *sqe, int fd, uint64_t user_data);
+void uring_prep_read(struct io_uring_sqe *sqe, int fd, void *buf, unsigned len, uint64_t user_data);
+void uring_prep_recv_select(struct io_uring_sqe *sqe, int fd, unsigned len, uint16_t group, uint64_t user_data);
+void uring_prep_provide(struct io_uring_sqe *sqe, void *addr, unsigned len, int nbufs, uint16_t group, int bid);
+void uring_prep_recv(struct io_uring_sqe *sqe, int fd, void *buf, unsigned len, int flags, uint64_t user_data);
+void uring_prep_sendmsg(struct io_uring_sqe *sqe, int fd, const struct msghdr *msg, int flags, uint64_t user_data);
+void uring_prep_recvmsg(struct io_uring_sqe *sqe, int fd, struct msghdr *msg, int flags, uint64_t user_data);
+
+#endif //FILE_STORAGE_SERVER_URING_H
@@ -2,19 +2,29 @@
 #define FILE_STORAGE_SERVER_WORKER_H
 
 #include <protocol.h>
+#include <reactor.h>
 
-void requesthandler(int *clientfd);
+#define REQUEST_BURST 16 //massimo numero di richieste già arrivate servite di seguito sullo stesso client
+
+void requesthandler(clienttask_t *task);
+int serverequest(msg_t *request, int fd);
+int rearm(int clientfd);
+bool pendingrequest(int clientfd);
 
 int w_openFile(msg_t *request, int clientfd);
 int w_readFile(msg_t *request, int clientfd);
 int w_readNFile(msg_t *request, int clientfd);
 int w_writeFile(msg_t *request, int clientfd);
+int w_putFile(msg_t *request, int clientfd);
 int w_appendToFile(msg_t *request, int clientfd);
 int w_lockFile(msg_t *request, int clientfd);
 int w_unlockFile(msg_t *request, int clientfd);
 int w_closeFile(msg_t *request, int clientfd);
 int w_removeFile(msg_t *request, int clientfd);
+int w_batch(msg_t *request, int clientfd);
 int w_closeConnection(msg_t *request, int clientfd);
+int w_hello(msg_t *request, int clientfd);
+int w_reject(msg_t *request, int clientfd, int rescode);
 
 int compare_msg_path(void *m1, void *m2);
 int client_waitlock(msg_t *lock_request);
@@ -4,6 +4,7 @@
 #include <unistd.h>
 #include <stdio.h>
 #include <errno.h>
+#include <sys/uio.h>
 
 #if !defined(BUFSIZE)
 #define BUFSIZE 256
@@ -62,4 +63,39 @@ static inline int writen(long fd, void *buf, size_t size) {
     return 1;
 }
 
+/** Avanza l'array iov di written byte: salta i buffer scritti completamente e avanza nel primo
+ *  scritto solo in parte
+ */
+static inline void advanceiov(struct iovec **iov, int *iovcnt, size_t written) {
+    while (*iovcnt > 0 && written >= (*iov)->iov_len) {
+        written -= (*iov)->iov_len;
+        (*iov)++;
+        (*iovcnt)--;
+    }
+    if (*iovcnt > 0) {
+        (*iov)->iov_base = (char *) (*iov)->iov_base + written;
+        (*iov)->iov_len -= written;
+    }
+}
+
+/** Evita scritture parziali di più buffer con un'unica writev: l'array iov viene modificato
+ *  per tenere traccia di quanto è già stato scritto
+ *
+ *   \retval -1   errore (errno settato)
+ *   \retval  0   se durante la scrittura la writev ritorna 0
+ *   \retval  1   se la scrittura termina con successo
+ */
+static inline int writevn(long fd, struct iovec *iov, int iovcnt) {
+    ssize_t r;
+    while (iovcnt > 0) {
+        if ((r = writev((int) fd, iov, iovcnt)) == -1) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (r == 0) return 0;
+        advanceiov(&iov, &iovcnt, (size_t) r);
+    }
+    return 1;
+}
+
 #endif /* CONN_H */
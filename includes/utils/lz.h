@@ -0,0 +1,31 @@
+#if !defined(LZ_H)
+#define LZ_H
+
+#include <stddef.h>
+
+/**
+ * @file lz.h
+ * @brief Compressione LZ77 veloce dei payload, nel formato a blocchi di LZ4: una sequenza di token, ognuno
+ * con una serie di byte letterali seguiti da un riferimento (distanza fino a 64 KB, lunghezza almeno 4)
+ * ai byte già prodotti. L'ultima sequenza contiene solo letterali. Pensata per i contenuti testuali, che si
+ * riducono molto e vengono compressi e decompressi a velocità vicine a quelle di una copia in memoria
+ */
+
+#define LZ_MIN_MATCH 4
+#define LZ_HASH_LOG 12     //posizioni ricordate dal compressore: 2^LZ_HASH_LOG
+#define LZ_LAST_LITERALS 5 //byte finali sempre copiati come letterali
+
+/**
+ * @brief Comprime size byte di src in dst
+ * @param capacity  spazio disponibile in dst
+ * @return i byte scritti in dst, 0 se il risultato non sta in capacity byte (il contenuto non si comprime abbastanza)
+ */
+size_t lz_compress(const void *src, size_t size, void *dst, size_t capacity);
+
+/**
+ * @brief Decomprime size byte di src, prodotti da lz_compress, in dst, che deve ricevere esattamente rawsize byte
+ * @return 0 in caso di successo, -1 se il blocco è malformato (setta errno)
+ */
+int lz_decompress(const void *src, size_t size, void *dst, size_t rawsize);
+
+#endif /* LZ_H */
@@ -0,0 +1,50 @@
+#if !defined(MSGPOOL_H)
+#define MSGPOOL_H
+
+#include <stddef.h>
+
+/**
+ * @file msgpool.h
+ * @brief Riutilizzo per thread dei messaggi e dei buffer dei payload: ogni thread conserva i messaggi
+ * distrutti e i buffer liberati in liste private, da cui vengono ripresi senza sincronizzazione e senza
+ * passare dall'allocatore. I buffer sono divisi in classi di dimensione potenza di 2 e restano blocchi
+ * ottenuti con malloc, quindi possono essere adottati (ad esempio come contenuto di un file) e liberati
+ * con free da chiunque.
+ */
+
+#if !defined(POOL_MSGS)
+#define POOL_MSGS 64              //messaggi conservati al massimo da ogni thread
+#endif
+#if !defined(POOL_BYTES)
+#define POOL_BYTES (8 << 20)      //byte di buffer conservati al massimo da ogni thread
+#endif
+#define POOL_MIN_CLASS 6          //buffer più piccoli conservati: 64 byte
+#define POOL_MAX_CLASS 20         //buffer più grandi conservati: 1 MB, un chunk di STREAM_CHUNK
+#define POOL_ROUND_MAX (64 << 10) //i buffer fino a questa dimensione vengono allocati arrotondati alla classe
+
+struct message; //msg_t, vedi protocol.h
+
+/**
+ * @brief Restituisce un messaggio (msg_t con il suo header) riutilizzato o appena allocato, non inizializzato
+ * @return il messaggio, NULL in caso di errore (setta errno)
+ */
+struct message *pool_getmsg();
+
+/**
+ * @brief Conserva il messaggio per il thread chiamante, o lo libera se il thread ne conserva già abbastanza.
+ * Il payload va liberato a parte (vedi pool_free)
+ */
+void pool_putmsg(struct message *message);
+
+/**
+ * @brief Come malloc, ma riutilizza se possibile un buffer liberato dal thread con pool_free
+ */
+void *pool_alloc(size_t size);
+
+/**
+ * @brief Come free, ma conserva il buffer per il thread chiamante. buf deve essere stato ottenuto con malloc,
+ * direttamente o tramite pool_alloc
+ */
+void pool_free(void *buf);
+
+#endif /* MSGPOOL_H */
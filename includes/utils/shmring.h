@@ -0,0 +1,150 @@
+#if !defined(SHMRING_H)
+#define SHMRING_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/uio.h>
+
+/**
+ * @file shmring.h
+ * @brief Trasporto su memoria condivisa per client e server sullo stesso host: per ogni connessione un memfd
+ * contiene due anelli SPSC di byte, uno per le richieste e uno per le risposte, su cui i messaggi viaggiano
+ * con lo stesso formato usato sul socket. Il socket resta aperto solo per lo scambio del memfd, per svegliare
+ * il server quando la connessione è tornata al reactor e per accorgersi della chiusura dell'altro capo.
+ * Produttore e consumatore girano per qualche microsecondo prima di addormentarsi su un futex, così le
+ * richieste brevi scambiate di seguito non fanno system call.
+ */
+
+#if !defined(SHM_SPIN_USEC)
+#define SHM_SPIN_USEC 50    //attesa attiva prima di addormentarsi sul futex
+#endif
+#if !defined(SHM_WAIT_MSEC)
+#define SHM_WAIT_MSEC 100   //intervallo dopo cui chi dorme controlla che l'altro capo sia ancora connesso
+#endif
+#define SHM_RING_MIN 4096
+#define SHM_RING_MAX (1 << 30)
+
+//stato del consumatore di un anello, indica al produttore come svegliarlo
+#define SHM_ACTIVE   0  //sta leggendo, non serve svegliarlo
+#define SHM_SLEEPING 1  //attende sul futex della coda
+#define SHM_PARKED   2  //la connessione è tornata al reactor: va svegliato con un byte sul socket
+
+/**
+ * @struct shmring_t
+ * @brief anello di byte in memoria condivisa, seguito dai size byte di dati. head e tail sono contatori
+ * liberi modulo 2^32, i byte presenti sono tail - head. Campi scritti da lati diversi su linee di cache diverse
+ *
+ * @var tail    byte scritti dal produttore, il consumatore vi attende con il futex
+ * @var rdwait  stato del consumatore (SHM_*)
+ * @var head    byte consumati, il produttore vi attende con il futex quando l'anello è pieno
+ * @var wrwait  1 se il produttore attende spazio
+ * @var size    capacità in byte, potenza di 2
+ */
+typedef struct shmring_ {
+    uint32_t tail;
+    uint32_t rdwait;
+    char pad1[56];
+    uint32_t head;
+    uint32_t wrwait;
+    char pad2[56];
+    uint32_t size;
+    char pad3[60];
+} shmring_t;
+
+/**
+ * @struct shmchan_t
+ * @brief estremo locale di una connessione su memoria condivisa
+ *
+ * @var tx      anello su cui scrive questo processo
+ * @var rx      anello da cui legge questo processo
+ * @var size    capacità degli anelli, copiata in locale perché quella in memoria condivisa è modificabile dall'altro capo
+ * @var sockfd  socket della connessione
+ */
+typedef struct shmchan_ {
+    void *base;
+    size_t len;
+    shmring_t *tx, *rx;
+    char *txdata, *rxdata;
+    uint32_t size;
+    int sockfd;
+} shmchan_t;
+
+/**
+ * @brief Crea il memfd di una nuova connessione (lato server) con anelli di ringsize byte arrotondati
+ * alla potenza di 2 successiva
+ * @param memfd  memfd da passare al client, va chiuso dal chiamante
+ * @return l'estremo del server, NULL in caso di errore (setta errno)
+ */
+shmchan_t *shmchan_create(int sockfd, size_t ringsize, int *memfd);
+
+/**
+ * @brief Mappa il memfd ricevuto dal server (lato client), dopo averne controllato il formato
+ * @return l'estremo del client, NULL in caso di errore (setta errno)
+ */
+shmchan_t *shmchan_attach(int sockfd, int memfd);
+
+void shmchan_destroy(shmchan_t *chan);
+
+/**
+ * @brief Come writevn, ma scrive nell'anello tx attendendo quando è pieno
+ * @return 1 in caso di successo, 0 se l'altro capo ha chiuso la connessione, -1 in caso di errore (setta errno)
+ */
+int shmchan_writev(shmchan_t *chan, struct iovec *iov, int iovcnt);
+
+/**
+ * @brief Come readn, ma legge dall'anello rx attendendo quando è vuoto
+ * @return size in caso di successo, 0 se l'altro capo ha chiuso la connessione, -1 in caso di errore (setta errno)
+ */
+int shmchan_readn(shmchan_t *chan, void *buf, size_t size);
+
+/**
+ * @brief Controlla, senza bloccarsi, se nell'anello rx ci sono byte da leggere
+ */
+bool shmchan_pending(shmchan_t *chan);
+
+/**
+ * @brief Come shmchan_pending, ma attende attivamente fino a SHM_SPIN_USEC che arrivi qualcosa
+ */
+bool shmchan_poll(shmchan_t *chan);
+
+/**
+ * @brief Il consumatore restituisce la connessione al reactor (SHM_PARKED): da questo momento il produttore
+ * lo sveglia con un byte sul socket. Se nel frattempo sono arrivati dei byte e il produttore non ha ancora
+ * suonato, il consumatore torna attivo
+ * @return true se il consumatore è tornato attivo e deve servire subito la connessione
+ */
+bool shmchan_park(shmchan_t *chan);
+
+/**
+ * @brief Consuma, senza bloccarsi, i byte di risveglio arrivati sul socket
+ * @return 1 se la connessione è ancora aperta, 0 se l'altro capo l'ha chiusa, -1 in caso di errore (setta errno)
+ */
+int shmchan_drain(shmchan_t *chan);
+
+/**
+ * @brief Prepara il registro delle connessioni su memoria condivisa per i fd minori di maxfd.
+ * I programmi con più thread devono chiamarla prima di registrare connessioni, perché il registro
+ * non viene più ingrandito e può essere consultato senza sincronizzazione
+ * @return 0 in caso di successo, -1 in caso di errore (setta errno)
+ */
+int shmchan_reserve(int maxfd);
+
+/**
+ * @brief Associa l'estremo al fd della connessione: da questo momento i messaggi letti e scritti sul fd
+ * (vedi protocol.h) passano dagli anelli
+ * @return 0 in caso di successo, -1 in caso di errore (setta errno)
+ */
+int shmchan_register(int fd, shmchan_t *chan);
+
+/**
+ * @brief Rimuove l'associazione del fd
+ * @return l'estremo associato, da distruggere, NULL se assente
+ */
+shmchan_t *shmchan_unregister(int fd);
+
+/**
+ * @brief Restituisce l'estremo associato al fd, NULL se la connessione usa il socket
+ */
+shmchan_t *shmchan_lookup(int fd);
+
+#endif /* SHMRING_H */
@@ -0,0 +1,47 @@
+#if !defined(SOCKIO_H)
+#define SOCKIO_H
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+/**
+ * @file sockio.h
+ * @brief Operazioni sul socket delle connessioni con cui viaggiano i messaggi (vedi protocol.h). Di default sono
+ * le system call bloccanti di conn.h; un processo può sostituirle, ad esempio il server con il backend io_uring
+ * le sottomette all'anello del reactor della connessione. Le connessioni su memoria condivisa non passano da qui.
+ */
+
+/**
+ * @struct sockio_t
+ * @brief operazioni che sostituiscono quelle di default, con la stessa semantica
+ *
+ * @var readn    come readn
+ * @var writevn  come writevn
+ * @var sendmsg  una sola sendmsg, che può essere parziale
+ * @var recvmsg  una sola recvmsg
+ */
+typedef struct sockio_ {
+    int (*readn)(int fd, void *buf, size_t size);
+    int (*writevn)(int fd, struct iovec *iov, int iovcnt);
+    ssize_t (*sendmsg)(int fd, const struct msghdr *msg, int flags);
+    ssize_t (*recvmsg)(int fd, struct msghdr *msg, int flags);
+} sockio_t;
+
+/**
+ * @brief Sostituisce le operazioni sul socket, NULL ripristina quelle di default.
+ * La struttura deve restare valida finché non viene sostituita
+ */
+void sockio_set(const sockio_t *io);
+
+int sockio_readn(int fd, void *buf, size_t size);
+
+int sockio_writevn(int fd, struct iovec *iov, int iovcnt);
+
+//come sendmsg, ripetuta se interrotta da un segnale
+ssize_t sockio_sendmsg(int fd, const struct msghdr *msg, int flags);
+
+//come recvmsg, ripetuta se interrotta da un segnale
+ssize_t sockio_recvmsg(int fd, struct msghdr *msg, int flags);
+
+#endif /* SOCKIO_H */
@@ -161,6 +161,15 @@ static inline bool checkfile_ext(char *filename, char *extension) {
     return true;
 }
 
+/* istcpaddress(): "host:port" (o "[host]:port") indica un server TCP, qualsiasi altro nome un socket AF_UNIX */
+static inline bool istcpaddress(const char *name) {
+
+    const char *port = strrchr(name, ':');
+    if (!port || strchr(name, '/') || port[1] == '\0')
+        return false;
+    return strspn(port + 1, "0123456789") == strlen(port + 1);
+}
+
 /* msleep(): Sleep for the requested number of milliseconds. */
 static inline int msleep(long msec) {
     struct timespec ts;
@@ -29,11 +29,20 @@ echo ""
 
 #WRITE/WRITE_APPEND
 declare -i sum=0;
-write_op=$(grep -c "/OP/=WRITE" "$LOG_FILE")
-write_ok=$(grep "/OP/=WRITE" "$LOG_FILE" | grep -c "/OUTCOME/=OK")
+# i chunk dei trasferimenti grandi (WRITE_CHUNK) contano solo per i byte scritti
+write_op=$(grep "/OP/=WRITE" "$LOG_FILE" | grep -vc "/OP/=WRITE_CHUNK")
+write_ok=$(grep "/OP/=WRITE" "$LOG_FILE" | grep -v "/OP/=WRITE_CHUNK" | grep -c "/OUTCOME/=OK")
 sum=$(grep "/OP/=WRITE" "$LOG_FILE" | grep "/OUTCOME/=OK" | cut -d ' ' -f5 | cut -d '=' -f2 |  awk '{ SUM += $1} END { print SUM }')
 echo "Write operations requested:" "$write_op"
 echo "Write operations completed with success:" "$write_ok"
+# le PUT creano in lock, scrivono e chiudono il file con un'unica richiesta, e contano anche come scritture.
+# Le WRITE_PUT rilasciano la lock, le WRITE_PUT_LOCK la lasciano al client
+put_op=$(grep -c "/OP/=WRITE_PUT" "$LOG_FILE")
+put_ok=$(grep "/OP/=WRITE_PUT" "$LOG_FILE" | grep -c "/OUTCOME/=OK")
+putunlock_op=$(grep -c "/OP/=WRITE_PUT " "$LOG_FILE")
+putunlock_ok=$(grep "/OP/=WRITE_PUT " "$LOG_FILE" | grep -c "/OUTCOME/=OK")
+echo "Writes requested as a single create-write-close request:" "$put_op"
+echo "Writes completed as a single create-write-close request:" "$put_ok"
 echo "Total bytes written:" "$sum"
 if [ "${write_ok}" -gt 0 ]; then
 write_avg=$(echo "scale=2; ${sum} / ${write_ok}" | bc -l)
@@ -50,30 +59,30 @@ opencreatelock_op=$(grep -c "/OP/=OPEN_CREATE_LOCK" "$LOG_FILE")
 opencreatelock_ok=$(grep "/OP/=OPEN_CREATE_LOCK" "$LOG_FILE" | grep -c "/OUTCOME/=OK")
 echo "Lock operations requested:" "$lock_op"
 echo "Lock operations completed with success:" "$lock_ok"
-echo "Lock requested when opening/creating a file:" $((openlock_op+opencreatelock_op))
-echo "Lock completed when opening/creating a file:" $((openlock_ok+opencreatelock_ok))
-echo "Total locks completed with success:" $((openlock_ok+opencreatelock_ok+lock_ok))
+echo "Lock requested when opening/creating a file:" $((openlock_op+opencreatelock_op+put_op))
+echo "Lock completed when opening/creating a file:" $((openlock_ok+opencreatelock_ok+put_ok))
+echo "Total locks completed with success:" $((openlock_ok+opencreatelock_ok+put_ok+lock_ok))
 echo ""
 
 #UNLOCK
 unlock_op=$(grep -c "/OP/=UNLOCK" "$LOG_FILE")
 unlock_ok=$(grep "/OP/=UNLOCK" "$LOG_FILE" | grep -c "/OUTCOME/=OK")
-echo "Unlock operations requested:" "$unlock_op"
-echo "Unlock operations completed with success:" "$unlock_ok"
+echo "Unlock operations requested:" $((unlock_op+putunlock_op))
+echo "Unlock operations completed with success:" $((unlock_ok+putunlock_ok))
 echo ""
 
 #OPEN
 open_op=$(grep -c "/OP/=OPEN" "$LOG_FILE")
 open_ok=$(grep "/OP/=OPEN" "$LOG_FILE" | grep -c "/OUTCOME/=OK")
-echo "Open operations requested:" "$open_op"
-echo "Open operations completed with success:" "$open_ok"
+echo "Open operations requested:" $((open_op+put_op))
+echo "Open operations completed with success:" $((open_ok+put_ok))
 echo ""
 
 #CLOSE
 close_op=$(grep -c "/OP/=CLOSE" "$LOG_FILE")
 close_ok=$(grep "/OP/=CLOSE" "$LOG_FILE" | grep -c "/OUTCOME/=OK")
-echo "Close operations requested:" "$close_op"
-echo "Close operations completed with success:" "$close_ok"
+echo "Close operations requested:" $((close_op+put_op))
+echo "Close operations completed with success:" $((close_ok+put_ok))
 echo ""
 
 #MAX CAPACITY
@@ -88,19 +97,33 @@ echo "Maximum files stored:" "$max_files"
 #REPLACEMENT ALGORITHM
 replacement_times=$(grep "/OP/=VICTIM" "$LOG_FILE" | grep -c "/OUTCOME/=OK")
 echo "Replacement algorithm executed times:" "$replacement_times"
+
+#EXPIRE
+expired_files=$(grep -c "/OP/=EXPIRE" "$LOG_FILE")
+expired_bytes=$(grep "/OP/=EXPIRE" "$LOG_FILE" | cut -d ' ' -f4 | cut -d '=' -f2 |  awk '{ SUM += $1} END { print SUM+0 }')
+echo "Files expired:" "$expired_files"
+echo "Total bytes expired:" "$expired_bytes"
+echo ""
+
+#CODA DELLE RICHIESTE
+max_queue=$(grep "/OP/=MAXQUEUE" "$LOG_FILE" | cut -d ' ' -f5 | cut -d '=' -f2)
+throttled=$(grep "/OP/=THROTTLED" "$LOG_FILE" | cut -d ' ' -f5 | cut -d '=' -f2)
+echo "Maximum requests waiting for a worker:" "$max_queue"
+echo "Requests throttled with full queue:" "$throttled"
 echo ""
 
-total_requests=$(grep -v "/OP/=CONNECT" "$LOG_FILE" | grep -v "/OP/=DISCONNECT" | grep -v "/OP/=MAXFILES" | grep -vc "/OP/=MAXCAPACITY")
+total_requests=$(grep -v "/OP/=CONNECT" "$LOG_FILE" | grep -v "/OP/=DISCONNECT" | grep -v "/OP/=MAXFILES" | grep -v "/OP/=MAXCAPACITY" | \
+    grep -v "/OP/=MAXQUEUE" | grep -vc "/OP/=THROTTLED")
 echo "Total requests received:" "$total_requests"
 
 #THREADS
 grep -v "/OP/=CONNECT" "$LOG_FILE" | grep -v "/OP/=DISCONNECT" | grep -v "/OP/=MAXFILES" | grep -v "/OP/=MAXCAPACITY" | \
-cut -d ' ' -f1 | cut -d '=' -f2 | sort | uniq -c | awk '{print "Requests handled by thread worker ["$2"]: "$1}'
+grep -v "/OP/=MAXQUEUE" | grep -v "/OP/=THROTTLED" | cut -d ' ' -f1 | cut -d '=' -f2 | sort | uniq -c | awk '{print "Requests handled by thread worker ["$2"]: "$1}'
 
 #CONNESSIONI
 #cerco il minimo ed il massimo fd durante l'esecuzione
 #la loro differenza+1 corrisponde al numero di client connessi contemporaneamente
-min_client=$( grep -v "/OP/=MAXFILES" "$LOG_FILE" | grep -v "/OP/=MAXCAPACITY" | cut -d ' ' -f3 | cut -d '=' -f2 | sort -g | head -1)
-max_client=$( grep -v "/OP/=MAXFILES" "$LOG_FILE" | grep -v "/OP/=MAXCAPACITY" | cut -d ' ' -f3 | cut -d '=' -f2 | sort -g | tail -1)
+min_client=$( grep -v "/OP/=MAXFILES" "$LOG_FILE" | grep -v "/OP/=MAXCAPACITY" | grep -v "/OP/=MAXQUEUE" | grep -v "/OP/=THROTTLED" | grep -v "/OP/=EXPIRE" | cut -d ' ' -f3 | cut -d '=' -f2 | sort -g | head -1)
+max_client=$( grep -v "/OP/=MAXFILES" "$LOG_FILE" | grep -v "/OP/=MAXCAPACITY" | grep -v "/OP/=MAXQUEUE" | grep -v "/OP/=THROTTLED" | grep -v "/OP/=EXPIRE" | cut -d ' ' -f3 | cut -d '=' -f2 | sort -g | tail -1)
 max_connection=$((max_client-min_client+1))
 echo "Maximum clients connected at the same time: "$max_connection
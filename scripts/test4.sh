@@ -0,0 +1,119 @@
+#!/bin/bash
+echo ""
+echo -e "< TEST 4 STARTING..."
+BASEDIR="$(cd "$(dirname "$(dirname "${BASH_SOURCE[0]}")")" && pwd)"
+SOCKET="$BASEDIR"/storage_sock.sk
+LOGFILE="$BASEDIR"/logs/log.txt
+SENDDIR="$BASEDIR"/tests/test4/send
+STOREDIR="$BASEDIR"/tests/test4/store
+EJECTDIR="$BASEDIR"/tests/test4/ejected
+CLIENT="$BASEDIR"/bin/client
+
+# i file spediti vengono generati ad ogni esecuzione
+rm -rf "$SENDDIR" "$STOREDIR" "$EJECTDIR"
+mkdir -p "$SENDDIR" "$STOREDIR" "$EJECTDIR"
+FAILED=0
+
+# check <descrizione> <comando...>: esegue il comando e ne riporta l'esito
+check() {
+    if "${@:2}"; then
+        echo "< OK: $1"
+    else
+        echo "< FAILED: $1"
+        FAILED=1
+    fi
+}
+# logged <operazione> <file> <esito>: l'operazione sul file compare nel log con l'esito dato
+logged() {
+    grep -q -- "/OP/=$1 .*/OBJECT_FILE/=$2 /OUTCOME/=$3\$" "$LOGFILE"
+}
+# stored <file>: il file letto dal server è stato salvato in STOREDIR identico all'originale
+stored() {
+    cmp -s "$1" "$STOREDIR$1"
+}
+
+echo -e "< Starting server..."
+cd "$BASEDIR" || exit 1
+"$BASEDIR"/bin/server -f "$BASEDIR"/tests/test4/config4.txt &
+# server pid
+SERVER_PID=$!
+export SERVER_PID
+
+sleep 2
+
+echo -e "< Starting clients..."
+echo ""
+
+# TTL: il file scade e viene rimosso dal server
+head -c 2048 /dev/urandom > "$SENDDIR"/ttl
+"$CLIENT" -a client1 -f "$SOCKET" -p -e 300 -W "$SENDDIR"/ttl
+sleep 2
+"$CLIENT" -a client1 -f "$SOCKET" -p -r "$SENDDIR"/ttl -d "$STOREDIR"
+check "file expired after its TTL" logged EXPIRE "$SENDDIR"/ttl OK
+check "expired file no longer readable" test ! -e "$STOREDIR$SENDDIR"/ttl
+
+# memoria condivisa: scrittura e lettura passano per gli anelli in memoria condivisa
+head -c 100000 /dev/urandom > "$SENDDIR"/shm
+"$CLIENT" -a client2 -f "$SOCKET" -p -m -W "$SENDDIR"/shm -r "$SENDDIR"/shm -d "$STOREDIR" -c "$SENDDIR"/shm
+check "file read back through shared memory" stored "$SENDDIR"/shm
+check "file removed through shared memory" logged REMOVE "$SENDDIR"/shm OK
+
+# TCP: lo stesso scambio su una connessione TCP
+head -c 100000 /dev/urandom > "$SENDDIR"/tcp
+"$CLIENT" -a client3 -f 127.0.0.1:50404 -p -W "$SENDDIR"/tcp -r "$SENDDIR"/tcp -d "$STOREDIR" -c "$SENDDIR"/tcp
+check "file read back over TCP" stored "$SENDDIR"/tcp
+check "file removed over TCP" logged REMOVE "$SENDDIR"/tcp OK
+
+# espulsioni: con FILE_LIMIT=4 ogni scrittura oltre il limite espelle il file più vecchio
+for f in full0 full1 full2 full3 full4 full5 names0 names1 none0 none1; do
+    head -c 1024 /dev/urandom > "$SENDDIR"/$f
+done
+mkdir -p "$EJECTDIR"/full "$EJECTDIR"/names "$EJECTDIR"/none
+"$CLIENT" -a client4 -f "$SOCKET" -p -E full -W "$SENDDIR"/full0,"$SENDDIR"/full1,"$SENDDIR"/full2,"$SENDDIR"/full3,"$SENDDIR"/full4,"$SENDDIR"/full5 -D "$EJECTDIR"/full
+"$CLIENT" -a client4 -f "$SOCKET" -p -E names -W "$SENDDIR"/names0,"$SENDDIR"/names1 -D "$EJECTDIR"/names
+"$CLIENT" -a client4 -f "$SOCKET" -p -E none -W "$SENDDIR"/none0,"$SENDDIR"/none1 -D "$EJECTDIR"/none
+check "EVICT_FULL delivers the evicted files" cmp -s "$SENDDIR"/full0 "$EJECTDIR"/full"$SENDDIR"/full0
+check "EVICT_FULL delivers the evicted files" cmp -s "$SENDDIR"/full1 "$EJECTDIR"/full"$SENDDIR"/full1
+check "EVICT_NAMES evicts without delivering content" logged VICTIM "$SENDDIR"/full2 OK
+check "EVICT_NAMES evicts without delivering content" test -z "$(ls -A "$EJECTDIR"/names)"
+check "EVICT_NONE evicts without delivering anything" logged VICTIM "$SENDDIR"/full4 OK
+check "EVICT_NONE evicts without delivering anything" test -z "$(ls -A "$EJECTDIR"/none)"
+"$CLIENT" -a client4 -f "$SOCKET" -p -l "$SENDDIR"/names0,"$SENDDIR"/names1,"$SENDDIR"/none0,"$SENDDIR"/none1 -c "$SENDDIR"/names0,"$SENDDIR"/names1,"$SENDDIR"/none0,"$SENDDIR"/none1
+
+# PUT: creazione e scrittura in un'unica richiesta
+head -c 50000 /dev/urandom > "$SENDDIR"/put
+"$CLIENT" -a client5 -f "$SOCKET" -p -W "$SENDDIR"/put -r "$SENDDIR"/put -d "$STOREDIR" -c "$SENDDIR"/put
+check "file created and written with PUT" logged WRITE_PUT_LOCK "$SENDDIR"/put OK
+check "file written with PUT read back" stored "$SENDDIR"/put
+
+# BATCH: le letture consecutive viaggiano insieme, il file oltre BATCH_READ_BUDGET viene letto da solo
+head -c 1000 /dev/urandom > "$SENDDIR"/batch0
+head -c 2000 /dev/urandom > "$SENDDIR"/batch1
+head -c 200000 /dev/urandom > "$SENDDIR"/batch2
+"$CLIENT" -a client6 -f "$SOCKET" -p -W "$SENDDIR"/batch0,"$SENDDIR"/batch1,"$SENDDIR"/batch2
+"$CLIENT" -a client6 -f "$SOCKET" -p -r "$SENDDIR"/batch0,"$SENDDIR"/batch1,"$SENDDIR"/batch2 -d "$STOREDIR" -l "$SENDDIR"/batch0,"$SENDDIR"/batch1,"$SENDDIR"/batch2 -c "$SENDDIR"/batch0,"$SENDDIR"/batch1,"$SENDDIR"/batch2
+for f in batch0 batch1 batch2; do
+    check "file $f read back with BATCH" stored "$SENDDIR"/$f
+    check "file $f removed with BATCH" logged REMOVE "$SENDDIR"/$f OK
+done
+check "file over the BATCH budget left to a single READ" logged READ "$SENDDIR"/batch2 ERR
+
+# LZ: i contenuti comprimibili viaggiano compressi in entrambe le direzioni
+yes "compressible content" | head -c 300000 > "$SENDDIR"/lz
+"$CLIENT" -a client7 -f "$SOCKET" -p -z -W "$SENDDIR"/lz -r "$SENDDIR"/lz -d "$STOREDIR" -c "$SENDDIR"/lz
+check "compressed file read back" stored "$SENDDIR"/lz
+check "compressed file removed" logged REMOVE "$SENDDIR"/lz OK
+
+echo ""
+echo -e "< Terminating server with SIGHUP"
+echo ""
+kill -s SIGHUP $SERVER_PID
+wait $SERVER_PID
+echo ""
+if [ $FAILED -ne 0 ]; then
+    echo -e "< TEST 4 FAILED"
+    echo ""
+    exit 1
+fi
+echo -e "< TEST 4 COMPLETED"
+echo ""
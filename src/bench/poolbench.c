@@ -0,0 +1,97 @@
+/**
+ * @file poolbench.c
+ * @brief Microbenchmark dei threadpool: misura i task al secondo smaltiti da ogni tipo di pool al variare del
+ * numero di worker, con alcuni thread esterni che aggiungono task come fanno i reactor del server.
+ * Uso: poolbench [task per prova] [iterazioni di lavoro per task]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include <util.h>
+#include <threadpool.h>
+
+#define PRODUCERS 4
+#define PENDING 50 //come PENDING_SIZE del server
+
+typedef struct bench_ {
+    threadpool_t *pool;
+    long ntasks;      //task aggiunti da ogni produttore
+    long work;
+} bench_t;
+
+static volatile unsigned long sink;
+
+//lavoro simulato di una richiesta, senza accessi a memoria condivisa
+static void task(void *arg) {
+    long work = (long) arg;
+    unsigned long x = 0;
+    for (long i = 0; i < work; i++) x += (unsigned long) i * 2654435761u;
+    sink = x;
+}
+
+//un produttore ripete l'aggiunta finché la coda è piena, invece di sospendere il task come il reactor
+static void *producer(void *arg) {
+    bench_t *bench = (bench_t *) arg;
+    for (long i = 0; i < bench->ntasks; i++) {
+        int ret;
+        while ((ret = addToThreadPool(bench->pool, task, (void *) bench->work)) == 1) sched_yield();
+        if (ret == -1) {
+            perror("addToThreadPool");
+            exit(EXIT_FAILURE);
+        }
+    }
+    return NULL;
+}
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+//task al secondo con nworkers worker, misurati fino alla fine dell'esecuzione dell'ultimo task
+static double run(poolkind_t kind, int nworkers, long ntasks, long work) {
+    bench_t bench = {NULL, ntasks / PRODUCERS, work};
+    pthread_t producers[PRODUCERS];
+
+    switch (kind) {
+        case STEALING_POOL: bench.pool = createStealingPool(nworkers, PENDING); break;
+        case LOCKFREE_POOL: bench.pool = createLockfreePool(nworkers, PENDING); break;
+        default: bench.pool = createThreadPool(nworkers, PENDING);
+    }
+    CHECK_EQ_EXIT(bench.pool, NULL, "create threadpool")
+
+    double start = now();
+    for (int i = 0; i < PRODUCERS; i++)
+        CHECK_NEQ_EXIT(pthread_create(&producers[i], NULL, producer, &bench), 0, "pthread_create")
+    for (int i = 0; i < PRODUCERS; i++)
+        CHECK_NEQ_EXIT(pthread_join(producers[i], NULL), 0, "pthread_join")
+    //l'uscita non forzata attende i task ancora in coda
+    CHECK_EQ_EXIT(destroyThreadPool(bench.pool, 0), -1, "destroy threadpool")
+    return bench.ntasks * PRODUCERS / (now() - start);
+}
+
+int main(int argc, char *argv[]) {
+    long ntasks = (argc > 1) ? atol(argv[1]) : 200000;
+    long work = (argc > 2) ? atol(argv[2]) : 100;
+    if (ntasks < PRODUCERS || work < 0) {
+        fprintf(stderr, "usage: %s [tasks] [work]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    printf("%ld task, %d produttori, coda di %d task, %ld iterazioni per task (Ktask/s)\n",
+           ntasks, PRODUCERS, PENDING, work);
+    printf("%8s %12s %12s %12s\n", "workers", "FIFO", "STEALING", "LOCK_FREE");
+    for (int nworkers = 1; nworkers <= 64; nworkers *= 2) {
+        printf("%8d", nworkers);
+        printf(" %12.1f", run(FIFO_POOL, nworkers, ntasks, work) / 1e3);
+        printf(" %12.1f", run(STEALING_POOL, nworkers, ntasks, work) / 1e3);
+        printf(" %12.1f\n", run(LOCKFREE_POOL, nworkers, ntasks, work) / 1e3);
+        fflush(stdout);
+    }
+    return 0;
+}
@@ -24,8 +24,10 @@ int request_delay = 0;
 extern bool Verbose;
 extern bool already_connected;
 extern char *username;
+extern long file_ttl;
 
 void sendrequests();
+void sendbatch(cmdrequest *first);
 void destroyrequest(cmdrequest *request);
 int isdot(const char dir[]);
 queue_t* lsR(const char nomedir[], queue_t *files, int *n);
@@ -45,7 +47,7 @@ int main(int argc, char* argv[]) {
     char *tok;
     CHECK_EQ_EXIT(requests = init_queue(), NULL, "init request queue")
 
-    while ((opt = getopt(argc, argv, ":ha:f:w:W:Dr:dR::t::l:u:c:p")) != -1) {
+    while ((opt = getopt(argc, argv, ":ha:f:w:W:Dr:dR::t::e:l:u:c:pmzE:")) != -1) {
 
         switch (opt) {
             case ':': {
@@ -82,8 +84,8 @@ int main(int argc, char* argv[]) {
                     printf("< Client already connected. Cannot repeat -%c option multiple times\n", opt);
                     exit(EXIT_FAILURE);
                 }
-                if (!checkfile_ext(optarg, "sk")) {
-                    printf("< Invalid argument for -f option. %s is not a valid socket file\n", optarg);
+                if (!checkfile_ext(optarg, "sk") && !istcpaddress(optarg)) {
+                    printf("< Invalid argument for -f option. %s is not a valid socket file or host:port address\n", optarg);
                     exit(EXIT_FAILURE);
                 }
                 size_t length;
@@ -308,6 +310,17 @@ int main(int argc, char* argv[]) {
                 request_delay = (int) n;
                 break;
             }
+            case 'e': {
+                long n = 0;
+                if (isNumber(optarg, &n) != 0 || n < 0) {
+                    if (errno == ERANGE)
+                        printf("< Invalid argument for -e option. %s is out of range\n", optarg);
+                    else printf("< Invalid argument for -e option. %s must be a non negative number\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                file_ttl = n;
+                break;
+            }
             case 'l': {
                 tok = strtok_r(optarg, ",", &tmpstr);
                 do {
@@ -352,6 +365,27 @@ int main(int argc, char* argv[]) {
                 Verbose = true;
                 break;
             }
+            case 'm': {
+                //le opzioni vengono eseguite dopo il parsing, la connessione non è ancora aperta
+                CHECK_EQ_EXIT(setSharedMemory(1), -1, "setSharedMemory")
+                break;
+            }
+            case 'z': {
+                CHECK_EQ_EXIT(setCompression(1), -1, "setCompression")
+                break;
+            }
+            case 'E': {
+                int mode;
+                if (strcmp(optarg, "full") == 0) mode = EVICT_FULL;
+                else if (strcmp(optarg, "names") == 0) mode = EVICT_NAMES;
+                else if (strcmp(optarg, "none") == 0) mode = EVICT_NONE;
+                else {
+                    printf("< Invalid argument for -E option. %s must be full, names or none\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                CHECK_EQ_EXIT(setEvictionMode(mode), -1, "setEvictionMode")
+                break;
+            }
             default: {
                 printf("< Unrecognised option -%c\n", optopt);
                 exit(EXIT_FAILURE);
@@ -374,6 +408,18 @@ void sendrequests() {
     assert(requests != NULL);
     char *tmpstr;
     while ((request = (cmdrequest *) pop(requests))) {
+        //le richieste consecutive di -r, -u o -c vengono eseguite insieme, se tra l'una e l'altra non si deve attendere.
+        //Le -l restano singole: in un BATCH le lock non attendono e riprovarle dopo ne cambierebbe l'ordine
+        if (request_delay == 0 && strchr("ruc", request->opt) && requests->head
+            && ((cmdrequest *) requests->head->data)->opt == request->opt) {
+            sendbatch(request);
+            if (errno == ECONNRESET) {
+                already_connected = false;
+                exit(EXIT_FAILURE);
+            }
+            destroyrequest(request);
+            continue;
+        }
         switch (request->opt) {
             case 'f': {
                 CHECK_EQ_EXIT(sktname = strndup(request->arg, strlen(request->arg)), NULL, "strdup")
@@ -392,7 +438,8 @@ void sendrequests() {
                     PRINT_PERROR("realpath")
                     break;
                 }
-                if (openFile(abspath, O_CREATE | O_LOCK) == -1){
+                //creazione e scrittura viaggiano in un'unica richiesta, il file resta in lock al client come prima
+                if (putFile(abspath, O_LOCK, storedir) == -1){
                     if (errno == EEXIST) { // se il file esiste già possiamo scriverlo solamente in append
                         if (openFile(abspath, O_NORMAL) == -1) break;
                         void *buf = NULL;
@@ -410,26 +457,19 @@ void sendrequests() {
                     }
                     break;
                 }
-                if (writeFile(abspath, storedir) == -1) break;
-                if (closeFile(abspath) == -1) break;
                 break;
             }
             case 'r': {
                 char *file = strtok_r(request->arg, ",", &tmpstr);  //file da leggere
                 void *buf = NULL;
                 size_t bufsize = 0;
-                if (openFile(file, O_NORMAL) == -1) break;
-                if (readFile(file, &buf, &bufsize) == -1) break;
-                if (closeFile(file) == -1) {
-                    free(buf);
-                    break;
-                }
+                if (fetchFile(file, &buf, &bufsize) == -1) break;
                 char *storedir = strtok_r(NULL, ",", &tmpstr); //directory d
                 if (storedir && storefile(storedir, file, buf, bufsize) == -1) {
-                    free(buf);
+                    unmapFile(buf, bufsize);
                     break;
                 }
-                free(buf);
+                unmapFile(buf, bufsize);
                 break;
             }
             case 'R': {
@@ -474,6 +514,67 @@ void sendrequests() {
     requests = NULL;
 }
 
+//esegue con batchFiles la richiesta first e le successive con la stessa opzione ancora in coda: ogni file di -r
+//diventa OPEN, READ e CLOSE, ogni file di -u e -c una UNLOCK o REMOVE
+void sendbatch(cmdrequest *first) {
+    char *tmpstr;
+    int n = 1;
+    for (node_t *node = requests->head; node && ((cmdrequest *) node->data)->opt == first->opt; node = node->next) n++;
+    int per = (first->opt == 'r') ? 3 : 1; //operazioni per file
+    cmdrequest **items = NULL;
+    char **storedirs = NULL;
+    batchop_t *ops = NULL;
+    CHECK_EQ_EXIT(items = malloc(n * sizeof(cmdrequest *)), NULL, "malloc")
+    CHECK_EQ_EXIT(storedirs = calloc(n, sizeof(char *)), NULL, "calloc")
+    CHECK_EQ_EXIT(ops = calloc(n * per, sizeof(batchop_t)), NULL, "calloc")
+
+    items[0] = first;
+    for (int i = 1; i < n; i++) items[i] = pop(requests);
+    for (int i = 0; i < n; i++) {
+        char *file = strtok_r(items[i]->arg, ",", &tmpstr);
+        if (first->opt == 'r') {
+            storedirs[i] = strtok_r(NULL, ",", &tmpstr); //directory d
+            const int codes[3] = {OPEN, READ, CLOSE};
+            for (int j = 0; j < 3; j++) {
+                ops[i * 3 + j].code = codes[j];
+                ops[i * 3 + j].flags = O_NORMAL;
+                ops[i * 3 + j].pathname = file;
+            }
+        } else {
+            ops[i].code = (first->opt == 'u') ? UNLOCK : REMOVE;
+            ops[i].pathname = file;
+        }
+    }
+
+    batchFiles(n * per, ops);
+    int errnosv = errno;
+    for (int i = 0; i < n; i++) {
+        if (first->opt == 'r') {
+            batchop_t *op = ops + i * 3;
+            if (op[0].result == 0 && op[1].result == 0 && op[2].result == 0 && storedirs[i])
+                storefile(storedirs[i], (char *) op[1].pathname, op[1].buf, op[1].size);
+            free(op[1].buf);
+            if (op[1].result == EFBIG) {
+                //il file non sta nella risposta del BATCH: lo si legge da solo, a chunk o in un memfd
+                void *buf = NULL;
+                size_t bufsize = 0;
+                if (fetchFile(op[1].pathname, &buf, &bufsize) == -1) {
+                    if (errno == ECONNRESET) errnosv = errno;
+                    continue;
+                }
+                if (storedirs[i]) storefile(storedirs[i], (char *) op[1].pathname, buf, bufsize);
+                unmapFile(buf, bufsize);
+            }
+        }
+    }
+    errno = errnosv;
+
+    for (int i = 1; i < n; i++) destroyrequest(items[i]);
+    free(items);
+    free(storedirs);
+    free(ops);
+}
+
 int isdot(const char dir[]) {
     int l = (int)strlen(dir);
 
@@ -523,7 +624,7 @@ void printcommands(char **args){
     printf(
     "Usage: %s -a <username> -f <socketfile> [OPTIONS]\n"
     "-h                     Prints help message.\n"
-    "-f <sockefile>         Specifies the connections socket.\n"
+    "-f <sockefile>         Specifies the connections socket, or host:port to connect to the server over TCP.\n"
     "-w <dirname>[,n=0]     Requests a write for all files inside dirname. If dirname contains other subdirectories,\n"
     "                       these are recursively visited and no more than n files are written.\n"
     "                       If n was not included or n = 0 then there is no limit to the number of files\n"
@@ -537,10 +638,17 @@ void printcommands(char **args){
     "-d <dirname>           Specifies the path of the directory in which to save the files received from the server\n"
     "                       following a read. This option must be used jointly with -r or -R.\n"
     "-t <time>              Sets the time in milliseconds between two consecutive requests to the server.\n"
+    "-e <time>              Sets the time-to-live in milliseconds of the files created and written by the client.\n"
+    "                       Expired files are removed from the server. If 0 (default) files never expire.\n"
     "-l file1[,file2]       Requests mutual exclusion access for all files distinguished by ',' in the list.\n"
     "-u file1[,file2]       Requests release of mutual exclusion for all files distinguished by ',' in the list.\n"
     "-c file1[,file2]       Requests deletion for all files distinguished by ',' in the list.\n"
-    "-p                     Enables screen dialog for each operation.\n", args[0]);
+    "-p                     Enables screen dialog for each operation.\n"
+    "-E <full|names|none>   Sets what the server sends back of the files ejected by a write: name and content\n"
+    "                       (default, only names and sizes when -D is not used), names and sizes, or nothing.\n"
+    "-m                     Exchanges requests and responses with the server through shared memory when the\n"
+    "                       server allows it (SHM_RING_SIZE). Otherwise the socket is used.\n"
+    "-z                     Compresses the contents read and written, when the server allows it (COMPRESS_MIN_SIZE).\n", args[0]);
 
 }
 
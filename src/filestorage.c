@@ -1,7 +1,13 @@
-
+#define _GNU_SOURCE //sigilli dei memfd
 #include <stdlib.h>
+#include <fcntl.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <sys/un.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 
 #include <filestorage.h>
 #include <protocol.h>
@@ -10,7 +16,31 @@ bool Verbose = false;
 bool already_connected = false;
 char socketname[UNIX_PATH_MAX];
 int socketfd = -1;
+bool remote = false; //connessione TCP, su cui non possono viaggiare descrittori
 char *username;
+long file_ttl = 0;
+bool shm_requested = false; //alla connessione chiede al server di passare alla memoria condivisa
+bool lz_requested = false; //alla connessione chiede al server di comprimere i payload
+bool lz_enabled = false; //compressione concordata con il server sulla connessione aperta
+int evict_mode = EVICT_FULL; //cosa ricevere dei file espulsi dalle scritture, vedi setEvictionMode
+unsigned int last_id = 0; //id dell'ultima richiesta inviata
+
+static int sendrequest(msg_t *request);
+static int recvresponse(msg_t *response, unsigned int id);
+static int sendcontent(int code, int flags, const char *pathname, void *data, size_t size, const char *dirname,
+                       int *files_recv, int *files_stored, size_t *bytes_stored, char *errdesc);
+static int sendmemfd(int code, int flags, const char *pathname, int fd, size_t size, const char *dirname,
+                     int *files_recv, int *files_stored, size_t *bytes_stored, char *errdesc);
+static int recvreplies(unsigned int id, const char *func, const char *pathname, const char *dirname,
+                       int *files_recv, int *files_stored, size_t *bytes_stored, char *errdesc);
+static int loadmemfd(const char *pathname, int *fd, size_t *size);
+static int recvcontent(unsigned int id, int *code, void **buf, size_t *size, bool map);
+static void *mapmemfd(int fd, size_t size);
+static int handshake();
+static int resolve(const char *sockname, struct sockaddr_storage *sa, socklen_t *salen);
+static bool fdpassing();
+static int evictmode(const char *dirname);
+static const char *opname(int code);
 
 int openConnection(const char *sockname, int msec, const struct timespec abstime) {
 
@@ -36,29 +66,51 @@ int openConnection(const char *sockname, int msec, const struct timespec abstime
         goto error;
     }
 
-    struct sockaddr_un sa;
-    memset(&sa, 0, sizeof(sa));
-    strncpy(sa.sun_path, sockname, UNIX_PATH_MAX);
-    sa.sun_family = AF_UNIX;
-    if ((socketfd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1){
-        strcpy(errdesc, "creating socket");
+    struct sockaddr_storage sa;
+    socklen_t salen;
+    if (resolve(sockname, &sa, &salen) == -1) {
+        strcpy(errdesc, "resolving server address");
         goto error;
     }
+    remote = (sa.ss_family != AF_UNIX);
 
     time_t now;
     time(&now);
-    int connres;
     verbose("< %s: Connecting to server ...\n", username);
-    while ((connres = connect(socketfd, (struct sockaddr *) &sa, sizeof(sa)) == -1)
-           && now < abstime.tv_sec) {
+    //dopo un connect fallito lo stato di un socket TCP non è definito, ad ogni tentativo ne viene creato uno nuovo
+    while (1) {
+        if ((socketfd = socket(sa.ss_family, SOCK_STREAM, 0)) == -1){
+            strcpy(errdesc, "creating socket");
+            goto error;
+        }
+        if (connect(socketfd, (struct sockaddr *) &sa, salen) == 0) break;
+        close(socketfd);
+        socketfd = -1;
+        if (now >= abstime.tv_sec) {
+            strcpy(errdesc, "connecting to server\n");
+            errno = ETIMEDOUT;
+            goto error;
+        }
         verbose("< %s: Unable to connect to server. Retrying in %d msec\n", username, msec);
 
         msleep(msec);
         time(&now);
     }
-    if (connres != 0) {
-        strcpy(errdesc, "connecting to server\n");
-        errno = ETIMEDOUT;
+    //richieste e risposte sono messaggi brevi scambiati a botta e risposta, l'algoritmo di Nagle li ritarderebbe
+    int nodelay = 1;
+    if (remote && setsockopt(socketfd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay)) == -1) {
+        int errnosv = errno;
+        strcpy(errdesc, "setting TCP_NODELAY");
+        close(socketfd);
+        errno = errnosv;
+        goto error;
+    }
+    //l'username viene comunicato una sola volta per connessione
+    if (handshake() == -1) {
+        int errnosv = errno;
+        strcpy(errdesc, "during the handshake with server");
+        close(socketfd);
+        errno = errnosv;
         goto error;
     }
     already_connected = true;
@@ -99,7 +151,7 @@ int closeConnection(const char *sockname) {
             strcpy(errdesc, "building the message to be send");
             goto error;
         }
-        if (writemsg(socketfd, request) <= 0) {
+        if (sendrequest(request) <= 0) {
             strcpy(errdesc, "writing the request to server");
             goto error;
         }
@@ -108,7 +160,7 @@ int closeConnection(const char *sockname) {
             strcpy(errdesc, "initialising the response to be received");
             goto error;
         }
-        if (readmsg(socketfd, response) < 0) {
+        if (recvresponse(response, request->header->id) < 0) {
             strcpy(errdesc, "reading the response from server");
             goto error;
         }
@@ -117,6 +169,7 @@ int closeConnection(const char *sockname) {
             goto error;
         }
     }
+    shmchan_destroy(shmchan_unregister(socketfd));
     if (close(socketfd) == -1) {
         strcpy(errdesc, "closing socket");
         goto error;
@@ -168,7 +221,8 @@ int openFile(const char *pathname, int flags) {
         strcpy(errdesc, "building the message to be send");
         goto error;
     }
-    if (writemsg(socketfd, request) <= 0) {
+    if (flags & O_CREATE) request->header->ttl = file_ttl;
+    if (sendrequest(request) <= 0) {
         strcpy(errdesc, "writing the request to server");
         goto error;
     }
@@ -176,7 +230,7 @@ int openFile(const char *pathname, int flags) {
         strcpy(errdesc, "initialising the response to be received");
         goto error;
     }
-    if (readmsg(socketfd, response) <= 0) {
+    if (recvresponse(response, request->header->id) <= 0) {
         strcpy(errdesc, "reading the response from server");
         goto error;
     }
@@ -201,7 +255,6 @@ int readFile(const char *pathname, void **buf, size_t *size) {
 
     char errdesc[STRERROR_LEN] = "";
     msg_t *request = NULL;
-    msg_t *response = NULL;
     *buf = NULL;
 
     if (already_connected == false) {
@@ -224,46 +277,120 @@ int readFile(const char *pathname, void **buf, size_t *size) {
         strcpy(errdesc, "building the message to be send");
         goto error;
     }
-    if (writemsg(socketfd, request) <= 0) {
+    //i file grandi possono arrivare a chunk
+    request->header->flags = FLAG_STREAM;
+    if (sendrequest(request) <= 0) {
         strcpy(errdesc, "writing the request to server");
         goto error;
     }
 
-    if ((response = initmsg()) == NULL) {
-        strcpy(errdesc, "initialising the response to be received");
+    int rescode;
+    if (recvcontent(request->header->id, &rescode, buf, size, false) == -1) {
+        strcpy(errdesc, "reading the response from server");
         goto error;
     }
-    if (readmsg(socketfd, response) <= 0) {
-        strcpy(errdesc, "reading the response from server");
+    if (rescode != EXIT_SUCCESS) {
+        errno = rescode;
         goto error;
     }
 
-    if (response->header->code != EXIT_SUCCESS) {
-        errno = response->header->code;
+    verbose("< %s: %s (%s) completed: read %d bytes\n", username, __func__, pathname, *size);
+    destroymsg(request);
+    return 0;
+
+    error:
+    verbose("< %s: %s (%s) failed: there was an error %s: %s\n", username, __func__, pathname, errdesc, strerror(errno));
+    if (*buf) free(*buf);
+    if (request) destroymsg(request);
+    return -1;
+}
+
+int fetchFile(const char *pathname, void **buf, size_t *size) {
+
+    char errdesc[STRERROR_LEN] = "";
+    const int codes[3] = {OPEN, READ, CLOSE};
+    msg_t *requests[3] = {NULL, NULL, NULL};
+    msg_t *response = NULL;
+    int rescode = EXIT_SUCCESS;
+    *buf = NULL;
+
+    if (already_connected == false) {
+        errno = ENOTCONN;
+        goto error;
+    }
+    if (!pathname) {
+        strcpy(errdesc, "with argument pathname");
+        errno = EINVAL;
         goto error;
     }
+    if (strlen(pathname) >= MAX_PATH) {
+        strcpy(errdesc, "with argument pathname");
+        errno = ENAMETOOLONG;
+        goto error;
+    }
+
+    //le tre richieste vengono inviate senza attendere le risposte
+    for (int i = 0; i < 3; i++) {
+        if ((requests[i] = buildmsg(username, codes[i], (codes[i] == OPEN ? O_NORMAL : -1), pathname, 0, NULL)) == NULL) {
+            strcpy(errdesc, "building the message to be send");
+            goto error;
+        }
+        //i file grandi possono arrivare in un memfd da mappare invece che sul socket
+        if (codes[i] == READ)
+            requests[i]->header->flags = FLAG_STREAM | (fdpassing() ? FLAG_MEMFD : 0);
+        if (sendrequest(requests[i]) <= 0) {
+            strcpy(errdesc, "writing the request to server");
+            goto error;
+        }
+    }
 
-    *buf = malloc(response->header->data_size);
-    if (*buf == NULL) {
-        strcpy(errdesc, "allocating the buffer");
+    //raccolgo comunque tutte le risposte per non lasciarne in sospeso sulla connessione,
+    //l'esito è quello della prima richiesta fallita
+    for (int i = 0; i < 3; i++) {
+        int code;
+        if (codes[i] == READ) {
+            if (recvcontent(requests[i]->header->id, &code, buf, size, true) == -1) {
+                strcpy(errdesc, "reading the response from server");
+                goto error;
+            }
+        } else {
+            if ((response = initmsg()) == NULL) {
+                strcpy(errdesc, "initialising the response to be received");
+                goto error;
+            }
+            if (recvresponse(response, requests[i]->header->id) <= 0) {
+                strcpy(errdesc, "reading the response from server");
+                goto error;
+            }
+            code = response->header->code;
+            destroymsg(response);
+            response = NULL;
+        }
+        if (code != EXIT_SUCCESS && rescode == EXIT_SUCCESS) rescode = code;
+    }
+    if (rescode != EXIT_SUCCESS) {
+        errno = rescode;
         goto error;
     }
-    memcpy(*buf, response->data, response->header->data_size);
-    *size = response->header->data_size;
 
-    verbose("< %s: %s (%s) completed: read %d bytes\n", username, __func__, pathname, response->header->data_size);
-    destroymsg(request);
-    destroymsg(response);
+    verbose("< %s: %s (%s) completed: read %d bytes\n", username, __func__, pathname, *size);
+    for (int i = 0; i < 3; i++) destroymsg(requests[i]);
     return 0;
 
     error:
     verbose("< %s: %s (%s) failed: there was an error %s: %s\n", username, __func__, pathname, errdesc, strerror(errno));
-    if (*buf) free(*buf);
-    if (request) destroymsg(request);
+    if (*buf) unmapFile(*buf, *size);
+    *buf = NULL;
+    for (int i = 0; i < 3; i++)
+        if (requests[i]) destroymsg(requests[i]);
     if (response) destroymsg(response);
     return -1;
 }
 
+void unmapFile(void *buf, size_t size) {
+    if (buf) munmap(buf, size);
+}
+
 int readNFiles(int N, const char *dirname) {
 
     char errdesc[STRERROR_LEN] = "";
@@ -288,18 +415,19 @@ int readNFiles(int N, const char *dirname) {
         strcpy(errdesc, "building the message to be send");
         goto error;
     }
-    if (writemsg(socketfd, request) <= 0) {
+    if (sendrequest(request) <= 0) {
         strcpy(errdesc, "writing the request to server");
         goto error;
     }
 
+    bool more;
     do {
         if (response) destroymsg(response);
         if ((response = initmsg()) == NULL) {
             strcpy(errdesc, "initialising the response to be received");
             goto error;
         }
-        if (readmsg(socketfd, response) <= 0) {
+        if (recvresponse(response, request->header->id) <= 0) {
             strcpy(errdesc, "reading the response from server");
             goto error;
         }
@@ -311,23 +439,39 @@ int readNFiles(int N, const char *dirname) {
             errno = response->header->code;
             goto error;
         }
-        if (response->header->arg == 0) break;
-
-        if (dirname) {
-            if (storefile(dirname, response->header->pathname, response->data, response->header->data_size) == -1) {
-                files_recv++;
-                verbose("< %s: %s (%s) : there was an error storing the file received: %s. File %s corrupted\n", username, __func__, N,
-                        strerror(errno), response->header->pathname);
-                continue;
+        more = (response->header->flags & FLAG_MORE);
+
+        //il payload contiene l'indice dei file seguito dai contenuti, che vengono memorizzati senza copiarli
+        const char *end = (const char *) response->data + response->header->data_size;
+        const char *entry = response->data;
+        const char *content = response->data;
+        char filename[MAX_PATH];
+        uint64_t size;
+        for (int i = 0; i < response->header->arg; i++)
+            if ((content = unpackentry(content, end, filename, &size)) == NULL) {
+                strcpy(errdesc, "reading the files received");
+                goto error;
             }
-        } else verbose("< %s: %s (%s) : read %s\n", username, __func__, N, response->header->pathname);
-
-
-        files_recv++;
-        if (dirname) files_stored++;
-        if (dirname) bytes_stored += response->header->data_size;
-
-    } while (files_recv < response->header->arg);
+        for (int i = 0; i < response->header->arg; i++) {
+            entry = unpackentry(entry, end, filename, &size);
+            if ((size_t) (end - content) < size) {
+                errno = EPROTO;
+                strcpy(errdesc, "reading the files received");
+                goto error;
+            }
+            files_recv++;
+            if (dirname) {
+                if (storefile(dirname, filename, (void *) content, size) == -1)
+                    verbose("< %s: %s (%d) : there was an error storing the file received: %s. File %s corrupted\n", username, __func__, N,
+                            strerror(errno), filename);
+                else {
+                    files_stored++;
+                    bytes_stored += size;
+                }
+            } else verbose("< %s: %s (%d) : read %s\n", username, __func__, N, filename);
+            content += size;
+        }
+    } while (more);
 
     files_recv ?
         (dirname ?
@@ -355,10 +499,9 @@ int readNFiles(int N, const char *dirname) {
 
 int writeFile(const char *pathname, const char *dirname) {
     char errdesc[STRERROR_LEN] = "";
-    msg_t *request = NULL;
-    msg_t *response = NULL;
     void *file_content = NULL;
     size_t file_size = 0;
+    int memfd = -1;
     int files_recv = 0;
     int files_stored = 0;
     size_t bytes_stored = 0;
@@ -383,50 +526,25 @@ int writeFile(const char *pathname, const char *dirname) {
         goto error;
     }
 
-    //leggo il contenuto del file prima di spedirlo al server
-    if (readfile(pathname, &file_content, &file_size) == -1){
+    //i file grandi vengono caricati in un memfd che il server adotta senza copiarlo,
+    //gli altri vengono letti in memoria e spediti sul socket
+    if (fdpassing() && loadmemfd(pathname, &memfd, &file_size) == -1) {
         strcpy(errdesc, "reading file content");
         goto error;
     }
-
-    if ((request = buildmsg(username, WRITE, -1, pathname, file_size, file_content)) == NULL) {
-        strcpy(errdesc, "building the message to be send");
-        goto error;
-    }
-    if (writemsg(socketfd, request) <= 0) {
-        strcpy(errdesc, "writing the request to server");
-        goto error;
-    }
-
-    do {
-        if (response) destroymsg(response);
-        if ((response = initmsg()) == NULL) {
-            strcpy(errdesc, "initialising the response to be received");
+    if (memfd != -1) {
+        if (sendmemfd(WRITE, 0, pathname, memfd, file_size, dirname, &files_recv, &files_stored, &bytes_stored, errdesc) == -1)
             goto error;
-        }
-        if (readmsg(socketfd, response) <= 0) {
-            strcpy(errdesc, "reading the response from server");
+        close(memfd);
+        memfd = -1;
+    } else {
+        if (readfile(pathname, &file_content, &file_size) == -1) {
+            strcpy(errdesc, "reading file content");
             goto error;
         }
-        if (response->header->code != EXIT_SUCCESS) {
-            errno = response->header->code;
+        if (sendcontent(WRITE, 0, pathname, file_content, file_size, dirname, &files_recv, &files_stored, &bytes_stored, errdesc) == -1)
             goto error;
-        }
-        if (response->header->arg == 0) break;
-
-        if (dirname) {
-            if (storefile(dirname, response->header->pathname, response->data, response->header->data_size) == -1) {
-                files_recv++;
-                verbose("< %s: %s (%s) : there was an error storing the ejected file received: %s. File %s corrupted\n", username, __func__, request->header->pathname,
-                        strerror(errno), response->header->pathname);
-                continue;
-            }
-        } else verbose("< %s: %s (%s) : received ejected %s\n", username, __func__, request->header->pathname, response->header->pathname);
-
-        files_recv++;
-        if (dirname) files_stored++;
-        if (dirname) bytes_stored += response->header->data_size;
-    } while (files_recv < response->header->arg);
+    }
 
     files_recv ?
         (dirname ?
@@ -436,8 +554,6 @@ int writeFile(const char *pathname, const char *dirname) {
                     __func__, pathname, file_size, files_recv))
     : verbose("< %s: %s (%s) completed: written %d bytes. No ejected files received\n", username,
               __func__, pathname, file_size);
-    destroymsg(request);
-    destroymsg(response);
     free(file_content);
     return 0;
 
@@ -450,17 +566,159 @@ int writeFile(const char *pathname, const char *dirname) {
                     __func__, pathname, errdesc, strerror(errno), files_recv))
     : verbose("< %s: %s (%s) failed: there was an error %s: %s. No ejected files received\n", username,
               __func__, pathname, errdesc,strerror(errno));
-    if (request) destroymsg(request);
-    if (response) destroymsg(response);
     if (file_content) free(file_content);
+    if (memfd != -1) close(memfd);
+    return -1;
+}
+
+int writeMemfd(const char *pathname, int fd, const char *dirname) {
+    char errdesc[STRERROR_LEN] = "";
+    struct stat st;
+    size_t size = 0;
+    int files_recv = 0;
+    int files_stored = 0;
+    size_t bytes_stored = 0;
+
+    if (already_connected == false) {
+        errno = ENOTCONN;
+        goto error;
+    }
+    if (!pathname || fd < 0) {
+        strcpy(errdesc, "with argument pathname or fd");
+        errno = EINVAL;
+        goto error;
+    }
+    if (strlen(pathname) >= MAX_PATH) {
+        strcpy(errdesc, "with argument pathname");
+        errno = ENAMETOOLONG;
+        goto error;
+    }
+    if (dirname && strlen(dirname) >= MAX_PATH) {
+        strcpy(errdesc, "with argument dirname");
+        errno = ENAMETOOLONG;
+        goto error;
+    }
+    if (fstat(fd, &st) == -1) {
+        strcpy(errdesc, "with argument fd");
+        goto error;
+    }
+    size = st.st_size;
+
+    if (!fdpassing()) {
+        //il memfd non può viaggiare su TCP né negli anelli in memoria condivisa, il contenuto viene copiato
+        void *content = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+        if (content == MAP_FAILED) {
+            strcpy(errdesc, "mapping argument fd");
+            goto error;
+        }
+        int res = sendcontent(WRITE, 0, pathname, content, size, dirname, &files_recv, &files_stored, &bytes_stored, errdesc);
+        munmap(content, size);
+        if (res == -1) goto error;
+    } else if (sendmemfd(WRITE, 0, pathname, fd, size, dirname, &files_recv, &files_stored, &bytes_stored, errdesc) == -1)
+        goto error;
+
+    verbose("< %s: %s (%s) completed: written %zu bytes, received %d ejected files, stored %d\n", username,
+            __func__, pathname, size, files_recv, files_stored);
+    return 0;
+
+    error:
+    verbose("< %s: %s (%s) failed: there was an error %s: %s. Received %d ejected files, stored %d\n", username,
+            __func__, pathname, errdesc, strerror(errno), files_recv, files_stored);
+    return -1;
+}
+
+int putFile(const char *pathname, int flags, const char *dirname) {
+
+    char errdesc[STRERROR_LEN] = "";
+    void *file_content = NULL;
+    size_t file_size = 0;
+    int memfd = -1;
+    int files_recv = 0;
+    int files_stored = 0;
+    size_t bytes_stored = 0;
+
+    if (already_connected == false) {
+        errno = ENOTCONN;
+        goto error;
+    }
+    if (!pathname) {
+        strcpy(errdesc, "with argument pathname");
+        errno = EINVAL;
+        goto error;
+    }
+    if (flags != O_NORMAL && flags != O_LOCK) {
+        strcpy(errdesc, "with argument flags");
+        errno = EINVAL;
+        goto error;
+    }
+    if (strlen(pathname) >= MAX_PATH) {
+        strcpy(errdesc, "with argument pathname");
+        errno = ENAMETOOLONG;
+        goto error;
+    }
+    if (dirname && strlen(dirname) >= MAX_PATH) {
+        strcpy(errdesc, "with argument dirname");
+        errno = ENAMETOOLONG;
+        goto error;
+    }
+
+    if (fdpassing() && loadmemfd(pathname, &memfd, &file_size) == -1) {
+        strcpy(errdesc, "reading file content");
+        goto error;
+    }
+    if (memfd != -1) {
+        if (sendmemfd(PUT, (flags & O_LOCK) ? FLAG_LOCK : 0, pathname, memfd, file_size, dirname, &files_recv, &files_stored, &bytes_stored, errdesc) == -1)
+            goto error;
+        close(memfd);
+        memfd = -1;
+    } else {
+        //un file vuoto viene solo creato
+        if (readfile(pathname, &file_content, &file_size) == -1) {
+            if (errno != ENODATA) {
+                strcpy(errdesc, "reading file content");
+                goto error;
+            }
+            file_size = 0;
+        }
+        if (file_size > STREAM_CHUNK) {
+            //i file da spedire a chunk passano per le richieste separate: dopo la PUT non ci sarebbe un file aperto a cui accodarli
+            free(file_content);
+            file_content = NULL;
+            if (openFile(pathname, O_CREATE | O_LOCK) == -1) return -1;
+            if (writeFile(pathname, dirname) == -1 || (!(flags & O_LOCK) && unlockFile(pathname) == -1)) {
+                int errnosv = errno;
+                closeFile(pathname);
+                errno = errnosv;
+                return -1;
+            }
+            return closeFile(pathname);
+        }
+        if (sendcontent(PUT, (flags & O_LOCK) ? FLAG_LOCK : 0, pathname, file_content, file_size, dirname, &files_recv, &files_stored, &bytes_stored, errdesc) == -1)
+            goto error;
+    }
+
+    files_recv ?
+        (dirname ?
+            verbose("< %s: %s (%s) completed: written %zu bytes, received %d ejected files, stored %d in %s, occupying a total of %zu bytes\n", username,
+                    __func__, pathname, file_size, files_recv, files_stored, dirname, bytes_stored)
+          : verbose("< %s: %s (%s) completed: written %zu bytes, received %d ejected files\n", username,
+                    __func__, pathname, file_size, files_recv))
+    : verbose("< %s: %s (%s) completed: written %zu bytes. No ejected files received\n", username,
+              __func__, pathname, file_size);
+    free(file_content);
+    return 0;
+
+    error:
+    verbose("< %s: %s (%s) failed: there was an error %s: %s. Received %d ejected files, stored %d\n", username,
+            __func__, pathname, errdesc, strerror(errno), files_recv, files_stored);
+    if (file_content) free(file_content);
+    if (memfd != -1) close(memfd);
     return -1;
 }
 
 int appendToFile(const char *pathname, void *buf, size_t size, const char *dirname) {
 
     char errdesc[STRERROR_LEN] = "";
-    msg_t *request = NULL;
-    msg_t *response = NULL;
     int files_stored = 0;
     int files_recv = 0;
     size_t bytes_stored = 0;
@@ -496,46 +754,8 @@ int appendToFile(const char *pathname, void *buf, size_t size, const char *dirna
     }
 
 
-    if ((request = buildmsg(username, APPEND, -1, pathname, size, buf)) == NULL) {
-        strcpy(errdesc, "building the message to be send");
+    if (sendcontent(APPEND, 0, pathname, buf, size, dirname, &files_recv, &files_stored, &bytes_stored, errdesc) == -1)
         goto error;
-    }
-    if (writemsg(socketfd, request) <= 0) {
-        strcpy(errdesc, "writing the request to server");
-        goto error;
-    }
-
-    do {
-        if (response) destroymsg(response);
-        if ((response = initmsg()) == NULL) {
-            strcpy(errdesc, "initialising the response to be received");
-            goto error;
-        }
-        if (readmsg(socketfd, response) <= 0) {
-            strcpy(errdesc, "reading the response from server");
-            goto error;
-        }
-        if (response->header->code != EXIT_SUCCESS) {
-            errno = response->header->code;
-            goto error;
-        }
-        if (response->header->arg == 0) break;
-
-        if (dirname) {
-            if (storefile(dirname, response->header->pathname, response->data, response->header->data_size) == -1) {
-                files_recv++;
-                verbose("< %s: %s (%s) : there was an error storing the ejected file received: %s. File %s corrupted\n", username,
-                        __func__, request->header->pathname,
-                        strerror(errno), response->header->pathname);
-                continue;
-            }
-        } else verbose("< %s: %s (%s) : received ejected %s\n", username, __func__, request->header->pathname, response->header->pathname);
-
-        files_recv++;
-        if (dirname) files_stored++;
-        if (dirname) bytes_stored += response->header->data_size;
-
-    } while (files_recv < response->header->arg);
 
 
     files_recv ?
@@ -546,8 +766,6 @@ int appendToFile(const char *pathname, void *buf, size_t size, const char *dirna
                     __func__, pathname, size, files_recv))
     : verbose("< %s: %s (%s) completed: appended %d bytes. No ejected files received\n", username,
               __func__, pathname, size);
-    destroymsg(response);
-    destroymsg(request);
     return 0;
 
     error:
@@ -559,8 +777,6 @@ int appendToFile(const char *pathname, void *buf, size_t size, const char *dirna
                     __func__, pathname, errdesc, strerror(errno), files_recv))
     : verbose("< %s: %s (%s) failed: there was an error %s: %s. No ejected files received\n", username,
               __func__, pathname,errdesc, strerror(errno));
-    if (request) destroymsg(request);
-    if (response) destroymsg(response);
     return -1;
 }
 
@@ -592,7 +808,7 @@ int lockFile(const char *pathname) {
 
     int rescode;
     do {
-        if (writemsg(socketfd, request) <= 0) {
+        if (sendrequest(request) <= 0) {
             strcpy(errdesc, "writing the request to server");
             goto error;
         }
@@ -601,7 +817,7 @@ int lockFile(const char *pathname) {
             strcpy(errdesc, "initialising the response to be received");
             goto error;
         }
-        if (readmsg(socketfd, response) <= 0) {
+        if (recvresponse(response, request->header->id) <= 0) {
             strcpy(errdesc, "reading the response from server");
             goto error;
         }
@@ -653,7 +869,7 @@ int unlockFile(const char *pathname) {
         strcpy(errdesc, "building the message to be send");
         goto error;
     }
-    if (writemsg(socketfd, request) <= 0) {
+    if (sendrequest(request) <= 0) {
         strcpy(errdesc, "writing the request to server");
         goto error;
     }
@@ -662,7 +878,7 @@ int unlockFile(const char *pathname) {
         strcpy(errdesc, "initialising the response to be received");
         goto error;
     }
-    if (readmsg(socketfd, response) <= 0) {
+    if (recvresponse(response, request->header->id) <= 0) {
         strcpy(errdesc, "reading the response from server");
         goto error;
     }
@@ -709,7 +925,7 @@ int closeFile(const char *pathname) {
         strcpy(errdesc, "building the message to be send");
         goto error;
     }
-    if (writemsg(socketfd, request) <= 0) {
+    if (sendrequest(request) <= 0) {
         strcpy(errdesc, "writing the request to server");
         goto error;
     }
@@ -718,7 +934,7 @@ int closeFile(const char *pathname) {
         strcpy(errdesc, "initialising the response to be received");
         goto error;
     }
-    if (readmsg(socketfd, response) <= 0) {
+    if (recvresponse(response, request->header->id) <= 0) {
         strcpy(errdesc, "reading the response from server");
         goto error;
     }
@@ -765,7 +981,7 @@ int removeFile(const char *pathname) {
         strcpy(errdesc, "building the message to be send");
         goto error;
     }
-    if (writemsg(socketfd, request) <= 0) {
+    if (sendrequest(request) <= 0) {
         strcpy(errdesc, "writing the request to server");
         goto error;
     }
@@ -774,7 +990,7 @@ int removeFile(const char *pathname) {
         strcpy(errdesc, "initialising the response to be received");
         goto error;
     }
-    if (readmsg(socketfd, response) <= 0) {
+    if (recvresponse(response, request->header->id) <= 0) {
         strcpy(errdesc, "reading the response from server");
         goto error;
     }
@@ -796,6 +1012,184 @@ int removeFile(const char *pathname) {
     return -1;
 }
 
+int batchFiles(int n, batchop_t *ops) {
+
+    char errdesc[STRERROR_LEN] = "";
+    msg_t *request = NULL;
+    msg_t *response = NULL;
+    int rescode = EXIT_SUCCESS;
+    int done = 0;
+
+    if (already_connected == false) {
+        errno = ENOTCONN;
+        goto error;
+    }
+    if (n < 0 || (n > 0 && !ops)) {
+        strcpy(errdesc, "with argument n or ops");
+        errno = EINVAL;
+        goto error;
+    }
+    for (int i = 0; i < n; i++) {
+        //finché il server non le esegue, le operazioni risultano annullate
+        ops[i].result = ECANCELED;
+        ops[i].buf = NULL;
+        ops[i].size = 0;
+    }
+    for (int i = 0; i < n; i++) {
+        int code = ops[i].code;
+        if (!ops[i].pathname || (code != OPEN && code != READ && code != LOCK && code != UNLOCK && code != CLOSE
+                                 && code != REMOVE)) {
+            strcpy(errdesc, "with argument ops");
+            errno = EINVAL;
+            goto error;
+        }
+        if (strlen(ops[i].pathname) >= MAX_PATH) {
+            strcpy(errdesc, "with argument ops");
+            errno = ENAMETOOLONG;
+            goto error;
+        }
+    }
+
+    //un gruppo viene inviato solo dopo aver ricevuto la risposta al precedente
+    while (done < n) {
+        int nops = (n - done < BATCH_OPS) ? n - done : BATCH_OPS;
+        batchop_t *batch = ops + done;
+        size_t size = 0;
+        for (int i = 0; i < nops; i++) size += entrysize(batch[i].pathname);
+        if ((request = buildmsg(username, BATCH, nops, NULL, 0, NULL)) == NULL
+            || (request->data = pool_alloc(size)) == NULL) {
+            strcpy(errdesc, "building the message to be send");
+            goto error;
+        }
+        request->header->data_size = size;
+        char *entry = request->data;
+        for (int i = 0; i < nops; i++)
+            entry = packentry(entry, batch[i].pathname,
+                              BATCHOP(batch[i].code, batch[i].code == OPEN ? batch[i].flags : -1));
+        //i file creati dalle OPEN del gruppo hanno il tempo di vita impostato con setTTL
+        request->header->ttl = file_ttl;
+        if (sendrequest(request) <= 0) {
+            strcpy(errdesc, "writing the request to server");
+            goto error;
+        }
+
+        if ((response = initmsg()) == NULL) {
+            strcpy(errdesc, "initialising the response to be received");
+            goto error;
+        }
+        if (recvresponse(response, request->header->id) <= 0) {
+            strcpy(errdesc, "reading the response from server");
+            goto error;
+        }
+        if (response->header->code != EXIT_SUCCESS) {
+            errno = response->header->code;
+            goto error;
+        }
+        if (response->header->arg != nops) {
+            errno = EPROTO;
+            strcpy(errdesc, "reading the response from server");
+            goto error;
+        }
+
+        //gli esiti sono seguiti dai contenuti letti, nello stesso ordine
+        const char *end = (const char *) response->data + response->header->data_size;
+        const char *result = response->data;
+        const char *content = response->data;
+        if ((size_t) (end - content) < nops * RESULT_SIZE) {
+            errno = EPROTO;
+            strcpy(errdesc, "reading the response from server");
+            goto error;
+        }
+        content += nops * RESULT_SIZE;
+        for (int i = 0; i < nops; i++) {
+            uint64_t bytes;
+            result = unpackresult(result, end, &batch[i].result, &bytes);
+            if (bytes == 0) continue;
+            if ((size_t) (end - content) < bytes) {
+                errno = EPROTO;
+                strcpy(errdesc, "reading the response from server");
+                goto error;
+            }
+            if ((batch[i].buf = malloc(bytes)) == NULL) {
+                strcpy(errdesc, "storing the content received");
+                goto error;
+            }
+            memcpy(batch[i].buf, content, bytes);
+            batch[i].size = bytes;
+            content += bytes;
+        }
+        destroymsg(request);
+        destroymsg(response);
+        request = response = NULL;
+        done += nops;
+    }
+
+    for (int i = 0; i < n; i++) {
+        if (ops[i].result == EXIT_SUCCESS)
+            verbose("< %s: %s %s (%s) completed\n", username, __func__, opname(ops[i].code), ops[i].pathname);
+        else {
+            verbose("< %s: %s %s (%s) failed: %s\n", username, __func__, opname(ops[i].code), ops[i].pathname,
+                    strerror(ops[i].result));
+            if (rescode == EXIT_SUCCESS) rescode = ops[i].result;
+        }
+    }
+    if (rescode != EXIT_SUCCESS) {
+        errno = rescode;
+        return -1;
+    }
+    return 0;
+
+    error:
+    verbose("< %s: %s (%d) failed: there was an error %s: %s\n", username, __func__, n, errdesc, strerror(errno));
+    if (request) destroymsg(request);
+    if (response) destroymsg(response);
+    return -1;
+}
+
+int setEvictionMode(int mode) {
+    if (mode != EVICT_FULL && mode != EVICT_NAMES && mode != EVICT_NONE) {
+        errno = EINVAL;
+        verbose("< %s: %s (%d) failed: there was an error with argument mode: %s\n", username, __func__, mode, strerror(errno));
+        return -1;
+    }
+    evict_mode = mode;
+    verbose("< %s: %s (%d) completed\n", username, __func__, mode);
+    return 0;
+}
+
+int setSharedMemory(int enable) {
+    if (already_connected) {
+        errno = EISCONN;
+        verbose("< %s: %s (%d) failed: there was an error: %s\n", username, __func__, enable, strerror(errno));
+        return -1;
+    }
+    shm_requested = (enable != 0);
+    verbose("< %s: %s (%d) completed\n", username, __func__, enable);
+    return 0;
+}
+
+int setCompression(int enable) {
+    if (already_connected) {
+        errno = EISCONN;
+        verbose("< %s: %s (%d) failed: there was an error: %s\n", username, __func__, enable, strerror(errno));
+        return -1;
+    }
+    lz_requested = (enable != 0);
+    verbose("< %s: %s (%d) completed\n", username, __func__, enable);
+    return 0;
+}
+
+int setTTL(long msec) {
+    if (msec < 0) {
+        errno = EINVAL;
+        verbose("< %s: %s (%ld) failed: there was an error with argument msec: %s\n", username, __func__, msec, strerror(errno));
+        return -1;
+    }
+    file_ttl = msec;
+    verbose("< %s: %s (%ld) completed\n", username, __func__, msec);
+    return 0;
+}
+
 int readfile(const char *pathname, void **file_content, size_t *file_size){
 
     if (!pathname || !file_content || !file_size){
@@ -868,4 +1262,430 @@ int verbose(const char *restrict format, ...) {
     va_end(args);
 
     return ret;
-}
\ No newline at end of file
+}
+
+//presenta il client al server inviando username e versione del protocollo
+static int handshake() {
+
+    int res = -1;
+    msg_t *request = NULL;
+    msg_t *response = NULL;
+    int memfd = -1;
+    if ((request = buildmsg(username, HELLO, PROTOCOL_VERSION, username, 0, NULL)) == NULL)
+        goto cleanup;
+    if (shm_requested && !remote) request->header->flags = FLAG_SHM;
+    if (lz_requested) request->header->flags |= FLAG_LZ;
+    if (sendrequest(request) <= 0)
+        goto cleanup;
+    if ((response = initmsg()) == NULL)
+        goto cleanup;
+    //la risposta può portare il memfd degli anelli in memoria condivisa
+    errno = 0;
+    if (readmsg_fd(socketfd, response, &memfd, SIZE_MAX, true) <= 0 || response->header->id != request->header->id) {
+        if (errno == 0) errno = ECONNRESET;
+        goto cleanup;
+    }
+    if (response->header->code != EXIT_SUCCESS) {
+        errno = response->header->code;
+        goto cleanup;
+    }
+    if ((response->header->flags & FLAG_SHM) && memfd != -1) {
+        shmchan_t *chan;
+        if ((chan = shmchan_attach(socketfd, memfd)) == NULL)
+            goto cleanup;
+        if (shmchan_register(socketfd, chan) == -1) {
+            shmchan_destroy(chan);
+            goto cleanup;
+        }
+        verbose("< %s: exchanging messages with server through shared memory\n", username);
+    } else if (shm_requested)
+        verbose("< %s: shared memory not available, using the socket\n", username);
+    lz_enabled = (response->header->flags & FLAG_LZ) != 0;
+    if (lz_enabled) verbose("< %s: payloads above %d bytes are compressed\n", username, LZ_MIN_SIZE);
+    else if (lz_requested) verbose("< %s: compression not available\n", username);
+    res = 0;
+
+    cleanup:
+    if (memfd != -1) close(memfd);
+    if (request) destroymsg(request);
+    if (response) destroymsg(response);
+    return res;
+}
+
+//invia la richiesta etichettandola con un nuovo id, i chunk che proseguono un payload mantengono quello della richiesta
+static int sendrequest(msg_t *request) {
+    if (!(request->header->flags & FLAG_CHUNK)) last_id++;
+    request->header->id = last_id;
+    return writemsg(socketfd, request);
+}
+
+//legge la prossima risposta, che deve riferirsi alla richiesta id: il server risponde nell'ordine di invio
+static int recvresponse(msg_t *response, unsigned int id) {
+    int r;
+    if ((r = readmsg(socketfd, response)) <= 0) return r;
+    if (response->header->id != id) {
+        errno = EPROTO;
+        return -1;
+    }
+    return r;
+}
+
+/**
+ * Spedisce il contenuto di una WRITE o APPEND e riceve le risposte con gli eventuali file espulsi.
+ * Se il contenuto supera STREAM_CHUNK viene diviso in chunk, i successivi al primo sono APPEND con lo stesso id:
+ * ogni chunk viene spedito solo dopo la risposta al precedente, così il server ne riceve uno alla volta
+ */
+static int sendcontent(int code, int flags, const char *pathname, void *data, size_t size, const char *dirname,
+                       int *files_recv, int *files_stored, size_t *bytes_stored, char *errdesc) {
+    const char *func = (code == WRITE ? "writeFile" : code == PUT ? "putFile" : "appendToFile");
+    msg_t *request = NULL;
+    size_t sent = 0;
+    bool packed = false;
+
+    do {
+        size_t chunk = (size - sent > STREAM_CHUNK ? STREAM_CHUNK : size - sent);
+        if ((request = buildmsg(username, (sent == 0 ? code : APPEND), evictmode(dirname), pathname, 0, NULL)) == NULL) {
+            strcpy(errdesc, "building the message to be send");
+            goto error;
+        }
+        if (code == WRITE || code == PUT) request->header->ttl = file_ttl;
+        request->header->flags = flags;
+        if (sent > 0) request->header->flags |= FLAG_CHUNK;
+        if (sent + chunk < size) request->header->flags |= FLAG_MORE;
+        //il contenuto viene spedito senza copiarlo nel messaggio, e staccato prima di distruggerlo.
+        //Se viene compresso il messaggio riceve un payload proprio, che va distrutto con lui
+        request->header->data_size = chunk;
+        request->data = (unsigned char *) data + sent;
+        packed = (lz_enabled && chunk >= LZ_MIN_SIZE && compressmsg(request) != NULL);
+        if (sendrequest(request) <= 0) {
+            strcpy(errdesc, "writing the request to server");
+            goto error;
+        }
+
+        if (recvreplies(request->header->id, func, pathname, dirname, files_recv, files_stored, bytes_stored, errdesc) == -1)
+            goto error;
+        if (!packed) request->data = NULL;
+        destroymsg(request);
+        request = NULL;
+        sent += chunk;
+    } while (sent < size);
+    return 0;
+
+    error:
+    if (request) {
+        if (!packed) request->data = NULL;
+        destroymsg(request);
+    }
+    return -1;
+}
+
+/**
+ * Spedisce il contenuto di una WRITE o PUT nel memfd sigillato fd: la richiesta annuncia il memfd e,
+ * ricevuto il via libera del server, il memfd viene passato con un messaggio con lo stesso id
+ */
+static int sendmemfd(int code, int flags, const char *pathname, int fd, size_t size, const char *dirname,
+                     int *files_recv, int *files_stored, size_t *bytes_stored, char *errdesc) {
+    msg_t *request = NULL;
+    msg_t *response = NULL;
+
+    if ((request = buildmsg(username, code, evictmode(dirname), pathname, 0, NULL)) == NULL) {
+        strcpy(errdesc, "building the message to be send");
+        goto error;
+    }
+    request->header->ttl = file_ttl;
+    request->header->flags = flags | FLAG_MEMFD;
+    request->header->data_size = size;
+    if (sendrequest(request) <= 0) {
+        strcpy(errdesc, "writing the request to server");
+        goto error;
+    }
+    if ((response = initmsg()) == NULL) {
+        strcpy(errdesc, "initialising the response to be received");
+        goto error;
+    }
+    if (recvresponse(response, request->header->id) <= 0) {
+        strcpy(errdesc, "reading the response from server");
+        goto error;
+    }
+    if (response->header->code != EXIT_SUCCESS) {
+        errno = response->header->code;
+        goto error;
+    }
+    if (!(response->header->flags & FLAG_MEMFD)) {
+        strcpy(errdesc, "reading the response from server");
+        errno = EPROTO;
+        goto error;
+    }
+    destroymsg(response);
+    response = NULL;
+
+    request->header->flags = FLAG_MEMFD | FLAG_CHUNK;
+    if (writemsg_fd(socketfd, request, fd) <= 0) {
+        strcpy(errdesc, "passing the content to server");
+        goto error;
+    }
+    if (recvreplies(request->header->id, (code == PUT ? "putFile" : "writeFile"), pathname, dirname, files_recv, files_stored,
+                    bytes_stored, errdesc) == -1)
+        goto error;
+    destroymsg(request);
+    return 0;
+
+    error:
+    if (request) destroymsg(request);
+    if (response) destroymsg(response);
+    return -1;
+}
+
+//modalità da chiedere al server per i file espulsi: senza una directory in cui memorizzarli il contenuto non serve
+static int evictmode(const char *dirname) {
+    return (evict_mode == EVICT_FULL && !dirname) ? EVICT_NAMES : evict_mode;
+}
+
+//riceve le risposte a una WRITE o APPEND, memorizzando in dirname gli eventuali file espulsi
+static int recvreplies(unsigned int id, const char *func, const char *pathname, const char *dirname,
+                       int *files_recv, int *files_stored, size_t *bytes_stored, char *errdesc) {
+    msg_t *response = NULL;
+    int files = 0;
+    do {
+        if (response) destroymsg(response);
+        if ((response = initmsg()) == NULL) {
+            strcpy(errdesc, "initialising the response to be received");
+            goto error;
+        }
+        if (recvresponse(response, id) <= 0) {
+            strcpy(errdesc, "reading the response from server");
+            goto error;
+        }
+        if (response->header->code != EXIT_SUCCESS) {
+            errno = response->header->code;
+            goto error;
+        }
+        if (response->header->arg == 0) break;
+        if (evictmode(dirname) == EVICT_NAMES) {
+            //un'unica risposta elenca nomi e dimensioni dei file espulsi
+            const char *entry = response->data;
+            const char *end = entry + response->header->data_size;
+            char victim[MAX_PATH];
+            uint64_t size;
+            for (int i = 0; i < response->header->arg; i++) {
+                if ((entry = unpackentry(entry, end, victim, &size)) == NULL) {
+                    strcpy(errdesc, "reading the ejected files");
+                    goto error;
+                }
+                (*files_recv)++;
+                verbose("< %s: %s (%s) : ejected %s (%llu bytes)\n", username, func, pathname, victim, (unsigned long long) size);
+            }
+            break;
+        }
+
+        files++;
+        (*files_recv)++;
+        if (dirname) {
+            if (storefile(dirname, response->header->pathname, response->data, response->header->data_size) == -1) {
+                verbose("< %s: %s (%s) : there was an error storing the ejected file received: %s. File %s corrupted\n", username,
+                        func, pathname, strerror(errno), response->header->pathname);
+                continue;
+            }
+            (*files_stored)++;
+            *bytes_stored += response->header->data_size;
+        } else verbose("< %s: %s (%s) : received ejected %s\n", username, func, pathname, response->header->pathname);
+
+    } while (files < response->header->arg);
+
+    destroymsg(response);
+    return 0;
+
+    error:
+    if (response) destroymsg(response);
+    return -1;
+}
+
+//carica in un memfd sigillato il contenuto di un file di almeno MEMFD_MIN_SIZE byte, *fd = -1 se è più piccolo
+static int loadmemfd(const char *pathname, int *fd, size_t *size) {
+    int filefd = -1;
+    void *map = MAP_FAILED;
+    struct stat st;
+    *fd = -1;
+    if ((filefd = open(pathname, O_RDONLY)) == -1) return -1;
+    if (fstat(filefd, &st) == -1) goto error;
+    *size = st.st_size;
+    if (*size < MEMFD_MIN_SIZE) {
+        close(filefd);
+        return 0;
+    }
+
+    verbose("< %s: Reading %zu bytes of %s from local ...\n", username, *size, pathname);
+    if ((*fd = memfd_create(pathname, MFD_CLOEXEC | MFD_ALLOW_SEALING)) == -1) goto error;
+    if (ftruncate(*fd, *size) == -1) goto error;
+    //il file viene letto direttamente nel memfd, senza passare da un buffer intermedio
+    if ((map = mmap(NULL, *size, PROT_READ | PROT_WRITE, MAP_SHARED, *fd, 0)) == MAP_FAILED) goto error;
+    int r;
+    if ((r = readn(filefd, map, *size)) <= 0) {
+        if (r == 0) errno = ENODATA;
+        goto error;
+    }
+    //la mappatura scrivibile va rimossa prima di sigillare
+    munmap(map, *size);
+    map = MAP_FAILED;
+    if (fcntl(*fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE) == -1) goto error;
+    close(filefd);
+    return 0;
+
+    error: {
+        int errnosv = errno;
+        if (map != MAP_FAILED) munmap(map, *size);
+        if (*fd != -1) close(*fd);
+        *fd = -1;
+        close(filefd);
+        errno = errnosv;
+        return -1;
+    }
+}
+
+/**
+ * Riceve il contenuto di una READ, che il server può spedire in più chunk con lo stesso id.
+ * Con map il contenuto viene restituito in una mappatura in sola lettura, da rilasciare con unmapFile:
+ * se il server lo passa in un memfd viene mappato direttamente, altrimenti viene copiato.
+ * In *code viene restituito l'esito della richiesta, *buf e *size sono validi solo se è EXIT_SUCCESS
+ * @return 0 se la risposta è stata ricevuta, -1 in caso di errore di comunicazione (setta errno)
+ */
+static int recvcontent(unsigned int id, int *code, void **buf, size_t *size, bool map) {
+    msg_t *response = NULL;
+    *buf = NULL;
+    *size = 0;
+
+    int more;
+    bool first = true;
+    do {
+        if ((response = initmsg()) == NULL) goto error;
+        if (map && first && fdpassing()) {
+            //solo la prima risposta può trasportare il memfd
+            int fd;
+            if (readmsg_fd(socketfd, response, &fd, SIZE_MAX, true) <= 0) goto error;
+            if (response->header->id != id || ((response->header->flags & FLAG_MEMFD) && fd == -1)) {
+                if (fd != -1) close(fd);
+                errno = EPROTO;
+                goto error;
+            }
+            if (fd != -1) {
+                if (!(response->header->flags & FLAG_MEMFD)) {
+                    close(fd);
+                    errno = EPROTO;
+                    goto error;
+                }
+                *buf = mapmemfd(fd, response->header->data_size);
+                close(fd);
+                if (*buf == NULL) goto error;
+                *code = response->header->code;
+                *size = response->header->data_size;
+                destroymsg(response);
+                return 0;
+            }
+        } else if (recvresponse(response, id) <= 0) goto error;
+        first = false;
+        *code = response->header->code;
+        more = (response->header->flags & FLAG_MORE);
+        if (*code != EXIT_SUCCESS) {
+            //un chunk fallito chiude il trasferimento
+            free(*buf);
+            *buf = NULL;
+            *size = 0;
+            more = 0;
+        } else if (*buf == NULL) {
+            *buf = response->data;
+            response->data = NULL;
+            *size = response->header->data_size;
+        } else if (response->header->data_size > 0) {
+            void *content = realloc(*buf, *size + response->header->data_size);
+            if (content == NULL) goto error;
+            *buf = content;
+            memcpy((unsigned char *) *buf + *size, response->data, response->header->data_size);
+            *size += response->header->data_size;
+        }
+        destroymsg(response);
+        response = NULL;
+    } while (more);
+
+    if (map && *buf) {
+        void *mapped = mmap(NULL, *size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mapped == MAP_FAILED) goto error;
+        memcpy(mapped, *buf, *size);
+        mprotect(mapped, *size, PROT_READ);
+        free(*buf);
+        *buf = mapped;
+    }
+    return 0;
+
+    error:
+    if (response) destroymsg(response);
+    free(*buf);
+    *buf = NULL;
+    *size = 0;
+    return -1;
+}
+
+//mappa in sola lettura il memfd ricevuto dal server, che deve essere sigillato: altrimenti potrebbe cambiare o accorciarsi sotto la mappatura
+static void *mapmemfd(int fd, size_t size) {
+    int seals;
+    struct stat st;
+    if ((seals = fcntl(fd, F_GET_SEALS)) == -1) return NULL;
+    if (!(seals & F_SEAL_WRITE) || !(seals & F_SEAL_SHRINK) || fstat(fd, &st) == -1 || (size_t) st.st_size < size) {
+        errno = EPROTO;
+        return NULL;
+    }
+    void *mapped = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    return mapped == MAP_FAILED ? NULL : mapped;
+}
+
+//risolve l'indirizzo del server, TCP se sockname è nella forma host:port (vedi istcpaddress)
+static int resolve(const char *sockname, struct sockaddr_storage *sa, socklen_t *salen) {
+    memset(sa, 0, sizeof(*sa));
+    if (!istcpaddress(sockname)) {
+        struct sockaddr_un *un = (struct sockaddr_un *) sa;
+        un->sun_family = AF_UNIX;
+        strncpy(un->sun_path, sockname, UNIX_PATH_MAX - 1);
+        *salen = sizeof(struct sockaddr_un);
+        return 0;
+    }
+
+    const char *port = strrchr(sockname, ':');
+    char host[UNIX_PATH_MAX];
+    size_t hostlen = port - sockname;
+    if (hostlen >= 2 && sockname[0] == '[' && sockname[hostlen - 1] == ']') {
+        sockname++;
+        hostlen -= 2;
+    }
+    memcpy(host, sockname, hostlen);
+    host[hostlen] = '\0';
+
+    struct addrinfo hints, *res;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    int err = getaddrinfo(hostlen > 0 ? host : NULL, port + 1, &hints, &res);
+    if (err != 0) {
+        errno = (err == EAI_SYSTEM) ? errno : EHOSTUNREACH;
+        return -1;
+    }
+    memcpy(sa, res->ai_addr, res->ai_addrlen);
+    *salen = res->ai_addrlen;
+    freeaddrinfo(res);
+    return 0;
+}
+
+//i memfd viaggiano solo sul socket AF_UNIX, non su TCP né negli anelli in memoria condivisa
+static bool fdpassing() {
+    return !remote && !shmchan_lookup(socketfd);
+}
+
+//nome della funzione equivalente ad un'operazione di batchFiles, per i messaggi
+static const char *opname(int code) {
+    switch (code) {
+        case OPEN: return "openFile";
+        case READ: return "readFile";
+        case LOCK: return "lockFile";
+        case UNLOCK: return "unlockFile";
+        case CLOSE: return "closeFile";
+        default: return "removeFile";
+    }
+}
@@ -0,0 +1,154 @@
+/**
+ * @file lz.c
+ * @brief Implementazione della compressione LZ77 dei payload
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#include <lz.h>
+
+#define LZ_MAX_OFFSET 65535
+//i riferimenti iniziano almeno LZ_MF_LIMIT byte prima della fine e terminano prima dei letterali finali
+#define LZ_MF_LIMIT (LZ_MIN_MATCH + LZ_LAST_LITERALS + 3)
+
+static inline uint32_t read32(const unsigned char *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t hash32(uint32_t v) {
+    return (v * 2654435761u) >> (32 - LZ_HASH_LOG);
+}
+
+//spazio occupato, nel caso peggiore, da una sequenza di literals letterali e un riferimento lungo LZ_MIN_MATCH + matchlen
+static inline size_t seqbound(size_t literals, size_t matchlen) {
+    return 1 + literals / 255 + 1 + literals + 2 + matchlen / 255 + 1;
+}
+
+//scrive i byte con cui prosegue una lunghezza che non sta nei 4 bit del token
+static unsigned char *putlength(unsigned char *op, size_t length) {
+    while (length >= 255) {
+        *op++ = 255;
+        length -= 255;
+    }
+    *op++ = (unsigned char) length;
+    return op;
+}
+
+//scrive il token e i letterali di una sequenza, il riferimento viene completato dal chiamante
+static unsigned char *putliterals(unsigned char *op, const unsigned char *literals, size_t length, size_t matchlen) {
+    unsigned char *token = op++;
+    *token = (unsigned char) (((length < 15 ? length : 15) << 4) | (matchlen < 15 ? matchlen : 15));
+    if (length >= 15) op = putlength(op, length - 15);
+    memcpy(op, literals, length);
+    return op + length;
+}
+
+size_t lz_compress(const void *src, size_t size, void *dst, size_t capacity) {
+    const unsigned char *base = src;
+    const unsigned char *ip = base, *anchor = base;
+    const unsigned char *iend = base + size;
+    unsigned char *op = dst, *oend = op + capacity;
+    uint32_t table[1 << LZ_HASH_LOG]; //ultima posizione vista per ogni hash di 4 byte
+
+    if (size > UINT32_MAX) return 0;
+    if (size >= LZ_MF_LIMIT) {
+        const unsigned char *mflimit = iend - LZ_MF_LIMIT;
+        const unsigned char *matchlimit = iend - LZ_LAST_LITERALS;
+        unsigned int misses = 0;
+        memset(table, 0, sizeof(table));
+        ip++;
+        while (ip <= mflimit) {
+            uint32_t seq = read32(ip);
+            uint32_t h = hash32(seq);
+            const unsigned char *ref = base + table[h];
+            table[h] = (uint32_t) (ip - base);
+            if (ref >= ip || ip - ref > LZ_MAX_OFFSET || read32(ref) != seq) {
+                //nei contenuti che non si comprimono la ricerca procede a passi sempre più lunghi
+                ip += 1 + (misses++ >> 6);
+                continue;
+            }
+            misses = 0;
+            size_t offset = (size_t) (ip - ref);
+            const unsigned char *mend = ip + LZ_MIN_MATCH;
+            ref += LZ_MIN_MATCH;
+            while (mend < matchlimit && *mend == *ref) {
+                mend++;
+                ref++;
+            }
+            size_t literals = (size_t) (ip - anchor);
+            size_t matchlen = (size_t) (mend - ip) - LZ_MIN_MATCH;
+            if (seqbound(literals, matchlen) > (size_t) (oend - op)) return 0;
+            op = putliterals(op, anchor, literals, matchlen);
+            *op++ = (unsigned char) (offset & 0xff);
+            *op++ = (unsigned char) (offset >> 8);
+            if (matchlen >= 15) op = putlength(op, matchlen - 15);
+            //la fine del riferimento viene ricordata, le ripetizioni vicine sono frequenti
+            table[hash32(read32(mend - 2))] = (uint32_t) (mend - 2 - base);
+            ip = anchor = mend;
+        }
+    }
+    size_t literals = (size_t) (iend - anchor);
+    if (1 + literals / 255 + 1 + literals > (size_t) (oend - op)) return 0;
+    op = putliterals(op, anchor, literals, 0);
+    return (size_t) (op - (unsigned char *) dst);
+}
+
+//legge i byte con cui prosegue una lunghezza, senza superare iend
+static const unsigned char *getlength(const unsigned char *ip, const unsigned char *iend, size_t *length) {
+    unsigned char byte;
+    do {
+        if (ip >= iend) return NULL;
+        byte = *ip++;
+        *length += byte;
+    } while (byte == 255);
+    return ip;
+}
+
+int lz_decompress(const void *src, size_t size, void *dst, size_t rawsize) {
+    const unsigned char *ip = src, *iend = ip + size;
+    unsigned char *op = dst, *oend = op + rawsize;
+
+    while (ip < iend) {
+        unsigned int token = *ip++;
+        size_t length = token >> 4;
+        if (length == 15 && (ip = getlength(ip, iend, &length)) == NULL) goto malformed;
+        if ((size_t) (iend - ip) < length || (size_t) (oend - op) < length) goto malformed;
+        memcpy(op, ip, length);
+        op += length;
+        ip += length;
+        if (ip == iend) break; //l'ultima sequenza non ha riferimento
+
+        if (iend - ip < 2) goto malformed;
+        size_t offset = ip[0] | ((size_t) ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > (size_t) (op - (unsigned char *) dst)) goto malformed;
+        length = token & 15;
+        if (length == 15 && (ip = getlength(ip, iend, &length)) == NULL) goto malformed;
+        length += LZ_MIN_MATCH;
+        if ((size_t) (oend - op) < length) goto malformed;
+        const unsigned char *ref = op - offset;
+        if (offset >= length) {
+            memcpy(op, ref, length);
+            op += length;
+        } else {
+            //il riferimento si sovrappone ai byte che produce, che ripetono gli ultimi offset byte:
+            //ogni copia raddoppia il tratto già ripetuto da cui copiare
+            while (length > 0) {
+                size_t n = (size_t) (op - ref) < length ? (size_t) (op - ref) : length;
+                memcpy(op, ref, n);
+                op += n;
+                length -= n;
+            }
+        }
+    }
+    if (op != oend) goto malformed;
+    return 0;
+
+    malformed:
+    errno = EPROTO;
+    return -1;
+}
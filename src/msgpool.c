@@ -0,0 +1,147 @@
+/**
+ * @file msgpool.c
+ * @brief Implementazione del riutilizzo per thread di messaggi e buffer
+ */
+
+#include <stdlib.h>
+#include <malloc.h>
+#include <pthread.h>
+
+#include <protocol.h>
+#include <msgpool.h>
+
+typedef struct freebuf_ {
+    struct freebuf_ *next;
+} freebuf_t;
+
+/**
+ * @struct msgcache_t
+ * @brief messaggi e buffer conservati da un thread
+ *
+ * @var msgs   messaggi liberi, collegati dal campo data
+ * @var bufs   buffer liberi per classe: in bufs[c] ci sono buffer di almeno 2^c byte
+ * @var bytes  byte occupati dai buffer conservati
+ */
+typedef struct msgcache_ {
+    msg_t *msgs;
+    int nmsgs;
+    freebuf_t *bufs[POOL_MAX_CLASS + 1];
+    size_t bytes;
+} msgcache_t;
+
+static pthread_key_t cachekey;
+static pthread_once_t cacheonce = PTHREAD_ONCE_INIT;
+static int cacheready = 0;
+
+//all'uscita del thread restituisce all'allocatore tutto quello che conservava
+static void destroycache(void *arg) {
+    msgcache_t *cache = (msgcache_t *) arg;
+    while (cache->msgs) {
+        msg_t *message = cache->msgs;
+        cache->msgs = message->data;
+        free(message->header);
+        free(message);
+    }
+    for (int c = POOL_MIN_CLASS; c <= POOL_MAX_CLASS; c++) {
+        while (cache->bufs[c]) {
+            freebuf_t *buf = cache->bufs[c];
+            cache->bufs[c] = buf->next;
+            free(buf);
+        }
+    }
+    free(cache);
+}
+
+static void createkey() {
+    cacheready = (pthread_key_create(&cachekey, destroycache) == 0);
+}
+
+//cache del thread chiamante, NULL se non è disponibile: in quel caso si usa direttamente l'allocatore
+static msgcache_t *getcache() {
+    if (pthread_once(&cacheonce, createkey) != 0 || !cacheready) return NULL;
+    msgcache_t *cache = pthread_getspecific(cachekey);
+    if (cache) return cache;
+    if ((cache = calloc(1, sizeof(msgcache_t))) == NULL) return NULL;
+    if (pthread_setspecific(cachekey, cache) != 0) {
+        free(cache);
+        return NULL;
+    }
+    return cache;
+}
+
+//classe più piccola che contiene size byte
+static int ceilclass(size_t size) {
+    int c = POOL_MIN_CLASS;
+    while (((size_t) 1 << c) < size) c++;
+    return c;
+}
+
+//classe più grande contenuta in size byte
+static int floorclass(size_t size) {
+    int c = POOL_MIN_CLASS;
+    while (c < POOL_MAX_CLASS && ((size_t) 1 << (c + 1)) <= size) c++;
+    return c;
+}
+
+msg_t *pool_getmsg() {
+    msgcache_t *cache = getcache();
+    if (cache && cache->msgs) {
+        msg_t *message = cache->msgs;
+        cache->msgs = message->data;
+        cache->nmsgs--;
+        return message;
+    }
+
+    msg_t *message = malloc(sizeof(msg_t));
+    if (!message) return NULL;
+    if ((message->header = malloc(sizeof(msg_header))) == NULL) {
+        free(message);
+        return NULL;
+    }
+    return message;
+}
+
+void pool_putmsg(msg_t *message) {
+    if (!message) return;
+    msgcache_t *cache = getcache();
+    if (!cache || cache->nmsgs >= POOL_MSGS) {
+        free(message->header);
+        free(message);
+        return;
+    }
+    message->data = cache->msgs;
+    cache->msgs = message;
+    cache->nmsgs++;
+}
+
+void *pool_alloc(size_t size) {
+    if (size == 0 || size > ((size_t) 1 << POOL_MAX_CLASS)) return malloc(size);
+
+    int c = ceilclass(size);
+    msgcache_t *cache = getcache();
+    if (cache && cache->bufs[c]) {
+        freebuf_t *buf = cache->bufs[c];
+        cache->bufs[c] = buf->next;
+        cache->bytes -= malloc_usable_size(buf);
+        return buf;
+    }
+    //i buffer piccoli vengono arrotondati alla classe, così tornano alla stessa classe quando vengono liberati
+    return malloc(size <= POOL_ROUND_MAX ? ((size_t) 1 << c) : size);
+}
+
+void pool_free(void *buf) {
+    if (!buf) return;
+    size_t usable = malloc_usable_size(buf);
+    msgcache_t *cache;
+    //i buffer molto più grandi della classe massima occuperebbero memoria senza essere sfruttati
+    if (usable < ((size_t) 1 << POOL_MIN_CLASS) || usable >= ((size_t) 2 << POOL_MAX_CLASS)
+        || (cache = getcache()) == NULL || cache->bytes + usable > POOL_BYTES) {
+        free(buf);
+        return;
+    }
+    int c = floorclass(usable);
+    freebuf_t *node = buf;
+    node->next = cache->bufs[c];
+    cache->bufs[c] = node;
+    cache->bytes += usable;
+}
@@ -1,31 +1,54 @@
 #include <signal.h>
 #include <sys/socket.h>
-#include <sys/select.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
 #include <sys/un.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <stdlib.h>
+#include <limits.h>
 
 #include <manager.h>
 #include <worker.h>
 #include <storage.h>
 #include <threadpool.h>
+#include <reactor.h>
 
-configArgs confargs = {"", "", 0, 0, 0, 0};
+configArgs confargs = {"", "", 0, 0, 0, 0, 0, EPOLL_BACKEND};
 storage_t *storage = NULL;
 threadpool_t *tpool = NULL;
+reactorpool_t *rpool = NULL;
 FILE *logfile = NULL;
 pthread_mutex_t logfile_mutex = PTHREAD_MUTEX_INITIALIZER;
 int listenfd = -1;
-int fdpipe[2], signalpipe[2];
+int tcplistenfd = -1;
+int epollfd = -1;
+#if defined(IO_URING)
+uring_t *acceptring = NULL;
+#endif
+int signalpipe[2];
 pthread_t signal_thread = 0;
 bool signal_thread_activated = false;
+pthread_t expiration_thread = 0;
+bool expiration_thread_activated = false;
+bool expiration_stop = false;
 bool shutdown_ = false;
 bool shutdown_now = false;
 bool logfile_opened = false;
 
 void cleanup();
 void signalhandler(void *arg);
+void expirationhandler(void *arg);
 int parse_configline(char* line, configArgs* cargs);
-int updatemax(fd_set set, int fdmax);
+int watchfd(int fd, int op, uint32_t events);
+int tcplisten();
+void newconnection(int newclient, bool remote);
+void queuestats();
+void epoll_acceptloop();
+#if defined(IO_URING)
+void uring_acceptloop();
+#endif
 
 int main(int argc, char *argv[]){
 
@@ -55,6 +78,10 @@ int main(int argc, char *argv[]){
             case 'f': {
                 if (parse_config(optarg, &confargs) == -1)
                     exit(EXIT_FAILURE);
+                if (confargs.iothreads == 0) confargs.iothreads = DEFAULT_IO_THREADS;
+                if (confargs.spawndelay == 0) confargs.spawndelay = DEFAULT_SPAWN_DELAY;
+                if (confargs.idletimeout == 0) confargs.idletimeout = DEFAULT_IDLE_TIMEOUT;
+                if (confargs.maxconnections == 0) confargs.maxconnections = DEFAULT_MAX_CONNECTIONS;
                 break;
             }
             case ':': {
@@ -73,11 +100,30 @@ int main(int argc, char *argv[]){
     logfile_opened = true;
     CHECK_NEQ_EXIT(pthread_mutex_init(&logfile_mutex, NULL), 0, "logfile mutex init")
 
-    CHECK_EQ_EXIT(pipe(fdpipe), -1, "create fdpipe")
-
     //creazione storage
     CHECK_EQ_EXIT(storage = fs_init(confargs.filelimit, confargs.storagecapacity, 0), NULL, "fs_init")
-    CHECK_EQ_EXIT(tpool = createThreadPool((int)confargs.nworkers, PENDING_SIZE), NULL,"create threadpool")
+    switch (confargs.scheduler) {
+        case STEALING_POOL:
+            CHECK_EQ_EXIT(tpool = createStealingPool((int)confargs.nworkers, PENDING_SIZE), NULL,"create threadpool")
+            break;
+        case LOCKFREE_POOL:
+            CHECK_EQ_EXIT(tpool = createLockfreePool((int)confargs.nworkers, PENDING_SIZE), NULL,"create threadpool")
+            break;
+        case PRIORITY_POOL:
+            CHECK_EQ_EXIT(tpool = createPriorityPool((int)confargs.nworkers, PENDING_SIZE), NULL,"create threadpool")
+            break;
+        default:
+            if (confargs.maxworkers > confargs.nworkers) {
+                CHECK_EQ_EXIT(tpool = createElasticPool((int)confargs.nworkers, confargs.maxworkers, PENDING_SIZE,
+                                                        confargs.spawndelay, confargs.idletimeout * 1000), NULL, "create threadpool")
+            } else {
+                CHECK_EQ_EXIT(tpool = createThreadPool((int)confargs.nworkers, PENDING_SIZE), NULL,"create threadpool")
+            }
+    }
+    if (confargs.maxworkers > confargs.nworkers && confargs.scheduler != FIFO_POOL)
+        fprintf(stderr, "< MAX_WORKERS requires SCHEDULER=FIFO, using %d workers\n", confargs.nworkers);
+    CHECK_NEQ_EXIT(pthread_create(&expiration_thread, NULL, (void *(*)(void *))expirationhandler, NULL), 0, "expiration thread create")
+    expiration_thread_activated = true;
 
     //creazione socket
     __attribute__((unused)) int unused;
@@ -89,105 +135,212 @@ int main(int argc, char *argv[]){
     strncpy(sa.sun_path, confargs.sktname, strlen(confargs.sktname));
     SYSCALL_EXIT(unused, bind(listenfd, (struct sockaddr*)&sa, sizeof(sa)), "bind")
     SYSCALL_EXIT(unused, listen(listenfd, MAXBACKLOG), "listen")
+    if (confargs.tcpport > 0)
+        SYSCALL_EXIT(tcplistenfd, tcplisten(), "tcp listen")
+
+    //senza limite di FD_SETSIZE i client connessi sono limitati solo dai descrittori disponibili: il limite soft
+    //viene alzato quanto basta per MAX_CONNECTIONS client, senza superare quello hard
+    struct rlimit fdlimit;
+    rlim_t wanted = (rlim_t) confargs.maxconnections + 2 * RESERVED_FDS;
+    CHECK_EQ_EXIT(getrlimit(RLIMIT_NOFILE, &fdlimit), -1, "getrlimit")
+    if (fdlimit.rlim_cur != RLIM_INFINITY && fdlimit.rlim_cur < wanted) {
+        fdlimit.rlim_cur = (fdlimit.rlim_max != RLIM_INFINITY && fdlimit.rlim_max < wanted) ? fdlimit.rlim_max : wanted;
+        if (setrlimit(RLIMIT_NOFILE, &fdlimit) == -1) {
+            PRINT_PERROR("setrlimit")
+            CHECK_EQ_EXIT(getrlimit(RLIMIT_NOFILE, &fdlimit), -1, "getrlimit")
+        }
+    }
+    //i client con fd oltre maxfd vengono rifiutati, così restano RESERVED_FDS descrittori per gli altri fd aperti
+    //durante le richieste e accept non fallisce per mancanza di descrittori
+    rlim_t fdbound = (fdlimit.rlim_cur != RLIM_INFINITY && fdlimit.rlim_cur < wanted) ? fdlimit.rlim_cur : wanted;
+    int maxfd = (fdbound > 2 * RESERVED_FDS) ? (int) (fdbound - RESERVED_FDS) : (int) fdbound;
+    //le connessioni vengono distribuite tra i reactor, il thread principale si occupa solo di accettarle
+    CHECK_EQ_EXIT(rpool = createReactorPool(confargs.iothreads, maxfd, confargs.iobackend, tpool, (void (*)(void *)) requesthandler), NULL, "create reactorpool")
+
+    if (confargs.iobackend == URING_BACKEND && rpool->backend != URING_BACKEND)
+        fprintf(stderr, "< io_uring not available, using epoll\n");
+    //il registro delle connessioni in memoria condivisa non può crescere mentre i worker lo consultano
+    if (confargs.shmringsize > 0)
+        CHECK_EQ_EXIT(shmchan_reserve(maxfd), -1, "shmchan reserve")
 
-    fd_set set, rset;
-    FD_ZERO(&set);
-    FD_SET(listenfd, &set);
-    FD_SET(fdpipe[0], &set);
-    FD_SET(signalpipe[0], &set);
     //Adesso che ho assegnato la pipe faccio partire il thread dei segnali
     CHECK_NEQ_EXIT(pthread_create(&signal_thread, NULL, (void *(*)(void *))signalhandler, (void*)&sigset), 0, "signal thread create")
     signal_thread_activated = true;
 
-    int connected = 0;
-    int fd_max, fd;
-    fd_max = max(3, listenfd, fdpipe[0], signalpipe[0]);
-    while(!shutdown_now && (!shutdown_ || connected)) {
-        rset = set;
+#if defined(IO_URING)
+    if (rpool->backend == URING_BACKEND && (acceptring = uring_create(URING_ENTRIES)) != NULL) {
+        uring_acceptloop();
+        //distruggere l'istanza cancella l'accept ancora in corso, altrimenti terrebbe aperto il listenfd
+        uring_destroy(acceptring);
+        acceptring = NULL;
+    } else
+#endif
+    epoll_acceptloop();
+
+    if (shutdown_now) {
+        //fermo i reactor prima del threadpool, così non vengono passate altre richieste
+        CHECK_EQ_EXIT(stopReactorPool(rpool), -1, "reactorpool stop")
+        queuestats();
+        CHECK_EQ_EXIT(destroyThreadPool(tpool, 1), -1, "threadpool destroy")
+        tpool = NULL;
+    } else {
+        //chiudo i listenfd e continuo a servire richieste finché ci sono ancora client connessi
+        close(listenfd);
+        listenfd = -1;
+        if (tcplistenfd != -1) close(tcplistenfd);
+        tcplistenfd = -1;
+        CHECK_EQ_EXIT(drainReactorPool(rpool), -1, "reactorpool drain")
+        queuestats();
+    }
+    //in caso di uscita immediata i fd dei client ancora connessi vengono chiusi all'uscita del processo
+    return 0;
+}
+
+//crea il socket TCP su cui accettare le connessioni dei client remoti
+int tcplisten(){
+    char port[16];
+    snprintf(port, sizeof(port), "%d", confargs.tcpport);
+    struct addrinfo hints, *res, *ai;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    int err = getaddrinfo(confargs.tcpaddress, port, &hints, &res);
+    if (err != 0) {
+        fprintf(stderr, "< getaddrinfo: %s\n", gai_strerror(err));
+        errno = EADDRNOTAVAIL;
+        return -1;
+    }
+
+    int fd = -1, on = 1;
+    for (ai = res; ai != NULL; ai = ai->ai_next) {
+        if ((fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol)) == -1) continue;
+        //i buffer vanno impostati prima di listen: i socket accettati li ereditano e la finestra TCP
+        //viene negoziata durante il three-way handshake
+        if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) == 0
+            && (confargs.tcpsndbuf == 0 || setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &confargs.tcpsndbuf, sizeof(int)) == 0)
+            && (confargs.tcprcvbuf == 0 || setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &confargs.tcprcvbuf, sizeof(int)) == 0)
+            && bind(fd, ai->ai_addr, ai->ai_addrlen) == 0
+            && listen(fd, MAXBACKLOG) == 0)
+            break;
+        int errnosv = errno;
+        close(fd);
+        fd = -1;
+        errno = errnosv;
+    }
+    freeaddrinfo(res);
+    return fd;
+}
+
+//registra il nuovo client e lo assegna ad un reactor
+void newconnection(int newclient, bool remote){
+    //richieste e risposte sono messaggi brevi scambiati a botta e risposta, l'algoritmo di Nagle li ritarderebbe
+    int nodelay = 1;
+    if (remote && setsockopt(newclient, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay)) == -1)
+        PRINT_PERROR("setsockopt TCP_NODELAY")
+    //loggo prima di assegnarlo, da quel momento il reactor può già disconnetterlo
+    if (log_operation("CONNECT", newclient, 0, 0, 0, 0, "OK") == -1)
+        exit(EXIT_FAILURE);
+    if (addToReactorPool(rpool, newclient, remote) == -1) {
+        PRINT_PERROR("add reactorpool")
+        close(newclient);
+        if (log_operation("DISCONNECT", newclient, 0, 0, 0, 0, "OK") == -1)
+            exit(EXIT_FAILURE);
+    }
+}
 
-        if (select(fd_max + 1, &rset, NULL, NULL, NULL) == -1) {
+//accetta le connessioni finché non arriva un segnale di terminazione
+void epoll_acceptloop(){
+    __attribute__((unused)) int unused;
+    SYSCALL_EXIT(epollfd, epoll_create1(EPOLL_CLOEXEC), "epoll_create1")
+    SYSCALL_EXIT(unused, watchfd(listenfd, EPOLL_CTL_ADD, EPOLLIN), "epoll_ctl listenfd")
+    if (tcplistenfd != -1)
+        SYSCALL_EXIT(unused, watchfd(tcplistenfd, EPOLL_CTL_ADD, EPOLLIN), "epoll_ctl tcplistenfd")
+    SYSCALL_EXIT(unused, watchfd(signalpipe[0], EPOLL_CTL_ADD, EPOLLIN), "epoll_ctl signalpipe")
+
+    int nready, fd;
+    struct epoll_event events[MAX_EVENTS];
+    while(!shutdown_now && !shutdown_) {
+
+        if ((nready = epoll_wait(epollfd, events, MAX_EVENTS, -1)) == -1) {
             if (errno == EINTR) continue; //segnali terminazione
-            PRINT_PERROR("select")
+            PRINT_PERROR("epoll_wait")
             exit(EXIT_FAILURE);
         }
 
-        for (fd = 0; fd <= fd_max; fd++) {
+        for (int i = 0; i < nready; i++) {
 
-            if (shutdown_now) {
-                CHECK_EQ_EXIT(destroyThreadPool(tpool, 1), -1, "threadpool destroy")
-                tpool = NULL;
-                break; //esco immediatamente
-            }
+            fd = events[i].data.fd;
+            if (fd == listenfd || fd == tcplistenfd) { //nuova richiesta di connessione
+
+                if (shutdown_ || shutdown_now) continue; //i listenfd verranno chiusi all'uscita dal ciclo
+                int newclient;
+                SYSCALL_EXIT(newclient, accept(fd, NULL, NULL), "accept")
+                newconnection(newclient, fd == tcplistenfd);
+
+            } else if (fd == signalpipe[0]) { //segnali terminazione
 
-            if (FD_ISSET(fd, &rset)) {
-                if (fd == listenfd && !shutdown_) { //nuova richiesta di connessione
-
-                    int newclient;
-                    SYSCALL_EXIT(newclient, accept(listenfd, NULL, NULL), "accept")
-                    connected++;
-                    FD_SET(newclient, &set); //aggiungo il fd al set generale
-                    if (newclient > fd_max) fd_max = newclient;
-                    if (log_operation("CONNECT", newclient, 0, 0, 0, 0, "OK") == -1)
-                        exit(EXIT_FAILURE);
-
-                } else if (fd == signalpipe[0]) { //segnali terminazione
-
-                    //tolgo la pipe dall'insieme
-                    FD_CLR(fd, &set);
-                    if (shutdown_now) break;
-                    if (shutdown_) { //chiudo il listenfd e continuo a servire richieste finché ci sono ancora client connessi
-                        FD_CLR(listenfd, &set);
-                        close(listenfd);
-                        if (listenfd == fd_max) fd_max = updatemax(set, fd_max);
-                    }
-                } else if (fd == fdpipe[0]) {
-
-                    int completedclient;
-                    CHECK_EQ_EXIT(read(fdpipe[0], &completedclient, sizeof(int)), -1, "read fdpipe")
-
-                    if (completedclient >= 0) {
-                        FD_SET(completedclient, &set);
-                        if (completedclient > fd_max) fd_max = completedclient;
-                    } else {
-                        int client = completedclient *(-1);
-                        FD_CLR(client, &set);
-                        close(client);
-                        connected--;
-                        if (client == fd_max) fd_max = updatemax(set, fd_max);
-                        if (log_operation("DISCONNECT", client, 0, 0, 0, 0, "OK") == -1)
-                            exit(EXIT_FAILURE);
-                    }
-                } else { //client
-                    int ret;
-                    int *client;
-                    MALLOC(client, 1, int)
-                    *client = fd;
-                    CHECK_EQ_EXIT((ret = addToThreadPool(tpool, (void (*)(void *)) requesthandler, client)), -1, "add threadpool")
-
-                    if (ret == 1) { //in questo caso il threadpool ha ritornato coda piena
-                        FD_CLR(fd, &set);
-                        close(fd);
-                        connected--;
-                        if (fd == fd_max) fd_max = updatemax(set, fd_max);
-                        if (log_operation("DISCONNECT", fd, 0, 0, 0, 0, "OK") == -1)
-                            exit(EXIT_FAILURE);
-                        continue;
-                    }
-                    //togliamo il fd dal set perchè adesso viene gestito dal threadpool
-                    FD_CLR(fd, &set);
-                    if (fd == fd_max) fd_max = updatemax(set, fd_max);
-                }
+                //tolgo la pipe dall'insieme
+                SYSCALL_EXIT(unused, watchfd(fd, EPOLL_CTL_DEL, 0), "epoll_ctl signalpipe")
+                break;
             }
         }
     }
-    if (shutdown_now){
-        //chiudo tutti i fd attivi
-        for (fd = 0; fd <= fd_max; fd++) {
-            if (FD_ISSET(fd, &set)) close(fd);
+}
+
+#if defined(IO_URING)
+#define ACCEPT_EVENT 1
+#define SIGNAL_EVENT 2
+#define TCP_ACCEPT_EVENT 3
+
+//come epoll_acceptloop, ma accept e lettura della signalpipe sono operazioni asincrone su acceptring
+void uring_acceptloop(){
+    int signal;
+    struct io_uring_sqe *sqe;
+    struct io_uring_cqe *cqe;
+
+    LOCK(&acceptring->mutex)
+    CHECK_EQ_EXIT(sqe = uring_getsqe(acceptring), NULL, "io_uring sqe")
+    uring_prep_accept(sqe, listenfd, ACCEPT_EVENT);
+    if (tcplistenfd != -1) {
+        CHECK_EQ_EXIT(sqe = uring_getsqe(acceptring), NULL, "io_uring sqe")
+        uring_prep_accept(sqe, tcplistenfd, TCP_ACCEPT_EVENT);
+    }
+    CHECK_EQ_EXIT(sqe = uring_getsqe(acceptring), NULL, "io_uring sqe")
+    uring_prep_read(sqe, signalpipe[0], &signal, sizeof(int), SIGNAL_EVENT);
+    UNLOCK(&acceptring->mutex)
+
+    while(!shutdown_now && !shutdown_) {
+
+        if (uring_enter(acceptring, 1) == -1) {
+            if (errno == EINTR) continue; //segnali terminazione
+            PRINT_PERROR("io_uring_enter")
+            exit(EXIT_FAILURE);
+        }
+
+        while ((cqe = uring_peekcqe(acceptring)) != NULL) {
+            uint64_t event = cqe->user_data;
+            int res = cqe->res;
+            uring_cqeseen(acceptring);
+            //il segnale di terminazione viene gestito dalla condizione del ciclo
+            if (event != ACCEPT_EVENT && event != TCP_ACCEPT_EVENT) continue;
+
+            if (res >= 0) { //nuova connessione
+                newconnection(res, event == TCP_ACCEPT_EVENT);
+            } else if (res != -EINTR && res != -ECONNABORTED) {
+                errno = -res;
+                PRINT_PERROR("accept")
+                exit(EXIT_FAILURE);
+            }
+            if (shutdown_ || shutdown_now) continue;
+            LOCK(&acceptring->mutex)
+            CHECK_EQ_EXIT(sqe = uring_getsqe(acceptring), NULL, "io_uring sqe")
+            uring_prep_accept(sqe, event == TCP_ACCEPT_EVENT ? tcplistenfd : listenfd, event);
+            UNLOCK(&acceptring->mutex)
         }
     }
-    return 0;
 }
+#endif
 
 void cleanup(){
     if (confargs.sktname && strcmp(confargs.sktname, "") != 0){
@@ -195,8 +348,15 @@ void cleanup(){
         free(confargs.sktname);
     }
     if (confargs.logfile) free(confargs.logfile);
+    if (confargs.tcpaddress) free(confargs.tcpaddress);
 
+    if (rpool) stopReactorPool(rpool);
     if (tpool) destroyThreadPool(tpool, 0);
+    if (rpool) destroyReactorPool(rpool);
+    if (expiration_thread_activated) {
+        __atomic_store_n(&expiration_stop, true, __ATOMIC_SEQ_CST);
+        pthread_join(expiration_thread, NULL);
+    }
     if (storage) {
         fs_stats(storage);
         log_operation("MAXFILES", 0, 0, storage->max_files_number, 0, 0, "OK");
@@ -211,7 +371,12 @@ void cleanup(){
         }
         fs_destroy(storage);
     }
+#if defined(IO_URING)
+    if (acceptring) uring_destroy(acceptring);
+#endif
     if (listenfd != -1) close(listenfd);
+    if (tcplistenfd != -1) close(tcplistenfd);
+    if (epollfd != -1) close(epollfd);
     if (signal_thread_activated) pthread_join(signal_thread, NULL);
     if (logfile_opened) {
         fclose(logfile);
@@ -219,6 +384,26 @@ void cleanup(){
     }
 }
 
+//stampa e registra nel log la profondità massima raggiunta dalla coda delle richieste
+void queuestats(){
+    printf("Request Queue Stats:\n");
+    printf("    MAX QUEUED REQUESTS: %d OF %d\n", tpool->maxcount, PENDING_SIZE);
+    printf("    REQUESTS THROTTLED WITH FULL QUEUE: %lu\n", rpool->throttled);
+    printf("    MAX THROTTLED REQUESTS: %d\n", rpool->maxdeferred);
+    poolstats_t stats;
+    if (getPoolStats(tpool, &stats) == 0 && stats.maxthreads > stats.minthreads) {
+        printf("Worker Pool Stats:\n");
+        printf("    WORKERS: %d (MIN %d, MAX %d, PEAK %d)\n", stats.threads, stats.minthreads, stats.maxthreads, stats.peak);
+        printf("    WORKERS SPAWNED: %lu, RETIRED: %lu\n", stats.spawned, stats.retired);
+        printf("    WORKERS OVER TIME (MAX EVERY %d S):", stats.samplesec);
+        for (int i = 0; i < stats.nsamples; i++) printf(" %d", stats.samples[i]);
+        printf("\n");
+    }
+    if (log_operation("MAXQUEUE", 0, 0, tpool->maxcount + rpool->maxdeferred, 0, 0, "OK") == -1
+        || log_operation("THROTTLED", 0, 0, rpool->throttled, 0, 0, "OK") == -1)
+        exit(EXIT_FAILURE);
+}
+
 void signalhandler(void *arg){
     sigset_t* sigset = (sigset_t*) arg;
     int signal;
@@ -237,13 +422,38 @@ void signalhandler(void *arg){
     CHECK_EQ_EXIT(write(signalpipe[1], &signal, sizeof(int)), -1, "signalpipe write")
 }
 
-//ritorno l'inidce massimo dei descrittori attivi
-int updatemax(fd_set set, int fdmax){
-    for (int i = fdmax-1; i >= 0 ; --i) {
-        if(FD_ISSET(i, &set))
-            return i;
+//ad ogni tick rimuove dallo storage i file scaduti e registra la loro rimozione nel log
+void expirationhandler(void *arg){
+    //il flag viene scritto dal thread che termina il server
+    while (!__atomic_load_n(&expiration_stop, __ATOMIC_SEQ_CST)) {
+        msleep(TTL_TICK_MSEC);
+
+        list_t *expired = NULL;
+        CHECK_EQ_EXIT(expired = list_init(), NULL, "list_init")
+        int rescode = fs_expireFiles(storage, expired);
+        elem_t *elem;
+        while ((elem = list_removehead(expired)) != NULL) {
+            file_t *file = elem->data;
+            if (log_operation("EXPIRE", 0, file->size, 0, 0, file->filename, "OK") == -1)
+                exit(EXIT_FAILURE);
+            fs_filedestroy(file);
+            free(elem);
+        }
+        list_destroy(expired, free);
+        if (rescode == ENOTRECOVERABLE) {
+            PRINT_ERROR("fatal error")
+            exit(EXIT_FAILURE);
+        }
     }
-    return -1;
+}
+
+//aggiunge, modifica o rimuove fd dall'insieme dei descrittori monitorati
+int watchfd(int fd, int op, uint32_t events){
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = events;
+    event.data.fd = fd;
+    return epoll_ctl(epollfd, op, fd, &event);
 }
 
 int parse_config(const char* config_filename, configArgs* cargs){
@@ -373,6 +583,217 @@ int parse_configline(char* line, configArgs* cargs){
         return 0;
     }
     
+    //parsing numero di thread reactor
+    if (strcmp(tok, "IO_THREADS") == 0) {
+        tok = strtok_r(NULL, "=", &tmpstr);
+        if (!tok || *tok == '\n') {
+            PRINT_ERROR("Missing I/O threads argument")
+            return -1;
+        }
+        TRUNC_NEWLINE(tok)
+        if (isNumber(tok, &value) != 0 || value <= 0) {
+            PRINT_ERROR("Invalid I/O threads argument")
+            return -1;
+        }
+        cargs->iothreads = (int)value;
+        return 0;
+    }
+
+    //parsing meccanismo di attesa delle richieste
+    if (strcmp(tok, "IO_BACKEND") == 0) {
+        tok = strtok_r(NULL, "=", &tmpstr);
+        if (!tok || *tok == '\n') {
+            PRINT_ERROR("Missing I/O backend argument")
+            return -1;
+        }
+        TRUNC_NEWLINE(tok)
+        if (strcmp(tok, "EPOLL") == 0) {
+            cargs->iobackend = EPOLL_BACKEND;
+            return 0;
+        }
+        if (strcmp(tok, "IO_URING") == 0) {
+            //se il server non è compilato con IO_URING o il kernel non lo supporta si usa epoll
+            cargs->iobackend = URING_BACKEND;
+            return 0;
+        }
+        PRINT_ERROR("Invalid I/O backend argument")
+        return -1;
+    }
+
+    //parsing capacità degli anelli in memoria condivisa
+    if (strcmp(tok, "SHM_RING_SIZE") == 0) {
+        tok = strtok_r(NULL, "=", &tmpstr);
+        if (!tok || *tok == '\n') {
+            PRINT_ERROR("Missing shared memory ring size argument")
+            return -1;
+        }
+        TRUNC_NEWLINE(tok)
+        if (isNumber(tok, &value) != 0 || value < 0 || value > SHM_RING_MAX) {
+            PRINT_ERROR("Invalid shared memory ring size argument")
+            return -1;
+        }
+        cargs->shmringsize = (size_t) value;
+        return 0;
+    }
+
+    //parsing indirizzo delle connessioni TCP
+    if (strcmp(tok, "TCP_ADDRESS") == 0) {
+        tok = strtok_r(NULL, "=", &tmpstr);
+        if (!tok || *tok == '\n') {
+            PRINT_ERROR("Missing TCP address argument")
+            return -1;
+        }
+        TRUNC_NEWLINE(tok)
+        if (cargs->tcpaddress) free(cargs->tcpaddress);
+        cargs->tcpaddress = strndup(tok, strlen(tok));
+        if(cargs->tcpaddress == NULL){
+            PRINT_PERROR("strndup")
+            return -1;
+        }
+        return 0;
+    }
+
+    //parsing porta delle connessioni TCP
+    if (strcmp(tok, "TCP_PORT") == 0) {
+        tok = strtok_r(NULL, "=", &tmpstr);
+        if (!tok || *tok == '\n') {
+            PRINT_ERROR("Missing TCP port argument")
+            return -1;
+        }
+        TRUNC_NEWLINE(tok)
+        if (isNumber(tok, &value) != 0 || value < 0 || value > 65535) {
+            PRINT_ERROR("Invalid TCP port argument")
+            return -1;
+        }
+        cargs->tcpport = (int)value;
+        return 0;
+    }
+
+    //parsing dimensione dei buffer dei socket TCP
+    if (strcmp(tok, "TCP_SNDBUF") == 0 || strcmp(tok, "TCP_RCVBUF") == 0) {
+        int *bufsize = (strcmp(tok, "TCP_SNDBUF") == 0) ? &cargs->tcpsndbuf : &cargs->tcprcvbuf;
+        tok = strtok_r(NULL, "=", &tmpstr);
+        if (!tok || *tok == '\n') {
+            PRINT_ERROR("Missing TCP buffer size argument")
+            return -1;
+        }
+        TRUNC_NEWLINE(tok)
+        if (isNumber(tok, &value) != 0 || value < 0 || value > INT_MAX) {
+            PRINT_ERROR("Invalid TCP buffer size argument")
+            return -1;
+        }
+        *bufsize = (int)value;
+        return 0;
+    }
+
+    //parsing dimensione minima dei payload compressi
+    if (strcmp(tok, "COMPRESS_MIN_SIZE") == 0) {
+        tok = strtok_r(NULL, "=", &tmpstr);
+        if (!tok || *tok == '\n') {
+            PRINT_ERROR("Missing compression minimum size argument")
+            return -1;
+        }
+        TRUNC_NEWLINE(tok)
+        if (isNumber(tok, &value) != 0 || value < 0) {
+            PRINT_ERROR("Invalid compression minimum size argument")
+            return -1;
+        }
+        cargs->compressmin = (size_t) value;
+        return 0;
+    }
+
+    //parsing numero massimo di worker del pool elastico
+    if (strcmp(tok, "MAX_WORKERS") == 0) {
+        tok = strtok_r(NULL, "=", &tmpstr);
+        if (!tok || *tok == '\n') {
+            PRINT_ERROR("Missing maximum thread workers argument")
+            return -1;
+        }
+        TRUNC_NEWLINE(tok)
+        if (isNumber(tok, &value) != 0 || value <= 0 || value > INT_MAX) {
+            PRINT_ERROR("Invalid maximum thread workers argument")
+            return -1;
+        }
+        cargs->maxworkers = (int) value;
+        return 0;
+    }
+
+    //parsing attesa in coda oltre cui il pool elastico aggiunge un worker (ms)
+    if (strcmp(tok, "WORKER_SPAWN_DELAY") == 0) {
+        tok = strtok_r(NULL, "=", &tmpstr);
+        if (!tok || *tok == '\n') {
+            PRINT_ERROR("Missing worker spawn delay argument")
+            return -1;
+        }
+        TRUNC_NEWLINE(tok)
+        if (isNumber(tok, &value) != 0 || value <= 0 || value > INT_MAX) {
+            PRINT_ERROR("Invalid worker spawn delay argument")
+            return -1;
+        }
+        cargs->spawndelay = (int) value;
+        return 0;
+    }
+
+    //parsing numero massimo di client connessi
+    if (strcmp(tok, "MAX_CONNECTIONS") == 0) {
+        tok = strtok_r(NULL, "=", &tmpstr);
+        if (!tok || *tok == '\n') {
+            PRINT_ERROR("Missing maximum connections argument")
+            return -1;
+        }
+        TRUNC_NEWLINE(tok)
+        if (isNumber(tok, &value) != 0 || value <= 0 || value > INT_MAX - 2 * RESERVED_FDS) {
+            PRINT_ERROR("Invalid maximum connections argument")
+            return -1;
+        }
+        cargs->maxconnections = (int) value;
+        return 0;
+    }
+
+    //parsing inattività dopo cui il pool elastico ritira i worker aggiunti (s)
+    if (strcmp(tok, "WORKER_IDLE_TIMEOUT") == 0) {
+        tok = strtok_r(NULL, "=", &tmpstr);
+        if (!tok || *tok == '\n') {
+            PRINT_ERROR("Missing worker idle timeout argument")
+            return -1;
+        }
+        TRUNC_NEWLINE(tok)
+        if (isNumber(tok, &value) != 0 || value <= 0 || value > INT_MAX / 1000) {
+            PRINT_ERROR("Invalid worker idle timeout argument")
+            return -1;
+        }
+        cargs->idletimeout = (int) value;
+        return 0;
+    }
+
+    //parsing politica di assegnazione delle richieste ai worker
+    if (strcmp(tok, "SCHEDULER") == 0) {
+        tok = strtok_r(NULL, "=", &tmpstr);
+        if (!tok || *tok == '\n') {
+            PRINT_ERROR("Missing scheduler argument")
+            return -1;
+        }
+        TRUNC_NEWLINE(tok)
+        if (strcmp(tok, "FIFO") == 0) {
+            cargs->scheduler = FIFO_POOL;
+            return 0;
+        }
+        if (strcmp(tok, "WORK_STEALING") == 0) {
+            cargs->scheduler = STEALING_POOL;
+            return 0;
+        }
+        if (strcmp(tok, "LOCK_FREE") == 0) {
+            cargs->scheduler = LOCKFREE_POOL;
+            return 0;
+        }
+        if (strcmp(tok, "PRIORITY") == 0) {
+            cargs->scheduler = PRIORITY_POOL;
+            return 0;
+        }
+        PRINT_ERROR("Invalid scheduler argument")
+        return -1;
+    }
+
     //parsing politica di rimpiazzamento
     if (strcmp(tok, "REPLACE_MODE") == 0) {
         tok = strtok_r(NULL, "=", &tmpstr);
@@ -0,0 +1,909 @@
+/**
+ * @file reactor.c
+ * @brief Implementazione del pool di reactor
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+#include <util.h>
+#include <reactor.h>
+#include <manager.h>
+
+//stato della connessione sul fd, NULL se il fd non è mai stato assegnato a un reactor
+static connection_t *getconn(reactorpool_t *pool, int fd) {
+    if (!pool || fd < 0 || fd >= pool->maxfd) return NULL;
+    //il blocco viene pubblicato da addToReactorPool prima di passare il client al reactor
+    connection_t *block = __atomic_load_n(&pool->conns[fd / CONN_BLOCK], __ATOMIC_ACQUIRE);
+    if (!block || !block[fd % CONN_BLOCK].owner) return NULL;
+    return &block[fd % CONN_BLOCK];
+}
+
+//decrementa il numero di client del reactor e chiude la connessione
+static int closeclient(reactor_t *reactor, int clientfd) {
+    reactorpool_t *pool = reactor->pool;
+    connection_t *conn = getconn(pool, clientfd);
+
+    if (log_operation("DISCONNECT", clientfd, 0, 0, 0, 0, "OK") == -1) return -1;
+    shmchan_destroy(shmchan_unregister(clientfd));
+    free(conn->pending);
+    conn->pending = NULL;
+    conn->npending = 0;
+    LOCK_RETURN(&pool->mutex, -1)
+    reactor->connected--;
+    pool->connected--;
+    if (pool->connected == 0 && pthread_cond_broadcast(&pool->drained) != 0) {
+        UNLOCK_RETURN(&pool->mutex, -1)
+        return -1;
+    }
+    UNLOCK_RETURN(&pool->mutex, -1)
+    close(clientfd);
+    return 0;
+}
+
+static int watch(int epollfd, int fd, int op, uint32_t events) {
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = events;
+    event.data.fd = fd;
+    return epoll_ctl(epollfd, op, fd, &event);
+}
+
+static void runtask(void *arg);
+
+//passa al threadpool le richieste sospese, in ordine di arrivo per ogni classe, finché la coda ha posto. Una classe
+//che non trova posto non ferma le altre: le richieste brevi possono occupare la parte della coda riservata a loro.
+//Da chiamare con pool->mutex
+static int flushdeferred(reactorpool_t *pool) {
+    for (int c = 0; c < TASK_CLASSES; c++) {
+        int ret = 0;
+        while (pool->deferred[c] && (ret = addToThreadPoolClass(pool->tpool, runtask, pool->deferred[c], c)) == 0) {
+            pool->deferred[c] = pool->deferred[c]->next;
+            if (!pool->deferred[c]) pool->lastdeferred[c] = NULL;
+            __atomic_sub_fetch(&pool->classdeferred[c], 1, __ATOMIC_SEQ_CST);
+            __atomic_sub_fetch(&pool->ndeferred, 1, __ATOMIC_SEQ_CST);
+        }
+        if (ret == -1) return -1;
+    }
+    return 0;
+}
+
+taskclass_t requestClass(reactorpool_t *pool, const char *data, size_t size) {
+    wire_header wire;
+
+    if (!pool || pool->tpool->kind != PRIORITY_POOL || !data || size < sizeof(wire)) return NORMAL_TASK;
+    memcpy(&wire, data, sizeof(wire));
+    if (wire.version != PROTOCOL_VERSION) return NORMAL_TASK;
+
+    switch (wire.code) {
+        case OPEN:
+        case LOCK:
+        case UNLOCK:
+        case CLOSE:
+        case REMOVE:
+        case FIN:
+        case HELLO:
+            return SHORT_TASK;
+        case READN:
+            return BULK_TASK;
+        case WRITE:
+        case APPEND:
+        case PUT:
+            //i trasferimenti a chunk proseguono con altri messaggi, il primo non ne riporta la dimensione totale
+            if (wire.data_size >= BULK_SIZE || (wire.flags & (FLAG_MORE | FLAG_CHUNK | FLAG_MEMFD)))
+                return BULK_TASK;
+            return NORMAL_TASK;
+        case BATCH:
+            //i contenuti letti stanno in BATCH_READ_BUDGET, il resto della risposta cresce con le operazioni
+            return (wire.arg > BULK_OPS) ? BULK_TASK : NORMAL_TASK;
+        default:
+            return NORMAL_TASK;
+    }
+}
+
+//passa il task al threadpool. Se la coda è piena, o altre richieste della stessa classe sono già sospese e vanno
+//servite prima, il task viene sospeso: il client resta disattivato e le sue richieste successive restano nel socket,
+//così un client che continua ad inviare si blocca sul proprio buffer di invio invece di venire disconnesso
+static int submittask(reactorpool_t *pool, clienttask_t *task) {
+    int c = task->class = requestClass(pool, task->prefetch, task->prefetched);
+    task->pool = pool;
+    task->next = NULL;
+    if (__atomic_load_n(&pool->classdeferred[c], __ATOMIC_SEQ_CST) == 0) {
+        int ret = addToThreadPoolClass(pool->tpool, runtask, task, c);
+        if (ret != 1) return ret;
+    }
+
+    LOCK_RETURN(&pool->mutex, -1)
+    if (pool->lastdeferred[c]) pool->lastdeferred[c]->next = task;
+    else pool->deferred[c] = task;
+    pool->lastdeferred[c] = task;
+    __atomic_add_fetch(&pool->classdeferred[c], 1, __ATOMIC_SEQ_CST);
+    int ndeferred = __atomic_add_fetch(&pool->ndeferred, 1, __ATOMIC_SEQ_CST);
+    if (ndeferred > pool->maxdeferred) pool->maxdeferred = ndeferred;
+    pool->throttled++;
+    //un worker potrebbe aver liberato un posto prima di vedere il task sospeso
+    if (flushdeferred(pool) == -1) {
+        UNLOCK_RETURN(&pool->mutex, -1)
+        return -1;
+    }
+    UNLOCK_RETURN(&pool->mutex, -1)
+    return 0;
+}
+
+/**
+ * @function void runtask(void *arg)
+ * @brief funzione eseguita dal threadpool: il task appena estratto ha liberato un posto nella coda,
+ * che viene occupato dalla prima richiesta sospesa prima di servire quella del task
+ */
+static void runtask(void *arg) {
+    clienttask_t *task = (clienttask_t *) arg;
+    reactorpool_t *pool = task->pool;
+
+    if (__atomic_load_n(&pool->ndeferred, __ATOMIC_SEQ_CST) > 0) {
+        LOCK(&pool->mutex)
+        if (flushdeferred(pool) == -1) {
+            PRINT_PERROR("threadpool add")
+            exit(EXIT_FAILURE);
+        }
+        UNLOCK(&pool->mutex)
+    }
+    pool->handler(task);
+}
+
+//passa la richiesta del client al threadpool, se la coda è piena il client resta sospeso (vedi submittask)
+static int dispatch(reactor_t *reactor, int clientfd, char *prefetch, size_t prefetched, int bid) {
+    reactorpool_t *pool = reactor->pool;
+
+    clienttask_t *task = malloc(sizeof(clienttask_t));
+    if (task == NULL) return -1;
+    task->fd = clientfd;
+    task->prefetch = prefetch;
+    task->prefetched = prefetched;
+    task->bid = bid;
+
+    if (submittask(pool, task) == -1) {
+        free(task);
+        return -1;
+    }
+    //il client è già disattivato (oneshot), adesso viene gestito dal threadpool
+    return 0;
+}
+
+//come dispatch, ma con il pool con priorità riceve l'inizio delle richieste per classificarle (vedi requestClass):
+//il worker consuma questi byte invece di leggerli dal socket. Le connessioni in memoria condivisa hanno le richieste
+//nell'anello, sul socket ci sono solo i byte con cui il client le sveglia
+static int epoll_dispatch(reactor_t *reactor, int clientfd) {
+    if (reactor->pool->tpool->kind != PRIORITY_POOL || shmchan_lookup(clientfd))
+        return dispatch(reactor, clientfd, NULL, 0, -1);
+
+    char *prefetch = malloc(PREFETCH_SIZE);
+    if (prefetch == NULL) return -1;
+    ssize_t n;
+    while ((n = recv(clientfd, prefetch, PREFETCH_SIZE, MSG_DONTWAIT)) == -1 && errno == EINTR);
+    if (n <= 0) {
+        //chiusura o errore della connessione, il worker li rileva leggendo dal socket
+        free(prefetch);
+        return dispatch(reactor, clientfd, NULL, 0, -1);
+    }
+    if (dispatch(reactor, clientfd, prefetch, (size_t) n, -1) == -1) {
+        free(prefetch);
+        return -1;
+    }
+    return 0;
+}
+
+#if defined(IO_URING)
+//tipo di operazione a cui si riferisce un completamento, nei 2 bit bassi di user_data: sopra c'è il fd del client
+//o, per l'I/O dei worker, l'indirizzo della sua uringio_t
+#define URING_PROVIDE   0UL
+#define URING_CLIENT    1UL
+#define URING_CLOSEPIPE 2UL
+#define URING_IO        3UL
+#define URING_TYPEMASK  3UL
+#define URING_DATA(type, fd) (((uint64_t) (uint32_t) (fd) << 2) | (type))
+
+/**
+ * @struct uringio_t
+ * @brief operazione di I/O di un worker sottomessa all'anello del reactor della connessione:
+ * il worker attende che il reactor ne raccolga il completamento
+ *
+ * @var res  risultato dell'operazione, -errno in caso di errore
+ */
+typedef struct uringio_ {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    bool done;
+    int res;
+} uringio_t;
+
+//pool i cui reactor completano l'I/O dei worker sul socket dei client, NULL se nessuno (vedi sockio.h)
+static reactorpool_t *uringpool = NULL;
+
+//inserisce un elemento nella SQ del reactor, se la coda è piena la svuota sottomettendo gli elementi presenti
+static struct io_uring_sqe *getsqe(reactor_t *reactor) {
+    struct io_uring_sqe *sqe;
+    while ((sqe = uring_getsqe(reactor->ring)) == NULL) {
+        UNLOCK_RETURN(&reactor->ring->mutex, NULL)
+        if (uring_enter(reactor->ring, 0) == -1) return NULL;
+        LOCK_RETURN(&reactor->ring->mutex, NULL)
+    }
+    return sqe;
+}
+
+//attende la prossima richiesta del client: il kernel la riceve direttamente in uno dei buffer del reactor
+static int submitrecv(reactor_t *reactor, int clientfd) {
+    LOCK_RETURN(&reactor->ring->mutex, -1)
+    struct io_uring_sqe *sqe;
+    if ((sqe = getsqe(reactor)) == NULL) return -1;
+    uring_prep_recv_select(sqe, clientfd, PREFETCH_SIZE, 0, URING_DATA(URING_CLIENT, clientfd));
+    UNLOCK_RETURN(&reactor->ring->mutex, -1)
+    return uring_enter(reactor->ring, 0);
+}
+
+//sottomette all'anello del reactor del client l'operazione indicata e ne attende il completamento.
+//Restituisce 0 e in *res il risultato dell'operazione, 1 senza sottomettere nulla se la connessione non è
+//di un reactor io_uring attivo (il chiamante esegue la system call equivalente), -1 in caso di errore
+static int ringio(int fd, int opcode, void *addr, size_t len, int flags, int *res) {
+    connection_t *conn = getconn(__atomic_load_n(&uringpool, __ATOMIC_ACQUIRE), fd);
+    if (!conn) return 1;
+    reactor_t *reactor = conn->owner;
+
+    uringio_t io;
+    io.done = false;
+    if (pthread_mutex_init(&io.mutex, NULL) != 0) return -1;
+    if (pthread_cond_init(&io.cond, NULL) != 0) {
+        pthread_mutex_destroy(&io.mutex);
+        return -1;
+    }
+    if (pthread_mutex_lock(&reactor->ring->mutex) != 0) goto error;
+    if (reactor->stopping) {
+        UNLOCK_RETURN(&reactor->ring->mutex, -1)
+        pthread_cond_destroy(&io.cond);
+        pthread_mutex_destroy(&io.mutex);
+        return 1;
+    }
+    struct io_uring_sqe *sqe;
+    if ((sqe = getsqe(reactor)) == NULL) goto error;
+    uint64_t data = (uint64_t) (uintptr_t) &io | URING_IO;
+    if (opcode == IORING_OP_RECV) uring_prep_recv(sqe, fd, addr, (unsigned) len, flags, data);
+    else if (opcode == IORING_OP_SENDMSG) uring_prep_sendmsg(sqe, fd, addr, flags, data);
+    else uring_prep_recvmsg(sqe, fd, addr, flags, data);
+    reactor->inflight++;
+    //da qui l'elemento in coda punta a io: si attende il completamento in ogni caso
+    UNLOCK(&reactor->ring->mutex)
+    //se la sottomissione fallisce l'elemento resta in coda e viene sottomesso dalla prossima uring_enter del reactor
+    while (uring_enter(reactor->ring, 0) == -1 && (errno == EINTR || errno == EAGAIN || errno == EBUSY));
+
+    LOCK(&io.mutex)
+    while (!io.done) pthread_cond_wait(&io.cond, &io.mutex);
+    UNLOCK(&io.mutex)
+    pthread_cond_destroy(&io.cond);
+    pthread_mutex_destroy(&io.mutex);
+    *res = io.res;
+    return 0;
+
+    error:
+    pthread_cond_destroy(&io.cond);
+    pthread_mutex_destroy(&io.mutex);
+    return -1;
+}
+
+static ssize_t uring_recv(int fd, void *buf, size_t len, int flags) {
+    int res, r;
+    if (len > INT_MAX) len = INT_MAX;
+    if ((r = ringio(fd, IORING_OP_RECV, buf, len, flags, &res)) == -1) return -1;
+    if (r == 1) return recv(fd, buf, len, flags);
+    if (res < 0) {
+        errno = -res;
+        return -1;
+    }
+    return res;
+}
+
+static ssize_t uring_sendmsg(int fd, const struct msghdr *msg, int flags) {
+    int res, r;
+    if ((r = ringio(fd, IORING_OP_SENDMSG, (void *) msg, 0, flags, &res)) == -1) return -1;
+    if (r == 1) {
+        ssize_t n;
+        while ((n = sendmsg(fd, msg, flags)) == -1 && errno == EINTR);
+        return n;
+    }
+    if (res < 0) {
+        errno = -res;
+        return -1;
+    }
+    return res;
+}
+
+static ssize_t uring_recvmsg(int fd, struct msghdr *msg, int flags) {
+    int res, r;
+    if ((r = ringio(fd, IORING_OP_RECVMSG, msg, 0, flags, &res)) == -1) return -1;
+    if (r == 1) {
+        ssize_t n;
+        while ((n = recvmsg(fd, msg, flags)) == -1 && errno == EINTR);
+        return n;
+    }
+    if (res < 0) {
+        errno = -res;
+        return -1;
+    }
+    return res;
+}
+
+//come readn, con RECV sottomesse all'anello del reactor del client
+static int uring_readn(int fd, void *buf, size_t size) {
+    size_t left = size;
+    char *bufptr = buf;
+    while (left > 0) {
+        ssize_t r;
+        if ((r = uring_recv(fd, bufptr, left, MSG_WAITALL)) == -1) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (r == 0) return 0;   // EOF
+        left -= r;
+        bufptr += r;
+    }
+    return (int) size;
+}
+
+//come writevn, con SENDMSG sottomesse all'anello del reactor del client
+static int uring_writevn(int fd, struct iovec *iov, int iovcnt) {
+    struct msghdr msg;
+    while (iovcnt > 0) {
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = iovcnt;
+        ssize_t r;
+        if ((r = uring_sendmsg(fd, &msg, MSG_NOSIGNAL)) == -1) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (r == 0) return 0;
+        advanceiov(&iov, &iovcnt, (size_t) r);
+    }
+    return 1;
+}
+
+static const sockio_t uringsockio = {uring_readn, uring_writevn, uring_sendmsg, uring_recvmsg};
+
+//segna il reactor in chiusura, restituisce true se non ha operazioni dei worker da completare e può terminare
+static bool stopreactor(reactor_t *reactor) {
+    LOCK(&reactor->ring->mutex)
+    reactor->stopping = true;
+    bool done = (reactor->inflight == 0);
+    UNLOCK(&reactor->ring->mutex)
+    return done;
+}
+
+static int submitclosepipe(reactor_t *reactor) {
+    LOCK_RETURN(&reactor->ring->mutex, -1)
+    struct io_uring_sqe *sqe;
+    if ((sqe = getsqe(reactor)) == NULL) return -1;
+    uring_prep_read(sqe, reactor->closepipe[0], &reactor->closeval, sizeof(int), URING_DATA(URING_CLOSEPIPE, 0));
+    UNLOCK_RETURN(&reactor->ring->mutex, -1)
+    return 0;
+}
+
+//accoda la restituzione del buffer, viene sottomessa alla prossima uring_enter
+static int providebuffer(reactor_t *reactor, int bid) {
+    LOCK_RETURN(&reactor->ring->mutex, -1)
+    struct io_uring_sqe *sqe;
+    if ((sqe = getsqe(reactor)) == NULL) return -1;
+    uring_prep_provide(sqe, reactor->buffers + bid * PREFETCH_SIZE, PREFETCH_SIZE, 1, 0, bid);
+    UNLOCK_RETURN(&reactor->ring->mutex, -1)
+    return 0;
+}
+
+static int uring_init(reactor_t *reactor) {
+    if ((reactor->ring = uring_create(URING_ENTRIES)) == NULL) return -1;
+    if ((reactor->buffers = malloc(URING_BUFFERS * PREFETCH_SIZE)) == NULL) return -1;
+
+    LOCK_RETURN(&reactor->ring->mutex, -1)
+    struct io_uring_sqe *sqe;
+    if ((sqe = getsqe(reactor)) == NULL) return -1;
+    uring_prep_provide(sqe, reactor->buffers, PREFETCH_SIZE, URING_BUFFERS, 0, 0);
+    UNLOCK_RETURN(&reactor->ring->mutex, -1)
+    if (submitclosepipe(reactor) == -1) return -1;
+    return uring_enter(reactor->ring, 0);
+}
+
+/**
+ * @function void *uring_reactor_thread(void *arg)
+ * @brief funzione eseguita dal thread reactor con il backend io_uring: ad ogni giro sottomette
+ * in un'unica chiamata tutte le operazioni accodate (riattivazioni, buffer restituiti) e
+ * attende i completamenti, le richieste arrivano già lette nei buffer del reactor.
+ * Completa anche le letture e le scritture dei worker sul socket dei client, svegliandoli
+ */
+static void *uring_reactor_thread(void *arg) {
+    reactor_t *reactor = (reactor_t *) arg;
+    struct io_uring_cqe *cqe;
+
+    for (;;) {
+        if (uring_enter(reactor->ring, 1) == -1) {
+            if (errno == EINTR) continue;
+            PRINT_PERROR("io_uring_enter")
+            exit(EXIT_FAILURE);
+        }
+
+        while ((cqe = uring_peekcqe(reactor->ring)) != NULL) {
+            unsigned long type = cqe->user_data & URING_TYPEMASK;
+            int fd = (int) (uint32_t) (cqe->user_data >> 2);
+            int res = cqe->res;
+            int bid = (cqe->flags & IORING_CQE_F_BUFFER) ? (int) (cqe->flags >> IORING_CQE_BUFFER_SHIFT) : -1;
+            uring_cqeseen(reactor->ring);
+
+            if (type == URING_IO) { //operazione di un worker
+
+                uringio_t *io = (uringio_t *) (uintptr_t) (cqe->user_data & ~URING_TYPEMASK);
+                LOCK(&io->mutex)
+                io->res = res;
+                io->done = true;
+                pthread_cond_signal(&io->cond);
+                UNLOCK(&io->mutex)
+                LOCK(&reactor->ring->mutex)
+                reactor->inflight--;
+                bool done = (reactor->stopping && reactor->inflight == 0);
+                UNLOCK(&reactor->ring->mutex)
+                if (done) return NULL;
+
+            } else if (reactor->stopping) { //in chiusura si attendono solo le operazioni dei worker
+                continue;
+
+            } else if (type == URING_CLOSEPIPE) { //client disconnessi
+
+                if (res != sizeof(int)) {
+                    PRINT_ERROR("read closepipe")
+                    exit(EXIT_FAILURE);
+                }
+                if (reactor->closeval == -1) { //terminazione del reactor
+                    if (stopreactor(reactor)) return NULL;
+                    continue;
+                }
+                if (closeclient(reactor, reactor->closeval) == -1) exit(EXIT_FAILURE);
+                if (submitclosepipe(reactor) == -1) exit(EXIT_FAILURE);
+
+            } else if (type == URING_CLIENT) { //client
+
+                if (res > 0) {
+                    if (dispatch(reactor, fd, reactor->buffers + bid * PREFETCH_SIZE, res, bid) == -1) exit(EXIT_FAILURE);
+                } else if (res == -ENOBUFS) {
+                    //buffer esauriti: il worker leggerà la richiesta direttamente dal socket
+                    if (dispatch(reactor, fd, NULL, 0, -1) == -1) exit(EXIT_FAILURE);
+                } else { //EOF o errore sul socket
+                    if (bid >= 0 && providebuffer(reactor, bid) == -1) exit(EXIT_FAILURE);
+                    if (closeclient(reactor, fd) == -1) exit(EXIT_FAILURE);
+                }
+
+            } else if (res < 0) { //restituzione dei buffer fallita
+                errno = -res;
+                PRINT_PERROR("provide buffers")
+            }
+        }
+    }
+    return NULL;
+}
+#endif
+
+/**
+ * @function void *reactor_thread(void *arg)
+ * @brief funzione eseguita dal thread reactor: attende le richieste dei suoi client
+ * e le passa al threadpool, chiude le connessioni segnalate dai worker
+ */
+static void *reactor_thread(void *arg) {
+    reactor_t *reactor = (reactor_t *) arg;
+    struct epoll_event events[MAX_EVENTS];
+    int nready, fd;
+
+    for (;;) {
+        if ((nready = epoll_wait(reactor->epollfd, events, MAX_EVENTS, -1)) == -1) {
+            if (errno == EINTR) continue;
+            PRINT_PERROR("epoll_wait")
+            exit(EXIT_FAILURE);
+        }
+
+        for (int i = 0; i < nready; i++) {
+            fd = events[i].data.fd;
+            if (fd == reactor->closepipe[0]) { //client disconnessi
+
+                int client;
+                CHECK_EQ_EXIT(read(reactor->closepipe[0], &client, sizeof(int)), -1, "read closepipe")
+                if (client == -1) return NULL; //terminazione del reactor
+                if (closeclient(reactor, client) == -1) exit(EXIT_FAILURE);
+
+            } else { //client
+                CHECK_EQ_EXIT(epoll_dispatch(reactor, fd), -1, "dispatch")
+            }
+        }
+    }
+    return NULL;
+}
+
+reactorpool_t *createReactorPool(int nreactors, int maxfd, io_backend_t backend, threadpool_t *tpool, void (*handler)(void *)) {
+    if (nreactors <= 0 || maxfd <= 0 || !tpool || !handler) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    reactorpool_t *pool = calloc(1, sizeof(reactorpool_t));
+    if (pool == NULL) return NULL;
+    pool->tpool = tpool;
+    pool->handler = handler;
+    pool->maxfd = maxfd;
+    pool->backend = EPOLL_BACKEND;
+#if !defined(IO_URING)
+    backend = EPOLL_BACKEND; //supporto io_uring non compilato
+#endif
+    if ((pool->conns = calloc((maxfd + CONN_BLOCK - 1) / CONN_BLOCK, sizeof(connection_t *))) == NULL) {
+        free(pool);
+        return NULL;
+    }
+    if ((pool->reactors = calloc(nreactors, sizeof(reactor_t))) == NULL) {
+        free(pool->conns);
+        free(pool);
+        return NULL;
+    }
+    if (pthread_mutex_init(&pool->mutex, NULL) != 0) {
+        free(pool->reactors);
+        free(pool->conns);
+        free(pool);
+        return NULL;
+    }
+    if (pthread_cond_init(&pool->drained, NULL) != 0) {
+        pthread_mutex_destroy(&pool->mutex);
+        free(pool->reactors);
+        free(pool->conns);
+        free(pool);
+        return NULL;
+    }
+
+    for (int i = 0; i < nreactors; i++) {
+        reactor_t *reactor = &pool->reactors[i];
+        reactor->id = i;
+        reactor->pool = pool;
+        reactor->epollfd = reactor->closepipe[0] = reactor->closepipe[1] = -1;
+        pool->nreactors++;
+
+        if (pipe(reactor->closepipe) == -1) goto error;
+#if defined(IO_URING)
+        if (backend == URING_BACKEND) {
+            if (uring_init(reactor) == 0) {
+                pool->backend = URING_BACKEND;
+            } else if (i > 0) {
+                goto error;
+            } else { //io_uring non disponibile, tutti i reactor useranno epoll
+                uring_destroy(reactor->ring);
+                reactor->ring = NULL;
+                free(reactor->buffers);
+                reactor->buffers = NULL;
+                backend = EPOLL_BACKEND;
+            }
+        }
+#endif
+        if (backend == EPOLL_BACKEND) {
+            if ((reactor->epollfd = epoll_create1(EPOLL_CLOEXEC)) == -1) goto error;
+            if (watch(reactor->epollfd, reactor->closepipe[0], EPOLL_CTL_ADD, EPOLLIN) == -1) goto error;
+        }
+        void *(*thread_fun)(void *) = reactor_thread;
+#if defined(IO_URING)
+        if (backend == URING_BACKEND) thread_fun = uring_reactor_thread;
+#endif
+        if (pthread_create(&reactor->thread, NULL, thread_fun, reactor) != 0) {
+            errno = EFAULT;
+            goto error;
+        }
+        reactor->activated = true;
+    }
+#if defined(IO_URING)
+    //da qui i worker leggono e scrivono sul socket dei client tramite gli anelli dei reactor
+    if (pool->backend == URING_BACKEND) {
+        __atomic_store_n(&uringpool, pool, __ATOMIC_RELEASE);
+        sockio_set(&uringsockio);
+    }
+#endif
+    return pool;
+
+    error: {
+        int errnosv = errno;
+        destroyReactorPool(pool);
+        errno = errnosv;
+        return NULL;
+    }
+}
+
+int addToReactorPool(reactorpool_t *pool, int clientfd, bool remote) {
+    if (!pool || clientfd < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (clientfd >= pool->maxfd) {
+        errno = EMFILE;
+        return -1;
+    }
+
+    LOCK_RETURN(&pool->mutex, -1)
+    connection_t *block = pool->conns[clientfd / CONN_BLOCK];
+    if (block == NULL) {
+        if ((block = calloc(CONN_BLOCK, sizeof(connection_t))) == NULL) {
+            UNLOCK_RETURN(&pool->mutex, -1)
+            return -1;
+        }
+        __atomic_store_n(&pool->conns[clientfd / CONN_BLOCK], block, __ATOMIC_RELEASE);
+    }
+    connection_t *conn = &block[clientfd % CONN_BLOCK];
+    //scelgo il reactor meno carico partendo dal successivo dell'ultimo scelto
+    reactor_t *reactor = &pool->reactors[pool->next];
+    for (int i = 1; i < pool->nreactors; i++) {
+        reactor_t *candidate = &pool->reactors[(pool->next + i) % pool->nreactors];
+        if (candidate->connected < reactor->connected) reactor = candidate;
+    }
+    pool->next = (reactor->id + 1) % pool->nreactors;
+    reactor->connected++;
+    pool->connected++;
+    conn->owner = reactor;
+    conn->username[0] = '\0';
+    conn->stream = 0;
+    conn->remote = remote;
+    conn->compress = 0;
+    UNLOCK_RETURN(&pool->mutex, -1)
+
+    //i client sono registrati in modalità oneshot: dopo ogni notifica il fd viene disattivato
+    //finché il worker non ha servito la richiesta
+    int res;
+#if defined(IO_URING)
+    if (pool->backend == URING_BACKEND)
+        res = submitrecv(reactor, clientfd);
+    else
+#endif
+    res = watch(reactor->epollfd, clientfd, EPOLL_CTL_ADD, EPOLLIN | EPOLLONESHOT);
+    if (res == -1) {
+        int errnosv = errno;
+        LOCK_RETURN(&pool->mutex, -1)
+        reactor->connected--;
+        pool->connected--;
+        UNLOCK_RETURN(&pool->mutex, -1)
+        errno = errnosv;
+        return -1;
+    }
+    return 0;
+}
+
+int rearmClient(reactorpool_t *pool, int clientfd) {
+    connection_t *conn = getconn(pool, clientfd);
+    if (!conn) {
+        errno = EINVAL;
+        return -1;
+    }
+    shmchan_t *chan = shmchan_lookup(clientfd);
+    //in memoria condivisa il client sveglia la connessione dal socket solo dopo che è stata restituita al reactor,
+    //le richieste arrivate prima vanno servite subito
+    if (conn->pending != NULL || (chan && shmchan_park(chan))) {
+        //il client potrebbe non inviare altro finché non riceve le risposte: non aspetto il reactor
+        clienttask_t *task = malloc(sizeof(clienttask_t));
+        if (task == NULL) return -1;
+        task->fd = clientfd;
+        task->prefetch = conn->pending;
+        task->prefetched = conn->npending;
+        task->bid = -1;
+        conn->pending = NULL;
+        conn->npending = 0;
+
+        if (submittask(pool, task) == -1) {
+            free(task->prefetch);
+            free(task);
+            return -1;
+        }
+        return 0;
+    }
+#if defined(IO_URING)
+    if (pool->backend == URING_BACKEND) return submitrecv(conn->owner, clientfd);
+#endif
+    return watch(conn->owner->epollfd, clientfd, EPOLL_CTL_MOD, EPOLLIN | EPOLLONESHOT);
+}
+
+int queueDepth(reactorpool_t *pool) {
+    if (!pool) {
+        errno = EINVAL;
+        return -1;
+    }
+    int pending;
+    if ((pending = countPendingTasks(pool->tpool)) == -1) return -1;
+    return pending + __atomic_load_n(&pool->ndeferred, __ATOMIC_SEQ_CST);
+}
+
+int holdPending(reactorpool_t *pool, int clientfd, const char *data, size_t size) {
+    connection_t *conn = getconn(pool, clientfd);
+    if (!conn || (!data && size > 0)) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (size == 0) return 0;
+
+    char *pending = realloc(conn->pending, conn->npending + size);
+    if (pending == NULL) return -1;
+    memcpy(pending + conn->npending, data, size);
+    conn->pending = pending;
+    conn->npending += size;
+    return 0;
+}
+
+int releaseClient(reactorpool_t *pool, int clientfd) {
+    connection_t *conn = getconn(pool, clientfd);
+    if (!conn) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (write(conn->owner->closepipe[1], &clientfd, sizeof(int)) <= 0) return -1;
+    return 0;
+}
+
+const char *clientName(reactorpool_t *pool, int clientfd) {
+    connection_t *conn = getconn(pool, clientfd);
+    if (!conn) {
+        errno = EINVAL;
+        return NULL;
+    }
+    return conn->username;
+}
+
+int setClientName(reactorpool_t *pool, int clientfd, const char *username) {
+    connection_t *conn = getconn(pool, clientfd);
+    if (!conn || !username) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (strlen(username) >= MAX_USERNAME) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(conn->username, username);
+    return 0;
+}
+
+bool clientRemote(reactorpool_t *pool, int clientfd) {
+    connection_t *conn = getconn(pool, clientfd);
+    if (!conn) {
+        errno = EINVAL;
+        return false;
+    }
+    return conn->remote;
+}
+
+unsigned int clientStream(reactorpool_t *pool, int clientfd) {
+    connection_t *conn = getconn(pool, clientfd);
+    if (!conn) {
+        errno = EINVAL;
+        return 0;
+    }
+    return conn->stream;
+}
+
+int setClientStream(reactorpool_t *pool, int clientfd, unsigned int stream) {
+    connection_t *conn = getconn(pool, clientfd);
+    if (!conn) {
+        errno = EINVAL;
+        return -1;
+    }
+    conn->stream = stream;
+    return 0;
+}
+
+size_t clientCompress(reactorpool_t *pool, int clientfd) {
+    connection_t *conn = getconn(pool, clientfd);
+    if (!conn) {
+        errno = EINVAL;
+        return 0;
+    }
+    return conn->compress;
+}
+
+int setClientCompress(reactorpool_t *pool, int clientfd, size_t minsize) {
+    connection_t *conn = getconn(pool, clientfd);
+    if (!conn) {
+        errno = EINVAL;
+        return -1;
+    }
+    conn->compress = minsize;
+    return 0;
+}
+
+int recycleBuffer(reactorpool_t *pool, clienttask_t *task) {
+    if (!pool || !task) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (task->prefetch == NULL) return 0;
+
+    if (task->bid < 0) free(task->prefetch);
+#if defined(IO_URING)
+    else if (providebuffer(getconn(pool, task->fd)->owner, task->bid) == -1) return -1;
+#endif
+    task->prefetch = NULL;
+    task->prefetched = 0;
+    return 0;
+}
+
+int drainReactorPool(reactorpool_t *pool) {
+    if (!pool) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    LOCK_RETURN(&pool->mutex, -1)
+    while (pool->connected > 0)
+        pthread_cond_wait(&pool->drained, &pool->mutex);
+    UNLOCK_RETURN(&pool->mutex, -1)
+    return 0;
+}
+
+int stopReactorPool(reactorpool_t *pool) {
+    if (!pool) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (pool->stopped) return 0;
+
+    int stop = -1;
+    for (int i = 0; i < pool->nreactors; i++) {
+        reactor_t *reactor = &pool->reactors[i];
+        if (!reactor->activated) continue;
+        if (write(reactor->closepipe[1], &stop, sizeof(int)) <= 0) return -1;
+    }
+    for (int i = 0; i < pool->nreactors; i++) {
+        reactor_t *reactor = &pool->reactors[i];
+        if (!reactor->activated) continue;
+        if (pthread_join(reactor->thread, NULL) != 0) {
+            errno = EFAULT;
+            return -1;
+        }
+        reactor->activated = false;
+    }
+    pool->stopped = true;
+    return 0;
+}
+
+void destroyReactorPool(reactorpool_t *pool) {
+    if (!pool) return;
+
+#if defined(IO_URING)
+    if (__atomic_load_n(&uringpool, __ATOMIC_ACQUIRE) == pool) {
+        sockio_set(NULL);
+        __atomic_store_n(&uringpool, NULL, __ATOMIC_RELEASE);
+    }
+#endif
+    stopReactorPool(pool);
+    for (int i = 0; i < pool->nreactors; i++) {
+        reactor_t *reactor = &pool->reactors[i];
+        if (reactor->epollfd != -1) close(reactor->epollfd);
+        if (reactor->closepipe[0] != -1) close(reactor->closepipe[0]);
+        if (reactor->closepipe[1] != -1) close(reactor->closepipe[1]);
+#if defined(IO_URING)
+        if (reactor->ring) uring_destroy(reactor->ring);
+        if (reactor->buffers) free(reactor->buffers);
+#endif
+    }
+    //solo i blocchi in cui sono caduti dei client sono stati allocati
+    for (int b = 0; b < (pool->maxfd + CONN_BLOCK - 1) / CONN_BLOCK; b++) {
+        if (!pool->conns[b]) continue;
+        for (int i = 0; i < CONN_BLOCK; i++) free(pool->conns[b][i].pending);
+        free(pool->conns[b]);
+    }
+    //richieste rimaste sospese, i buffer dei reactor sono già stati liberati
+    for (int c = 0; c < TASK_CLASSES; c++) {
+        while (pool->deferred[c]) {
+            clienttask_t *task = pool->deferred[c];
+            pool->deferred[c] = task->next;
+            if (task->bid < 0) free(task->prefetch);
+            free(task);
+        }
+    }
+    pthread_cond_destroy(&pool->drained);
+    pthread_mutex_destroy(&pool->mutex);
+    free(pool->reactors);
+    free(pool->conns);
+    free(pool);
+}
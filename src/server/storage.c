@@ -1,10 +1,19 @@
+#define _GNU_SOURCE //memfd_create e sigilli
 #include <stdlib.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include <storage.h>
 #include <protocol.h>
 
 int select_victims(int op, storage_t *storage, file_t *file, size_t file_size, list_t *filesEjected);
 int eject_victims(storage_t *storage, list_t *filesEjected);
+static int detach_file(storage_t *storage, file_t *file);
+static int expire_file(storage_t *storage, file_t *file);
+static int set_expiration(storage_t *storage, char *filename, long ttl, unsigned long *expiration);
+static int seal_content(file_t *file);
+static void free_content(file_t *file);
 
 storage_t *fs_init(int max_files, size_t max_capacity, int replace_mode) {
 
@@ -23,6 +32,9 @@ storage_t *fs_init(int max_files, size_t max_capacity, int replace_mode) {
     storage->max_files_number = 0;
     storage->max_occupied_memory = 0;
     storage->times_replacement_algorithm = 0;
+    storage->times_expired = 0;
+    storage->expirations = NULL;
+    storage->files_expired = NULL;
     storage->mutex = malloc(sizeof(pthread_rwlock_t));
     if (pthread_rwlock_init(storage->mutex, NULL) != 0) {
         free(storage->mutex);
@@ -47,6 +59,17 @@ storage_t *fs_init(int max_files, size_t max_capacity, int replace_mode) {
         return NULL;
     }
 
+    storage->expirations = tw_create(TTL_TICK_MSEC);
+    if (storage->expirations == NULL) {
+        fs_destroy(storage);
+        return NULL;
+    }
+    storage->files_expired = list_init();
+    if (storage->files_expired == NULL) {
+        fs_destroy(storage);
+        return NULL;
+    }
+
     return storage;
 }
 
@@ -70,6 +93,14 @@ void fs_destroy(storage_t *storage) {
         list_destroy(storage->clients_awaiting, (void (*)(void *)) destroymsg);
         storage->clients_awaiting = NULL;
     }
+    if (storage->expirations != NULL) {
+        tw_destroy(storage->expirations, free);
+        storage->expirations = NULL;
+    }
+    if (storage->files_expired != NULL) {
+        list_destroy(storage->files_expired, (void (*)(void *)) fs_filedestroy);
+        storage->files_expired = NULL;
+    }
     if (pthread_rwlock_unlock(storage->mutex) != 0) return;
     if (pthread_rwlock_destroy(storage->mutex) != 0) return;
     free(storage->mutex);
@@ -81,11 +112,11 @@ void fs_destroy(storage_t *storage) {
 //I file vuoti appena inseriti non causano nè subiscono espulsione
 //poiché sono visti come file di peso pari a 0.
 //L'espulsione avviene solo al momento della scrittura.
-int fs_openFile(storage_t *storage, char *filename, int flags, char *client) {
+int fs_openFile(storage_t *storage, char *filename, int flags, char *client, long ttl) {
 
     if (!storage || !filename || !client)
         return EINVAL;
-    if (flags < 0 || flags > 3)
+    if (flags < 0 || flags > 3 || ttl < 0)
         return EINVAL;
 
     int returnc;
@@ -133,6 +164,14 @@ int fs_openFile(storage_t *storage, char *filename, int flags, char *client) {
             returnc = ECANCELED;
             goto error;
         }
+        //Se è stato indicato un tempo di vita registro la scadenza del file
+        if (ttl > 0 && (returnc = set_expiration(storage, filename, ttl, &newfile->expiration)) != EXIT_SUCCESS) {
+            if (pthread_rwlock_unlock(storage->mutex) != 0) {
+                returnc = ENOTRECOVERABLE;
+                goto error;
+            }
+            goto error;
+        }
         //Lo aggiungo
         char *filename_key = NULL;
         if ((filename_key = strndup(filename, strlen(filename))) == NULL)
@@ -232,8 +271,13 @@ int fs_openFile(storage_t *storage, char *filename, int flags, char *client) {
 }
 
 int fs_readFile(storage_t *storage, char *filename, char *client, void **buf, size_t *bytes_read) {
+    return fs_readFileChunk(storage, filename, client, 0, SIZE_MAX, buf, bytes_read, NULL);
+}
+
+int fs_readFileChunk(storage_t *storage, char *filename, char *client, size_t offset, size_t maxsize,
+                     void **buf, size_t *bytes_read, size_t *file_size) {
 
-    if (!storage || !filename || !bytes_read || !client)
+    if (!storage || !filename || !bytes_read || !client || maxsize == 0)
         return EINVAL;
 
     int returnc;
@@ -292,8 +336,20 @@ int fs_readFile(storage_t *storage, char *filename, char *client, void **buf, si
         returnc = ENODATA;
         goto error;
     }
-    //Memorizzo il contenuto del file nel buffer e restituisco la quantità di bytes
-    *buf = malloc(toRead->size);
+    //Memorizzo la porzione richiesta del contenuto nel buffer e restituisco la quantità di bytes
+    size_t toCopy = offset < toRead->size ? toRead->size - offset : 0;
+    if (toCopy > maxsize) toCopy = maxsize;
+    if (file_size) *file_size = toRead->size;
+    if (toCopy == 0) {
+        *buf = NULL;
+        if (pthread_rwlock_unlock(toRead->mutex) != 0) {
+            returnc = ENOTRECOVERABLE;
+            goto error;
+        }
+        return EXIT_SUCCESS;
+    }
+    //i chunk vengono spediti e liberati subito dal worker, il buffer viene riutilizzato (vedi msgpool.h)
+    *buf = pool_alloc(toCopy);
     if (*buf == NULL) {
         if (pthread_rwlock_unlock(toRead->mutex) != 0) {
             returnc = ENOTRECOVERABLE;
@@ -302,8 +358,8 @@ int fs_readFile(storage_t *storage, char *filename, char *client, void **buf, si
         returnc = ECANCELED;
         goto error;
     }
-    memcpy(*buf, toRead->content, toRead->size);
-    *bytes_read = toRead->size;
+    memcpy(*buf, (unsigned char *) toRead->content + offset, toCopy);
+    *bytes_read = toCopy;
     if (pthread_rwlock_unlock(toRead->mutex) != 0) {
         returnc = ENOTRECOVERABLE;
         goto error;
@@ -408,14 +464,60 @@ int fs_readNFiles(storage_t *storage, char *client, int N, list_t *files_to_send
     return returnc;
 }
 
-int fs_writeFile(storage_t *storage, char *filename, size_t file_size, void *file_content, char *client,
-                 list_t *filesEjected) {
+int fs_shareFile(storage_t *storage, char *filename, char *client, int *fd, size_t *size) {
 
-    if (!storage || !filename || !file_content || file_size <= 0 || !filesEjected || !client)
+    if (!storage || !filename || !client || !fd || !size)
+        return EINVAL;
+
+    int returnc;
+    *fd = -1;
+    *size = 0;
+
+    if (pthread_rwlock_rdlock(storage->mutex) != 0)
+        return ENOTRECOVERABLE;
+    file_t *toShare;
+    if ((toShare = icl_hash_find(storage->files, filename)) == NULL) {
+        if (pthread_rwlock_unlock(storage->mutex) != 0) return ENOTRECOVERABLE;
+        return ENOENT;
+    }
+    //lock in scrittura sul file perché il contenuto potrebbe essere spostato nel memfd
+    if (pthread_rwlock_wrlock(toShare->mutex) != 0) return ENOTRECOVERABLE;
+    if (pthread_rwlock_unlock(storage->mutex) != 0) return ENOTRECOVERABLE;
+
+    //stessi permessi della lettura
+    if (list_get(toShare->who_opened, client, (int (*)(void *, void *)) strcmp) == NULL)
+        returnc = EPERM;
+    else if (toShare->client_locker != NULL && strcmp(toShare->client_locker, client) != 0)
+        returnc = EACCES;
+    else if (toShare->size == 0)
+        returnc = ENODATA;
+    else if (toShare->size < MEMFD_MIN_SIZE)
+        returnc = EXIT_SUCCESS; //file piccolo, conviene spedirlo inline
+    else if (toShare->memfd == -1 && seal_content(toShare) == -1)
+        returnc = ECANCELED;
+    else if ((*fd = fcntl(toShare->memfd, F_DUPFD_CLOEXEC, 0)) == -1)
+        returnc = ECANCELED;
+    else
+        returnc = EXIT_SUCCESS;
+    *size = toShare->size;
+
+    if (pthread_rwlock_unlock(toShare->mutex) != 0) {
+        if (*fd != -1) close(*fd);
+        *fd = -1;
+        return ENOTRECOVERABLE;
+    }
+    return returnc;
+}
+
+int fs_writeFile(storage_t *storage, char *filename, size_t file_size, void **file_content, int *memfd, char *client,
+                 long ttl, list_t *filesEjected) {
+
+    if (!storage || !filename || !file_content || !*file_content || file_size <= 0 || !filesEjected || !client || ttl < 0)
         return EINVAL;
 
     int returnc;
     char *toWrite_filename = NULL;
+    unsigned long expiration = 0;
 
     //Devo controllare che il file esista e che sia aperto e locked dal client
     //Tutto in modalità scrittore perché poi potrei modificare la struttura dati
@@ -492,6 +594,19 @@ int fs_writeFile(storage_t *storage, char *filename, size_t file_size, void *fil
         returnc = EACCES;
         goto error;
     }
+    //Se è stato indicato un tempo di vita registro la nuova scadenza, verrà assegnata al file
+    //solo a scrittura completata (un timer rimasto orfano viene ignorato alla scadenza)
+    if (ttl > 0 && (returnc = set_expiration(storage, filename, ttl, &expiration)) != EXIT_SUCCESS) {
+        if (pthread_rwlock_unlock(toWrite->mutex) != 0) {
+            returnc = ENOTRECOVERABLE;
+            goto error;
+        }
+        if (pthread_rwlock_unlock(storage->mutex) != 0) {
+            returnc = ENOTRECOVERABLE;
+            goto error;
+        }
+        goto error;
+    }
 
     //Rimpiazzamento file
     //Se aumentando di 1 il numero di file e aggiungendo la dimensione del file rimango nei limiti
@@ -510,16 +625,16 @@ int fs_writeFile(storage_t *storage, char *filename, size_t file_size, void *fil
             goto error;
         }
     }
-    //allochiamo lo spazio necessario per il contenuto del file
-    if ((toWrite->content = malloc(file_size)) == NULL) {
-        //inconsistenza perchè a questo punto abbiamo già espulso gli eventuali file per fare spazio al contenuto da
-        //scrivere, quindi ci troveremo senza file scritto e con i file già espulsi
-        returnc = ENOTRECOVERABLE;
-        goto error;
+    //A questo punto c'è sufficiente spazio per ospitare il file: il buffer in cui è stato ricevuto
+    //il contenuto diventa quello del file, senza copiarlo
+    toWrite->content = *file_content;
+    *file_content = NULL;
+    if (memfd && *memfd != -1) {
+        toWrite->memfd = *memfd;
+        *memfd = -1;
     }
-    //A questo punto c'è sufficiente spazio per ospitare il file e quindi lo scrivo nella cache
-    memcpy(toWrite->content, file_content, file_size);
     toWrite->size = file_size;
+    if (expiration != 0) toWrite->expiration = expiration;
     //aggiungo il nome del file alla coda
     if ((toWrite_filename = strndup(filename, strlen(filename))) == NULL)
         return ECANCELED;
@@ -553,9 +668,120 @@ int fs_writeFile(storage_t *storage, char *filename, size_t file_size, void *fil
     return returnc;
 }
 
-int fs_appendToFile(storage_t *storage, char *filename, size_t size, void *data, char *client, list_t *filesEjected) {
+int fs_putFile(storage_t *storage, char *filename, size_t file_size, void **file_content, int *memfd, char *client,
+               long ttl, int flags, list_t *filesEjected) {
 
-    if (!storage || !filename || size <= 0 || !data || !filesEjected || !client)
+    if (!storage || !filename || !file_content || (file_size > 0 && !*file_content) || !filesEjected || !client || ttl < 0)
+        return EINVAL;
+    if (file_size > storage->memory_limit)
+        return EFBIG;
+
+    int returnc;
+    file_t *newfile = NULL;
+    char *filename_key = NULL;
+    char *newfile_filename = NULL;
+    unsigned long expiration = 0;
+
+    //Tutta l'operazione avviene in modalità scrittore sullo storage: il file diventa visibile solo quando è completo,
+    //per questo non serve prenderne la lock né registrarlo tra quelli aperti dal client (alla fine sarebbe chiuso)
+    if (pthread_rwlock_wrlock(storage->mutex) != 0)
+        return ENOTRECOVERABLE;
+    if (icl_hash_find(storage->files, (void *) filename) != NULL) {
+        returnc = EEXIST;
+        goto error;
+    }
+    if ((newfile = fs_filecreate(filename, 0, NULL, O_CREATE | (flags & O_LOCK), client)) == NULL
+        || (filename_key = strndup(filename, strlen(filename))) == NULL
+        || (newfile_filename = strndup(filename, strlen(filename))) == NULL) {
+        returnc = ECANCELED;
+        goto error;
+    }
+    if (ttl > 0 && (returnc = set_expiration(storage, filename, ttl, &expiration)) != EXIT_SUCCESS)
+        goto error;
+
+    //Rimpiazzamento file, come in fs_writeFile
+    if (file_size > 0
+        && (storage->files_number + 1 > storage->files_limit || storage->occupied_memory + file_size > storage->memory_limit)) {
+        if ((returnc = select_victims(WRITE, storage, newfile, file_size, filesEjected)) != EXIT_SUCCESS
+            || (returnc = eject_victims(storage, filesEjected)) != EXIT_SUCCESS)
+            goto error;
+    }
+    //il contenuto viene adottato senza copiarlo
+    newfile->expiration = expiration;
+    if (file_size > 0) {
+        newfile->content = *file_content;
+        *file_content = NULL;
+        if (memfd && *memfd != -1) {
+            newfile->memfd = *memfd;
+            *memfd = -1;
+        }
+        newfile->size = file_size;
+    }
+    if (icl_hash_insert(storage->files, (void *) filename_key, (void *) newfile) == NULL) {
+        //i file espulsi sono già stati rimossi, lo storage non è più consistente con quanto richiesto
+        returnc = ENOTRECOVERABLE;
+        goto error;
+    }
+    filename_key = NULL;
+    newfile = NULL;
+    //un file vuoto, come uno aperto e non ancora scritto, non entra nella coda né nel conteggio
+    if (file_size > 0) {
+        if (list_add(storage->filenames_queue, newfile_filename) == NULL) {
+            returnc = ENOTRECOVERABLE;
+            goto error;
+        }
+        newfile_filename = NULL;
+        storage->occupied_memory += file_size;
+        storage->files_number++;
+
+        //aggiorno le stats
+        if (storage->occupied_memory > storage->max_occupied_memory)
+            storage->max_occupied_memory = storage->occupied_memory;
+        if (storage->files_number > storage->max_files_number)
+            storage->max_files_number = storage->files_number;
+    }
+    if (newfile_filename) free(newfile_filename);
+
+    if (pthread_rwlock_unlock(storage->mutex) != 0)
+        return ENOTRECOVERABLE;
+    return EXIT_SUCCESS;
+
+    error:
+    if (pthread_rwlock_unlock(storage->mutex) != 0)
+        returnc = ENOTRECOVERABLE;
+    if (filename_key) free(filename_key);
+    if (newfile_filename) free(newfile_filename);
+    if (newfile) fs_filedestroy(newfile);
+    return returnc;
+}
+
+int fs_mapMemfd(int memfd, size_t size, void **content) {
+
+    if (memfd < 0 || size == 0 || !content)
+        return EINVAL;
+
+    //senza questi sigilli il client potrebbe ancora modificare o accorciare il contenuto adottato
+    int seals;
+    struct stat st;
+    if ((seals = fcntl(memfd, F_GET_SEALS)) == -1)
+        return EINVAL;
+    if ((seals & (F_SEAL_WRITE | F_SEAL_SHRINK | F_SEAL_GROW)) != (F_SEAL_WRITE | F_SEAL_SHRINK | F_SEAL_GROW))
+        return EPERM;
+    if (fstat(memfd, &st) == -1)
+        return ECANCELED;
+    if ((size_t) st.st_size != size)
+        return EINVAL;
+
+    void *map;
+    if ((map = mmap(NULL, size, PROT_READ, MAP_SHARED, memfd, 0)) == MAP_FAILED)
+        return ECANCELED;
+    *content = map;
+    return EXIT_SUCCESS;
+}
+
+int fs_appendToFile(storage_t *storage, char *filename, size_t size, void **data, char *client, list_t *filesEjected) {
+
+    if (!storage || !filename || size <= 0 || !data || !*data || !filesEjected || !client)
         return EINVAL;
 
     int returnc;
@@ -639,14 +865,34 @@ int fs_appendToFile(storage_t *storage, char *filename, size_t size, void *data,
         }
     }
 
-    //A questo punto c'è sufficiente spazio per ospitare i nuovi dati e quindi faccio la append
-    if ((toAppend->content = realloc(toAppend->content, toAppend->size + size)) == NULL) {
-        //inconsistenza perchè ci ritroviamo con una append impossibile da completare
-        //e gli eventuali file espulsi per fare spazio al nuovo contenuto del file
-        returnc = ENOTRECOVERABLE;
-        goto error;
+    //A questo punto c'è sufficiente spazio per ospitare i nuovi dati e quindi faccio la append,
+    //se il file è vuoto adotto direttamente il buffer ricevuto
+    if (toAppend->size == 0) {
+        free(toAppend->content);
+        toAppend->content = *data;
+        *data = NULL;
+    } else if (toAppend->memfd != -1) {
+        //il contenuto sigillato non può crescere, torna nello heap (chi lo ha già ricevuto conserva la versione precedente)
+        void *content;
+        if ((content = malloc(toAppend->size + size)) == NULL) {
+            returnc = ENOTRECOVERABLE;
+            goto error;
+        }
+        memcpy(content, toAppend->content, toAppend->size);
+        free_content(toAppend);
+        toAppend->content = content;
+        memcpy((unsigned char *) toAppend->content + toAppend->size, *data, size);
+    } else {
+        void *content;
+        if ((content = realloc(toAppend->content, toAppend->size + size)) == NULL) {
+            //inconsistenza perchè ci ritroviamo con una append impossibile da completare
+            //e gli eventuali file espulsi per fare spazio al nuovo contenuto del file
+            returnc = ENOTRECOVERABLE;
+            goto error;
+        }
+        toAppend->content = content;
+        memcpy((unsigned char *) toAppend->content + toAppend->size, *data, size);
     }
-    memcpy((unsigned char *) toAppend->content + toAppend->size, data, size);
     toAppend->size = toAppend->size + size;
 
     //modifico variabili dello storage
@@ -944,6 +1190,8 @@ file_t *fs_filecreate(char *filename, unsigned int size, void *content, int flag
 
     file->filename = strndup(filename, strlen(filename));
     file->size = size;
+    file->content = NULL;
+    file->memfd = -1;
     file->who_opened = list_init();
 
     file->mutex = malloc(sizeof(pthread_rwlock_t));
@@ -957,6 +1205,7 @@ file_t *fs_filecreate(char *filename, unsigned int size, void *content, int flag
         return NULL;
     }
 
+    file->expiration = 0;
     file->content = NULL;
     if (size > 0) {
         file->content = malloc(size);
@@ -981,7 +1230,7 @@ void fs_filedestroy(file_t *file) {
     if (!file) return;
     if (file->filename) free(file->filename);
     if (file->client_locker) free(file->client_locker);
-    if (file->content) free((file->content));
+    free_content(file);
     if (file->who_opened) list_destroy(file->who_opened, free);
     if (file->mutex) {
         pthread_rwlock_destroy(file->mutex);
@@ -1001,6 +1250,7 @@ void fs_stats(storage_t *storage) {
     printf("    MAX FILES REACHED: %d\n", storage->max_files_number);
     printf("    MAX OCCUPIED CAPACITY REACHED: %f MB\n", ((double) storage->max_occupied_memory) / 1000000);
     printf("    REPLACEMENT ALGORITM EXECUTED: %d TIMES\n", storage->times_replacement_algorithm);
+    printf("    FILES EXPIRED: %d\n", storage->times_expired);
     printf("    FILES CURRENTLY STORED: %d\n", storage->files_number);
     list_tostring(storage->filenames_queue);
 }
@@ -1011,25 +1261,40 @@ int select_victims(int op, storage_t *storage, file_t *file, size_t file_size, l
     if (file_size > storage->memory_limit)
         return EINVAL;
 
+    int returnc;
     file_t *toEject_copy = NULL;
     int curr_files_number = storage->files_number;
     size_t curr_occupied_memory = storage->occupied_memory;
-    elem_t *possible_victim;
-    for ( possible_victim = list_gethead(storage->filenames_queue)
-        ; (op == WRITE && curr_files_number + 1 > storage->files_limit) || (curr_occupied_memory + file_size > storage->memory_limit)
-        ; possible_victim = list_getnext(storage->filenames_queue, possible_victim) ) {
+    unsigned long now = tw_now(storage->expirations);
+    elem_t *possible_victim = list_gethead(storage->filenames_queue);
+    elem_t *next_victim;
+    while ((op == WRITE && curr_files_number + 1 > storage->files_limit) || (curr_occupied_memory + file_size > storage->memory_limit)) {
 
         if (possible_victim == NULL) {
             //se siamo arrivati qui avevamo bisogno di liberare spazio, ma non abbiamo file da espellere -> inconsistenza
             return ENOTRECOVERABLE;
         }
-        if (op == APPEND && strcmp(possible_victim->data, file->filename) == 0) continue;
+        //mi salvo il successivo perché un file scaduto viene tolto subito dalla lista
+        next_victim = possible_victim->next;
+        if (op == APPEND && strcmp(possible_victim->data, file->filename) == 0) {
+            possible_victim = next_victim;
+            continue;
+        }
         //non c'è abbastanza spazio e devo liberare dei file
         //prendo il nome del primo file da eliminare (FIFO)
         //Vado a cercarlo nello storage
         file_t *toEject = icl_hash_find(storage->files, possible_victim->data);
         //presente nella lista ma non nello storage -> inconsistenza
         if (toEject == NULL) return ENOTRECOVERABLE;
+        //Un file scaduto non viene restituito come vittima: lo rimuovo direttamente
+        if (toEject->expiration != 0 && toEject->expiration <= now) {
+            size_t expired_size = toEject->size;
+            if ((returnc = expire_file(storage, toEject)) != EXIT_SUCCESS) return returnc;
+            curr_files_number--;
+            curr_occupied_memory -= expired_size;
+            possible_victim = next_victim;
+            continue;
+        }
         if (pthread_rwlock_rdlock(toEject->mutex) != 0) return ENOTRECOVERABLE;
         if ((toEject_copy = fs_filecreate(toEject->filename, toEject->size, toEject->content, O_CREATE, NULL)) == NULL) {
             if (pthread_rwlock_unlock(toEject->mutex) != 0) return ENOTRECOVERABLE;
@@ -1046,8 +1311,8 @@ int select_victims(int op, storage_t *storage, file_t *file, size_t file_size, l
         }
         curr_files_number--;
         curr_occupied_memory -= toEject_copy->size;
+        possible_victim = next_victim;
     }
-    possible_victim = NULL;
     return EXIT_SUCCESS;
 }
 
@@ -1055,37 +1320,164 @@ int eject_victims(storage_t *storage, list_t *filesEjected){
     if (!storage || !filesEjected)
         return EINVAL;
 
+    int returnc;
     elem_t *toEject_file_elem = list_gethead(filesEjected);
-    elem_t *victim = NULL;
     while (toEject_file_elem != NULL) {
 
         file_t *toEject_file = (file_t *) toEject_file_elem->data;
-        victim = list_remove(storage->filenames_queue, toEject_file->filename, (int (*)(void *, void *)) strcmp);
-        //presente nella lista da espellere ma non nella lista dello storage -> inconsistenza
-        if (victim == NULL) return ENOTRECOVERABLE;
-
         //Prendo il riferimento nello storage
-        file_t *toEject = icl_hash_find(storage->files, victim->data);
-        //presente nella lista dello storage ma non nella cache dello storage -> inconsistenza
+        file_t *toEject = icl_hash_find(storage->files, toEject_file->filename);
+        //presente nella lista da espellere ma non nella cache dello storage -> inconsistenza
         if (toEject == NULL) return ENOTRECOVERABLE;
 
-        if (pthread_rwlock_wrlock(toEject->mutex) != 0) return ENOTRECOVERABLE;
         //Lo elimino dallo storage
-        if (icl_hash_delete(storage->files, toEject->filename, free, NULL) != 0)
-            return ENOTRECOVERABLE;
-        if (pthread_rwlock_unlock(toEject->mutex) != 0) return ENOTRECOVERABLE;
+        if ((returnc = detach_file(storage, toEject)) != EXIT_SUCCESS) return returnc;
+        storage->times_replacement_algorithm++;
 
-        //Modifico lo storage in seguito all'eliminazione
-        storage->occupied_memory -= toEject->size;
+        toEject_file_elem = list_getnext(filesEjected, toEject_file_elem);
+    }
+    return EXIT_SUCCESS;
+}
+
+int fs_expireFiles(storage_t *storage, list_t *filesExpired) {
+    if (!storage || !filesExpired)
+        return EINVAL;
+
+    int returnc = EXIT_SUCCESS;
+    list_t *timers = NULL;
+    elem_t *elem = NULL;
+    if ((timers = list_init()) == NULL) return ECANCELED;
+    if (tw_advance(storage->expirations, timers) == -1) {
+        returnc = ECANCELED;
+        goto cleanup;
+    }
+    //lettura senza lock dei file già scaduti: un file aggiunto nel frattempo viene
+    //notificato al tick successivo, così non blocco lo storage se non c'è niente da fare
+    if (timers->length == 0 && storage->files_expired->length == 0)
+        goto cleanup;
+
+    if (pthread_rwlock_wrlock(storage->mutex) != 0) {
+        returnc = ENOTRECOVERABLE;
+        goto cleanup;
+    }
+    while ((elem = list_removehead(timers)) != NULL) {
+        tw_timer_t *timer = elem->data;
+        //il timer è valido solo se il file esiste ancora con la stessa scadenza,
+        //altrimenti il file è stato rimosso, espulso o ha ricevuto una nuova scadenza
+        file_t *toExpire = icl_hash_find(storage->files, timer->data);
+        if (toExpire != NULL && toExpire->expiration == timer->expire)
+            returnc = expire_file(storage, toExpire);
+        free(timer->data);
+        free(timer);
+        free(elem);
+        if (returnc != EXIT_SUCCESS) break;
+    }
+    //passo al chiamante tutti i file scaduti rimossi, compresi quelli recuperati durante le scritture
+    while (returnc == EXIT_SUCCESS && (elem = list_removehead(storage->files_expired)) != NULL) {
+        if (list_add(filesExpired, elem->data) == NULL) {
+            list_addhead(storage->files_expired, elem->data);
+            returnc = ECANCELED;
+        }
+        free(elem);
+    }
+    if (pthread_rwlock_unlock(storage->mutex) != 0)
+        returnc = ENOTRECOVERABLE;
+
+    cleanup:
+    while ((elem = list_removehead(timers)) != NULL) {
+        tw_timer_t *timer = elem->data;
+        free(timer->data);
+        free(timer);
+        free(elem);
+    }
+    list_destroy(timers, free);
+    return returnc;
+}
+
+//Rimuove il file dallo storage aggiornando memoria occupata e numero di file,
+//va chiamata con la write lock sullo storage acquisita
+static int detach_file(storage_t *storage, file_t *file) {
+
+    //solo i file con contenuto sono in coda e contano per i limiti dello storage
+    if (file->size > 0) {
+        elem_t *queued = list_remove(storage->filenames_queue, file->filename, (int (*)(void *, void *)) strcmp);
+        //presente nello storage ma non nella lista -> inconsistenza
+        if (queued == NULL) return ENOTRECOVERABLE;
+        free(queued->data);
+        free(queued);
+        storage->occupied_memory -= file->size;
         storage->files_number--;
-        storage->times_replacement_algorithm++;
+    }
 
-        fs_filedestroy(toEject);
-        free(victim->data);
-        free(victim);
+    if (pthread_rwlock_wrlock(file->mutex) != 0) return ENOTRECOVERABLE;
+    if (icl_hash_delete(storage->files, file->filename, free, NULL) != 0)
+        return ENOTRECOVERABLE;
+    if (pthread_rwlock_unlock(file->mutex) != 0) return ENOTRECOVERABLE;
 
-        toEject_file_elem = list_getnext(filesEjected, toEject_file_elem);
+    fs_filedestroy(file);
+    return EXIT_SUCCESS;
+}
+
+//Rimuove un file scaduto memorizzandone nome e dimensione tra i file da notificare,
+//va chiamata con la write lock sullo storage acquisita
+static int expire_file(storage_t *storage, file_t *file) {
+
+    file_t *expired = NULL;
+    if ((expired = fs_filecreate(file->filename, 0, NULL, O_CREATE, NULL)) == NULL)
+        return ECANCELED;
+    expired->size = file->size;
+    if (list_add(storage->files_expired, expired) == NULL) {
+        fs_filedestroy(expired);
+        return ECANCELED;
     }
+
+    int returnc;
+    if ((returnc = detach_file(storage, file)) != EXIT_SUCCESS) return returnc;
+    storage->times_expired++;
     return EXIT_SUCCESS;
 }
 
+//Registra una scadenza per il file sulla ruota dei timer dello storage
+static int set_expiration(storage_t *storage, char *filename, long ttl, unsigned long *expiration) {
+
+    char *key = NULL;
+    if ((key = strndup(filename, strlen(filename))) == NULL)
+        return ECANCELED;
+    if (tw_add(storage->expirations, ttl, key, expiration) == -1) {
+        free(key);
+        return ECANCELED;
+    }
+    return EXIT_SUCCESS;
+}
+
+//sposta il contenuto del file in un memfd sigillato e lo mappa in sola lettura al posto del buffer nello heap
+static int seal_content(file_t *file) {
+    int memfd;
+    if ((memfd = memfd_create(file->filename, MFD_CLOEXEC | MFD_ALLOW_SEALING)) == -1) return -1;
+    void *map = MAP_FAILED;
+    if (writen(memfd, file->content, file->size) != 1) goto error;
+    //senza più scritture possibili i client possono mapparlo senza temere modifiche
+    if (fcntl(memfd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) == -1) goto error;
+    if ((map = mmap(NULL, file->size, PROT_READ, MAP_SHARED, memfd, 0)) == MAP_FAILED) goto error;
+
+    free(file->content);
+    file->content = map;
+    file->memfd = memfd;
+    return 0;
+
+    error: {
+        int errnosv = errno;
+        close(memfd);
+        errno = errnosv;
+        return -1;
+    }
+}
+
+static void free_content(file_t *file) {
+    if (file->memfd != -1) {
+        munmap(file->content, file->size);
+        close(file->memfd);
+        file->memfd = -1;
+    } else free(file->content);
+    file->content = NULL;
+}
@@ -3,44 +3,130 @@
  * @brief File di implementazione dell'interfaccia Threadpool
  */
 
+#define _DEFAULT_SOURCE //syscall
 #include <stdio.h>
 #include <assert.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include <pthread.h>
 #include <unistd.h>
 #include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
 
 #include <util.h>
 #include <threadpool.h>
 
+#define WS_CACHELINE 64
+#define WS_BATCH 16 // task presi al massimo in una volta dalla coda globale
+
 /**
- * @function void *threadpool_thread(void *threadpool)
- * @brief funzione eseguita dal thread worker che appartiene al pool
+ *  @struct wsdeque_t
+ *  @brief deque di Chase-Lev di un worker: il proprietario inserisce e preleva in fondo (bottom) senza lock,
+ *  gli altri worker rubano dalla cima (top) con una CAS. I task in attesa sono al massimo queue_size, quindi
+ *  l'array circolare, di dimensione potenza di 2 non minore, non deve mai crescere.
+ *  top e bottom stanno su cache line diverse, come deque consecutive nell'array del pool
  */
-static void *workerpool_thread(void *threadpool) {    
-    threadpool_t *pool = (threadpool_t *)threadpool; // cast
-    taskfun_t task;  // generic task
-    pthread_t self = pthread_self();
-    int myid = -1;
+typedef struct wsdeque_ {
+    long top;
+    char pad1[WS_CACHELINE - sizeof(long)];
+    long bottom;
+    unsigned int seed;        // stato del generatore con cui il proprietario sceglie a chi rubare
+    char pad2[WS_CACHELINE - sizeof(long) - sizeof(unsigned int)];
+    taskfun_t *tasks;
+    long mask;
+    threadpool_t *pool;
+    char pad3[WS_CACHELINE];
+} wsdeque_t;
 
-    // non efficiente, si puo' fare meglio.....
-    do {
-	for (int i=0;i<pool->numthreads;++i)
-	    if (pthread_equal(pool->threads[i], self)) {
-		myid = i;
-		break;
-	    }
-    } while (myid < 0);
+typedef struct mpmccell_ {
+    unsigned long seq;        // posizione per cui la cella e' pronta: pos se libera, pos + 1 se contiene il task
+    taskfun_t task;
+} mpmccell_t;
+
+/**
+ *  @struct mpmcring_t
+ *  @brief anello di task limitato a piu' produttori e piu' consumatori, senza lock. Le posizioni di inserimento
+ *  e prelievo crescono sempre, la cella e' quella di indice posizione modulo size. Ogni contatore sta su una
+ *  cache line propria, come l'eventcount su cui dormono i worker
+ */
+typedef struct mpmcring_ {
+    unsigned long enqueue;
+    char pad1[WS_CACHELINE - sizeof(unsigned long)];
+    unsigned long dequeue;
+    char pad2[WS_CACHELINE - sizeof(unsigned long)];
+    uint32_t epoch;           // eventcount: incrementato ad ogni risveglio, e' il futex su cui si dorme
+    int sleepers;             // worker addormentati o in procinto di addormentarsi
+    char pad3[WS_CACHELINE - sizeof(uint32_t) - sizeof(int)];
+    mpmccell_t *cells;
+    unsigned long size;
+} mpmcring_t;
+
+/**
+ *  @struct elastic_t
+ *  @brief stato di un pool elastico, protetto da pool->lock. I worker aggiunti sono detached e vengono contati
+ *  in extra, quelli creati con il pool restano nell'array threads
+ */
+typedef struct elastic_ {
+    pthread_t monitor;        // thread che aggiunge e ritira i worker
+    int waitmsec;
+    int idlemsec;
+    long *enqueued;           // istante di inserimento (ms) di ogni task della coda
+    int extra;                // worker aggiunti ancora attivi
+    int retiring;             // worker aggiunti che devono ritirarsi appena restano senza lavoro
+    int busypeak;             // massimo di task in esecuzione contemporaneamente dall'inizio della finestra
+    long windowstart;         // inizio della finestra su cui si valuta l'inattivita'
+    long samplestart;         // inizio e valore del campione in corso
+    int samplemax;
+    poolstats_t stats;
+} elastic_t;
+
+#define ELASTIC_TICK_MSEC 10 // intervallo dei controlli sul carico del pool elastico
+
+typedef struct classqueue_ {
+    taskfun_t *tasks;         // coda circolare di queue_size task
+    int head, count;
+    int credit;               // task che la classe puo' ancora far partire nel turno corrente
+    int running;              // task della classe in esecuzione
+} classqueue_t;
+
+static int stealingAdd(threadpool_t *pool, void (*f)(void *), void *arg);
+static int lockfreeAdd(threadpool_t *pool, void (*f)(void *), void *arg);
+static int priorityAdd(threadpool_t *pool, void (*f)(void *), void *arg, taskclass_t class);
+static void lockfreeWake(mpmcring_t *ring, int n);
+
+static long nowmsec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000L + ts.tv_nsec / 1000000L;
+}
+
+/**
+ * @function void *workerloop(threadpool_t *pool, int extra)
+ * @brief ciclo dei worker dei pool con coda condivisa. Un worker aggiunto dal pool elastico (extra) si ritira
+ * quando il pool lo chiede e la coda e' vuota
+ */
+static void *workerloop(threadpool_t *pool, int extra) {
+    taskfun_t task;  // generic task
+    elastic_t *elastic = pool->elastic;
 
     LOCK_RETURN(&(pool->lock), NULL);
     for (;;) {
         // in attesa di un messaggio, controllo spurious wakeups.
-        while((pool->count == 0) && (!pool->exiting))
+        while((pool->count == 0) && (!pool->exiting) && !(extra && elastic->retiring > 0))
             pthread_cond_wait(&(pool->cond), &(pool->lock));
 
         if (pool->exiting > 1) break; // exit forzato, esco immediatamente
 	// devo uscire ma ci sono messaggi pendenti 
 	if (pool->exiting == 1 && !pool->count) break;  
+	if (pool->count == 0) { // ritiro di un worker aggiunto
+	    elastic->retiring--;
+	    elastic->stats.retired++;
+	    break;
+	}
 
 	// nuovo task
         task.fun = pool->pending_queue[pool->head].fun;
@@ -50,6 +136,7 @@ static void *workerpool_thread(void *threadpool) {
         pool->head = (pool->head == abs(pool->queue_size)) ? 0 : pool->head;
 
 	pool->taskonthefly++;
+	if (pool->elastic && pool->taskonthefly > pool->elastic->busypeak) pool->elastic->busypeak = pool->taskonthefly;
         UNLOCK_RETURN(&(pool->lock), NULL);
 
         // eseguo la funzione 
@@ -58,18 +145,69 @@ static void *workerpool_thread(void *threadpool) {
 	LOCK_RETURN(&(pool->lock), NULL);
 	pool->taskonthefly--;
     }
+    if (extra) {
+	// destroyThreadPool attende che i worker aggiunti siano usciti
+	elastic->extra--;
+	pthread_cond_broadcast(&(pool->cond));
+    }
     UNLOCK_RETURN(&(pool->lock), NULL);
+    return NULL;
+}
+
+/**
+ * @function void *threadpool_thread(void *threadpool)
+ * @brief funzione eseguita dal thread worker che appartiene al pool
+ */
+static void *workerpool_thread(void *threadpool) {    
+    threadpool_t *pool = (threadpool_t *)threadpool; // cast
+    pthread_t self = pthread_self();
+    int myid = -1;
+
+    // non efficiente, si puo' fare meglio.....
+    do {
+	for (int i=0;i<pool->numthreads;++i)
+	    if (pthread_equal(pool->threads[i], self)) {
+		myid = i;
+		break;
+	    }
+    } while (myid < 0);
 
+    workerloop(pool, 0);
     //fprintf(stderr, "thread %d exiting\n", myid);
     return NULL;
 }
 
+/**
+ * @function void *extra_thread(void *threadpool)
+ * @brief funzione eseguita dal worker aggiunto da un pool elastico
+ */
+static void *extra_thread(void *threadpool) {
+    return workerloop((threadpool_t *)threadpool, 1);
+}
+
 
 
 static int freePoolResources(threadpool_t *pool) {
     if(pool->threads) {
         free(pool->threads);
         free(pool->pending_queue);
+	if (pool->kind == STEALING_POOL) {
+	    for (int i = 0; i < pool->numthreads; i++) free(pool->deques[i].tasks);
+	    free(pool->deques);
+	    pthread_key_delete(pool->selfkey);
+	}
+	if (pool->kind == LOCKFREE_POOL) {
+	    free(pool->ring->cells);
+	    free(pool->ring);
+	}
+	if (pool->elastic) {
+	    free(pool->elastic->enqueued);
+	    free(pool->elastic);
+	}
+	if (pool->kind == PRIORITY_POOL) {
+	    for (int c = 0; c < TASK_CLASSES; c++) free(pool->classes[c].tasks);
+	    free(pool->classes);
+	}
 	
         pthread_mutex_destroy(&(pool->lock));
         pthread_cond_destroy(&(pool->cond));
@@ -91,8 +229,14 @@ threadpool_t *createThreadPool(int numthreads, int pending_size) {
     pool->numthreads   = 0;
     pool->taskonthefly = 0;
     pool->queue_size = (pending_size == 0 ? -1 : pending_size);
-    pool->head = pool->tail = pool->count = 0;
+    pool->head = pool->tail = pool->count = pool->maxcount = 0;
     pool->exiting = 0;
+    pool->kind = FIFO_POOL;
+    pool->deques = NULL;
+    pool->ring = NULL;
+    pool->elastic = NULL;
+    pool->classes = NULL;
+    pool->pending = pool->ready = pool->idle = 0;
 
     /* Allocate thread and task queue */
     pool->threads = (pthread_t *)malloc(sizeof(pthread_t) * numthreads);
@@ -135,7 +279,8 @@ int destroyThreadPool(threadpool_t *pool, int force) {
 
     LOCK_RETURN(&(pool->lock), -1);
 
-    pool->exiting = 1 + force;
+    // i pool con work stealing e senza lock leggono exiting anche senza il lock
+    __atomic_store_n(&pool->exiting, 1 + force, __ATOMIC_SEQ_CST);
 
     if (pthread_cond_broadcast(&(pool->cond)) != 0) {
       UNLOCK_RETURN(&(pool->lock),-1);
@@ -143,7 +288,13 @@ int destroyThreadPool(threadpool_t *pool, int force) {
       return -1;
     }
     UNLOCK_RETURN(&(pool->lock), -1);
+    // i worker del pool senza lock dormono sull'eventcount
+    if (pool->kind == LOCKFREE_POOL) lockfreeWake(pool->ring, INT_MAX);
 
+    if (pool->elastic && pthread_join(pool->elastic->monitor, NULL) != 0) {
+	errno = EFAULT;
+	return -1;
+    }
     for(int i = 0; i < pool->numthreads; i++) {
 	if (pthread_join(pool->threads[i], NULL) != 0) {
 	    errno = EFAULT;
@@ -151,6 +302,13 @@ int destroyThreadPool(threadpool_t *pool, int force) {
 	    return -1;
 	}
     }
+    if (pool->elastic) {
+	// i worker aggiunti sono detached: si aspetta che escano
+	LOCK_RETURN(&(pool->lock), -1);
+	while (pool->elastic->extra > 0)
+	    pthread_cond_wait(&(pool->cond), &(pool->lock));
+	UNLOCK_RETURN(&(pool->lock), -1);
+    }
     freePoolResources(pool);
     return 0;
 }
@@ -161,6 +319,10 @@ int addToThreadPool(threadpool_t *pool, void (*f)(void *), void *arg) {
 	return -1;
     }
 
+    if (pool->kind == STEALING_POOL) return stealingAdd(pool, f, arg);
+    if (pool->kind == LOCKFREE_POOL) return lockfreeAdd(pool, f, arg);
+    if (pool->kind == PRIORITY_POOL) return priorityAdd(pool, f, arg, NORMAL_TASK);
+
     LOCK_RETURN(&(pool->lock), -1);
     int queue_size = abs(pool->queue_size);
     int nopending  = (pool->queue_size == -1); // non dobbiamo gestire messaggi pendenti
@@ -184,7 +346,9 @@ int addToThreadPool(threadpool_t *pool, void (*f)(void *), void *arg) {
 
     pool->pending_queue[pool->tail].fun = f;
     pool->pending_queue[pool->tail].arg = arg;
+    if (pool->elastic) pool->elastic->enqueued[pool->tail] = nowmsec();
     pool->count++;    
+    if (pool->count > pool->maxcount) pool->maxcount = pool->count;
     pool->tail++;
     if (pool->tail >= queue_size) pool->tail = 0;
     
@@ -199,6 +363,702 @@ int addToThreadPool(threadpool_t *pool, void (*f)(void *), void *arg) {
     return 0;
 }
 
+int countPendingTasks(threadpool_t *pool) {
+    if(pool == NULL) {
+	errno = EINVAL;
+	return -1;
+    }
+    if (pool->kind == STEALING_POOL) return __atomic_load_n(&pool->pending, __ATOMIC_SEQ_CST);
+    if (pool->kind == LOCKFREE_POOL) {
+	// le due posizioni non vengono lette insieme: il conteggio e' approssimato
+	long count = (long) (__atomic_load_n(&pool->ring->enqueue, __ATOMIC_RELAXED)
+			     - __atomic_load_n(&pool->ring->dequeue, __ATOMIC_RELAXED));
+	return count < 0 ? 0 : (count > pool->queue_size ? pool->queue_size : (int) count);
+    }
+
+    LOCK_RETURN(&(pool->lock), -1);
+    int count = pool->count;
+    UNLOCK_RETURN(&(pool->lock), -1);
+    return count;
+}
+
+
+/* --------------------------------- elastico --------------------------------- */
+
+//chiude il campione in corso della dimensione del pool se e' passato il suo intervallo.
+//Quando i campioni sono finiti vengono fusi a coppie e l'intervallo raddoppia
+static void poolsample(elastic_t *elastic, long now) {
+    poolstats_t *stats = &elastic->stats;
+    if (now - elastic->samplestart < stats->samplesec * 1000L) return;
+    stats->samples[stats->nsamples++] = elastic->samplemax;
+    if (stats->nsamples == POOL_SAMPLES) {
+	for (int i = 0; i < POOL_SAMPLES / 2; i++)
+	    stats->samples[i] = stats->samples[2 * i] > stats->samples[2 * i + 1] ? stats->samples[2 * i] : stats->samples[2 * i + 1];
+	stats->nsamples = POOL_SAMPLES / 2;
+	stats->samplesec *= 2;
+    }
+    elastic->samplestart = now;
+    elastic->samplemax = stats->threads;
+}
+
+//aggiunge un worker detached, da chiamare con pool->lock
+static int spawnExtra(threadpool_t *pool) {
+    elastic_t *elastic = pool->elastic;
+    pthread_t thread;
+    pthread_attr_t attr;
+    if (pthread_attr_init(&attr) != 0) return -1;
+    int r = pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (r == 0) r = pthread_create(&thread, &attr, extra_thread, (void*)pool);
+    pthread_attr_destroy(&attr);
+    if (r != 0) return -1;
+
+    elastic->extra++;
+    elastic->stats.spawned++;
+    elastic->stats.threads = pool->numthreads + elastic->extra;
+    if (elastic->stats.threads > elastic->stats.peak) elastic->stats.peak = elastic->stats.threads;
+    if (elastic->stats.threads > elastic->samplemax) elastic->samplemax = elastic->stats.threads;
+    return 0;
+}
+
+/**
+ * @function void *monitor_thread(void *threadpool)
+ * @brief controlla periodicamente il carico del pool elastico: aggiunge worker se tutti sono occupati e la
+ * coda aspetta troppo, ritira quelli aggiunti che in una finestra di idlemsec non sono mai serviti
+ */
+static void *monitor_thread(void *threadpool) {
+    threadpool_t *pool = (threadpool_t *)threadpool;
+    elastic_t *elastic = pool->elastic;
+
+    for (;;) {
+	msleep(ELASTIC_TICK_MSEC);
+	LOCK_RETURN(&(pool->lock), NULL);
+	if (pool->exiting) break;
+
+	long now = nowmsec();
+	int alive = pool->numthreads + elastic->extra - elastic->retiring;
+	if (pool->count > 0 && pool->taskonthefly >= alive
+	    && now - elastic->enqueued[pool->head] >= elastic->waitmsec) {
+	    // un worker per ogni task pendente, finche' si resta nel massimo
+	    int n = elastic->stats.maxthreads - (pool->numthreads + elastic->extra);
+	    if (n > pool->count) n = pool->count;
+	    for (int i = 0; i < n && spawnExtra(pool) == 0; i++);
+	    elastic->retiring = 0;
+	    elastic->windowstart = now;
+	    elastic->busypeak = pool->taskonthefly;
+	} else if (now - elastic->windowstart >= elastic->idlemsec) {
+	    // i worker in piu' rispetto al massimo di task in esecuzione nella finestra non sono serviti
+	    int spare = alive - elastic->busypeak;
+	    if (spare > elastic->extra - elastic->retiring) spare = elastic->extra - elastic->retiring;
+	    if (spare > 0) {
+		elastic->retiring += spare;
+		pthread_cond_broadcast(&(pool->cond));
+	    }
+	    elastic->windowstart = now;
+	    elastic->busypeak = pool->taskonthefly;
+	}
+	elastic->stats.threads = pool->numthreads + elastic->extra;
+	poolsample(elastic, now);
+	UNLOCK_RETURN(&(pool->lock), NULL);
+    }
+    UNLOCK_RETURN(&(pool->lock), NULL);
+    return NULL;
+}
+
+threadpool_t *createElasticPool(int minthreads, int maxthreads, int pending_size, int waitmsec, int idlemsec) {
+    if (maxthreads < minthreads || pending_size <= 0 || waitmsec < 0 || idlemsec <= 0) {
+	errno = EINVAL;
+	return NULL;
+    }
+
+    elastic_t *elastic = calloc(1, sizeof(elastic_t));
+    if (elastic == NULL) return NULL;
+    if ((elastic->enqueued = malloc(sizeof(long) * pending_size)) == NULL) {
+	free(elastic);
+	return NULL;
+    }
+    elastic->waitmsec = waitmsec;
+    elastic->idlemsec = idlemsec;
+    elastic->windowstart = elastic->samplestart = nowmsec();
+    elastic->samplemax = minthreads;
+    elastic->stats.minthreads = elastic->stats.threads = elastic->stats.peak = minthreads;
+    elastic->stats.maxthreads = maxthreads;
+    elastic->stats.samplesec = 1;
+
+    threadpool_t *pool = createThreadPool(minthreads, pending_size);
+    if (pool == NULL) {
+	free(elastic->enqueued);
+	free(elastic);
+	return NULL;
+    }
+    // i worker sono gia' partiti: il pool diventa elastico sotto lock
+    LOCK_RETURN(&(pool->lock), NULL);
+    pool->elastic = elastic;
+    UNLOCK_RETURN(&(pool->lock), NULL);
+    if (pthread_create(&(elastic->monitor), NULL, monitor_thread, (void*)pool) != 0) {
+	LOCK_RETURN(&(pool->lock), NULL);
+	pool->elastic = NULL;
+	UNLOCK_RETURN(&(pool->lock), NULL);
+	free(elastic->enqueued);
+	free(elastic);
+	destroyThreadPool(pool, 1);
+	errno = EFAULT;
+	return NULL;
+    }
+    return pool;
+}
+
+int getPoolStats(threadpool_t *pool, poolstats_t *stats) {
+    if (pool == NULL || stats == NULL) {
+	errno = EINVAL;
+	return -1;
+    }
+
+    LOCK_RETURN(&(pool->lock), -1);
+    if (!pool->elastic) {
+	memset(stats, 0, sizeof(poolstats_t));
+	stats->minthreads = stats->maxthreads = stats->threads = stats->peak = pool->numthreads;
+    } else {
+	*stats = pool->elastic->stats;
+	// il campione in corso, se c'e' posto
+	if (stats->nsamples < POOL_SAMPLES) stats->samples[stats->nsamples++] = pool->elastic->samplemax;
+    }
+    UNLOCK_RETURN(&(pool->lock), -1);
+    return 0;
+}
+
+
+/* --------------------------------- priorita' --------------------------------- */
+
+static const int classweight[TASK_CLASSES] = {SHORT_WEIGHT, NORMAL_WEIGHT, BULK_WEIGHT};
+
+//posti della coda e worker riservati ai task brevi: almeno uno se ce n'e' piu' di uno
+static inline int reserved(int n) {
+    int r = (n + SHORT_RESERVED - 1) / SHORT_RESERVED;
+    return r < n ? r : n - 1;
+}
+
+//classe del prossimo task da eseguire, -1 se non ce ne sono di eseguibili. Da chiamare con pool->lock.
+//Quando nessuna classe con task eseguibili ha piu' credito inizia un nuovo turno
+static int pickclass(threadpool_t *pool) {
+    classqueue_t *classes = pool->classes;
+    int longrunning = classes[NORMAL_TASK].running + classes[BULK_TASK].running;
+    int longlimit = pool->numthreads - reserved(pool->numthreads);
+
+    for (int turn = 0; turn < 2; turn++) {
+	int runnable = 0;
+	for (int c = 0; c < TASK_CLASSES; c++) {
+	    if (classes[c].count == 0 || (c != SHORT_TASK && longrunning >= longlimit)) continue;
+	    runnable = 1;
+	    if (classes[c].credit > 0) {
+		classes[c].credit--;
+		return c;
+	    }
+	}
+	if (!runnable) return -1;
+	for (int c = 0; c < TASK_CLASSES; c++) classes[c].credit = classweight[c];
+    }
+    return -1;
+}
+
+/**
+ * @function void *priority_thread(void *threadpool)
+ * @brief funzione eseguita dal worker di un pool con priorita'
+ */
+static void *priority_thread(void *threadpool) {
+    threadpool_t *pool = (threadpool_t *)threadpool;
+    classqueue_t *classes = pool->classes;
+    taskfun_t task;
+
+    LOCK_RETURN(&(pool->lock), NULL);
+    for (;;) {
+	int c;
+	// i task in coda potrebbero non essere eseguibili finche' non termina uno di quelli lunghi
+	while ((c = pickclass(pool)) < 0 && pool->exiting <= 1 && !(pool->exiting && pool->count == 0))
+	    pthread_cond_wait(&(pool->cond), &(pool->lock));
+	if (pool->exiting > 1 || c < 0) break;
+
+	task = classes[c].tasks[classes[c].head];
+	classes[c].head = (classes[c].head + 1 == pool->queue_size) ? 0 : classes[c].head + 1;
+	classes[c].count--;
+	classes[c].running++;
+	pool->count--;
+	pool->taskonthefly++;
+	UNLOCK_RETURN(&(pool->lock), NULL);
+
+	(*(task.fun))(task.arg);
+
+	LOCK_RETURN(&(pool->lock), NULL);
+	classes[c].running--;
+	pool->taskonthefly--;
+	// un task lungo libera un worker che i task lunghi in coda non potevano occupare
+	if (c != SHORT_TASK && pool->count > 0) pthread_cond_signal(&(pool->cond));
+    }
+    UNLOCK_RETURN(&(pool->lock), NULL);
+    return NULL;
+}
+
+static int priorityAdd(threadpool_t *pool, void (*f)(void *), void *arg, taskclass_t class) {
+    if (class < 0 || class >= TASK_CLASSES) {
+	errno = EINVAL;
+	return -1;
+    }
+    classqueue_t *queue = &pool->classes[class];
+
+    LOCK_RETURN(&(pool->lock), -1);
+    int limit = (class == SHORT_TASK) ? pool->queue_size : pool->queue_size - reserved(pool->queue_size);
+    if (pool->count >= limit || pool->exiting) {
+	UNLOCK_RETURN(&(pool->lock), -1);
+	return 1; // esco con valore "coda piena"
+    }
+
+    int tail = (queue->head + queue->count) % pool->queue_size;
+    queue->tasks[tail].fun = f;
+    queue->tasks[tail].arg = arg;
+    queue->count++;
+    pool->count++;
+    if (pool->count > pool->maxcount) pool->maxcount = pool->count;
+
+    int r;
+    if ((r = pthread_cond_signal(&(pool->cond))) != 0) {
+	UNLOCK_RETURN(&(pool->lock), -1);
+	errno = r;
+	return -1;
+    }
+    UNLOCK_RETURN(&(pool->lock), -1);
+    return 0;
+}
+
+int addToThreadPoolClass(threadpool_t *pool, void (*f)(void *), void *arg, taskclass_t class) {
+    if (pool == NULL || f == NULL) {
+	errno = EINVAL;
+	return -1;
+    }
+    if (pool->kind != PRIORITY_POOL) return addToThreadPool(pool, f, arg);
+    return priorityAdd(pool, f, arg, class);
+}
+
+threadpool_t *createPriorityPool(int numthreads, int pending_size) {
+    if (numthreads <= 0 || pending_size <= 0) {
+	errno = EINVAL;
+	return NULL;
+    }
+
+    threadpool_t *pool = (threadpool_t *)calloc(1, sizeof(threadpool_t));
+    if (pool == NULL) return NULL;
+    pool->queue_size = pending_size;
+    pool->kind = PRIORITY_POOL;
+
+    // ogni classe puo' occupare tutta la coda, i limiti sono sul numero totale di task pendenti
+    if ((pool->threads = (pthread_t *)malloc(sizeof(pthread_t) * numthreads)) == NULL
+	|| (pool->classes = (classqueue_t *)calloc(TASK_CLASSES, sizeof(classqueue_t))) == NULL)
+	goto error;
+    for (int c = 0; c < TASK_CLASSES; c++) {
+	pool->classes[c].credit = classweight[c];
+	if ((pool->classes[c].tasks = (taskfun_t *)malloc(sizeof(taskfun_t) * pending_size)) == NULL) goto error;
+    }
+    if ((pthread_mutex_init(&(pool->lock), NULL) != 0) ||
+	(pthread_cond_init(&(pool->cond), NULL) != 0))
+	goto error;
+
+    for (int i = 0; i < numthreads; i++) {
+	// numthreads limita i worker occupabili dai task lunghi, va aggiornato sotto lock
+	LOCK_RETURN(&(pool->lock), NULL);
+	pool->numthreads++;
+	UNLOCK_RETURN(&(pool->lock), NULL);
+        if (pthread_create(&(pool->threads[i]), NULL, priority_thread, (void*)pool) != 0) {
+	    /* errore fatale, libero tutto forzando l'uscita dei threads */
+	    pool->numthreads--;
+            destroyThreadPool(pool, 1);
+	    errno = EFAULT;
+            return NULL;
+        }
+    }
+    return pool;
+
+    error:
+    if (pool->classes) {
+	for (int c = 0; c < TASK_CLASSES; c++) free(pool->classes[c].tasks);
+	free(pool->classes);
+    }
+    free(pool->threads);
+    free(pool);
+    return NULL;
+}
+
+
+/* ------------------------------ work stealing ------------------------------ */
+
+//gli elementi vengono letti dai ladri mentre il proprietario scrive in altre posizioni dell'array
+static inline void wsstore(taskfun_t *slot, void (*fun)(void *), void *arg) {
+    __atomic_store_n(&slot->fun, fun, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->arg, arg, __ATOMIC_RELAXED);
+}
+
+static inline void wsload(taskfun_t *slot, taskfun_t *task) {
+    task->fun = __atomic_load_n(&slot->fun, __ATOMIC_RELAXED);
+    task->arg = __atomic_load_n(&slot->arg, __ATOMIC_RELAXED);
+}
+
+//inserimento in fondo, solo dal proprietario
+static void wspush(wsdeque_t *d, void (*fun)(void *), void *arg) {
+    long b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED);
+    wsstore(&d->tasks[b & d->mask], fun, arg);
+    __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELEASE);
+}
+
+//prelievo dal fondo, solo dal proprietario: l'ultimo task viene conteso ai ladri
+static int wstake(wsdeque_t *d, taskfun_t *task) {
+    long b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED) - 1;
+    __atomic_store_n(&d->bottom, b, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    long t = __atomic_load_n(&d->top, __ATOMIC_RELAXED);
+    if (t > b) {
+	__atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+	return 0;
+    }
+    wsload(&d->tasks[b & d->mask], task);
+    if (t < b) return 1;
+    int won = __atomic_compare_exchange_n(&d->top, &t, t + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+    __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+    return won;
+}
+
+//furto dalla cima, da qualunque worker. Restituisce 0 anche se un altro thread ha preso il task per primo
+static int wssteal(wsdeque_t *d, taskfun_t *task) {
+    long t = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    long b = __atomic_load_n(&d->bottom, __ATOMIC_ACQUIRE);
+    if (t >= b) return 0;
+    wsload(&d->tasks[t & d->mask], task);
+    return __atomic_compare_exchange_n(&d->top, &t, t + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+}
+
+//preleva un task dalla coda globale; se ce ne sono altri, una parte passa nella deque del worker,
+//da cui possono essere rubati, così la coda globale viene bloccata una volta per più task
+static int wsinject(wsdeque_t *self, taskfun_t *task) {
+    threadpool_t *pool = self->pool;
+    if (__atomic_load_n(&pool->count, __ATOMIC_RELAXED) == 0) return 0;
+
+    LOCK_RETURN(&(pool->lock), 0);
+    int n = pool->count / __atomic_load_n(&pool->numthreads, __ATOMIC_RELAXED) + 1;
+    if (n > pool->count) n = pool->count;
+    if (n > WS_BATCH) n = WS_BATCH;
+    for (int i = 0; i < n; i++) {
+	taskfun_t *slot = &pool->pending_queue[pool->head];
+	if (i == 0) *task = *slot;
+	else wspush(self, slot->fun, slot->arg);
+	pool->head = (pool->head + 1 == pool->queue_size) ? 0 : pool->head + 1;
+    }
+    __atomic_store_n(&pool->count, pool->count - n, __ATOMIC_RELAXED);
+    UNLOCK_RETURN(&(pool->lock), 0);
+    return n > 0;
+}
+
+//cerca un task nelle deque degli altri worker, a partire da una vittima scelta a caso
+static int wsstealany(wsdeque_t *self, taskfun_t *task) {
+    threadpool_t *pool = self->pool;
+    int n = __atomic_load_n(&pool->numthreads, __ATOMIC_RELAXED);
+    self->seed ^= self->seed << 13;
+    self->seed ^= self->seed >> 17;
+    self->seed ^= self->seed << 5;
+    for (int i = 0, start = (int) (self->seed % (unsigned int) n); i < n; i++) {
+	wsdeque_t *victim = &pool->deques[(start + i) % n];
+	if (victim != self && wssteal(victim, task)) return 1;
+    }
+    return 0;
+}
+
+//addormenta il worker finché non ci sono task in attesa. Restituisce 1 se il worker deve uscire
+static int wspark(threadpool_t *pool) {
+    LOCK_RETURN(&(pool->lock), 1);
+    // chi aggiunge un task incrementa ready e poi controlla idle, qui si fa il contrario:
+    // almeno uno dei due vede la modifica dell'altro, quindi nessuna notifica va persa.
+    // ready e' negativo se un task e' stato prelevato prima che chi lo ha inserito lo contasse
+    __atomic_add_fetch(&pool->idle, 1, __ATOMIC_SEQ_CST);
+    while (__atomic_load_n(&pool->ready, __ATOMIC_SEQ_CST) <= 0 && !pool->exiting)
+	pthread_cond_wait(&(pool->cond), &(pool->lock));
+    __atomic_sub_fetch(&pool->idle, 1, __ATOMIC_SEQ_CST);
+    int done = pool->exiting > 1 || (pool->exiting == 1 && __atomic_load_n(&pool->pending, __ATOMIC_SEQ_CST) == 0);
+    UNLOCK_RETURN(&(pool->lock), 1);
+    return done;
+}
+
+/**
+ * @function void *stealing_thread(void *deque)
+ * @brief funzione eseguita dal worker di un pool con work stealing: cerca i task nella propria deque,
+ * poi nella coda globale, poi nelle deque degli altri worker, e se non ne trova si addormenta
+ */
+static void *stealing_thread(void *deque) {
+    wsdeque_t *self = (wsdeque_t *)deque;
+    threadpool_t *pool = self->pool;
+    taskfun_t task;
+
+    if (pthread_setspecific(pool->selfkey, self) != 0) return NULL;
+    for (;;) {
+	if (__atomic_load_n(&pool->exiting, __ATOMIC_RELAXED) > 1) break; // exit forzato
+	if (wstake(self, &task) || wsinject(self, &task) || wsstealany(self, &task)) {
+	    __atomic_sub_fetch(&pool->ready, 1, __ATOMIC_SEQ_CST);
+	    __atomic_sub_fetch(&pool->pending, 1, __ATOMIC_SEQ_CST);
+	    (*(task.fun))(task.arg);
+	    continue;
+	}
+	if (wspark(pool)) break;
+    }
+    return NULL;
+}
+
+static int stealingAdd(threadpool_t *pool, void (*f)(void *), void *arg) {
+    if (__atomic_load_n(&pool->exiting, __ATOMIC_RELAXED)) return 1;
+
+    // il posto viene prenotato prima dell'inserimento, così le deque non superano mai queue_size task
+    int pending = __atomic_add_fetch(&pool->pending, 1, __ATOMIC_SEQ_CST);
+    if (pending > pool->queue_size) {
+	__atomic_sub_fetch(&pool->pending, 1, __ATOMIC_SEQ_CST);
+	return 1; // esco con valore "coda piena"
+    }
+    int maxcount = __atomic_load_n(&pool->maxcount, __ATOMIC_RELAXED);
+    while (pending > maxcount &&
+	   !__atomic_compare_exchange_n(&pool->maxcount, &maxcount, pending, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+    wsdeque_t *self = pthread_getspecific(pool->selfkey);
+    if (self) {
+	// un worker (ad esempio quando passa al pool le richieste sospese) usa la propria deque
+	wspush(self, f, arg);
+    } else {
+	LOCK_RETURN(&(pool->lock), -1);
+	pool->pending_queue[pool->tail].fun = f;
+	pool->pending_queue[pool->tail].arg = arg;
+	pool->tail = (pool->tail + 1 == pool->queue_size) ? 0 : pool->tail + 1;
+	__atomic_store_n(&pool->count, pool->count + 1, __ATOMIC_RELAXED);
+	UNLOCK_RETURN(&(pool->lock), -1);
+    }
+
+    __atomic_add_fetch(&pool->ready, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&pool->idle, __ATOMIC_SEQ_CST) > 0) {
+	int r;
+	LOCK_RETURN(&(pool->lock), -1);
+	if ((r = pthread_cond_signal(&(pool->cond))) != 0) {
+	    UNLOCK_RETURN(&(pool->lock), -1);
+	    errno = r;
+	    return -1;
+	}
+	UNLOCK_RETURN(&(pool->lock), -1);
+    }
+    return 0;
+}
+
+threadpool_t *createStealingPool(int numthreads, int pending_size) {
+    if (numthreads <= 0 || pending_size <= 0) {
+	errno = EINVAL;
+	return NULL;
+    }
+
+    threadpool_t *pool = (threadpool_t *)calloc(1, sizeof(threadpool_t));
+    if (pool == NULL) return NULL;
+    pool->queue_size = pending_size;
+    pool->kind = STEALING_POOL;
+
+    long capacity = 1;
+    while (capacity < pending_size) capacity <<= 1;
+    void *deques = NULL;
+    if ((pool->threads = (pthread_t *)malloc(sizeof(pthread_t) * numthreads)) == NULL
+	|| (pool->pending_queue = (taskfun_t *)malloc(sizeof(taskfun_t) * pending_size)) == NULL
+	|| posix_memalign(&deques, WS_CACHELINE, sizeof(wsdeque_t) * numthreads) != 0)
+	goto error;
+    pool->deques = memset(deques, 0, sizeof(wsdeque_t) * numthreads);
+    for (int i = 0; i < numthreads; i++) {
+	pool->deques[i].mask = capacity - 1;
+	pool->deques[i].seed = 2463534242u + (unsigned int) i;
+	pool->deques[i].pool = pool;
+	if ((pool->deques[i].tasks = (taskfun_t *)malloc(sizeof(taskfun_t) * capacity)) == NULL) goto error;
+    }
+    if (pthread_key_create(&(pool->selfkey), NULL) != 0) goto error;
+    if ((pthread_mutex_init(&(pool->lock), NULL) != 0) ||
+	(pthread_cond_init(&(pool->cond), NULL) != 0)) {
+	pthread_key_delete(pool->selfkey);
+	goto error;
+    }
+
+    for (int i = 0; i < numthreads; i++) {
+	// numthreads conta anche il thread che sta partendo, che potrebbe cercare subito nelle deque
+	__atomic_store_n(&pool->numthreads, i + 1, __ATOMIC_RELAXED);
+        if (pthread_create(&(pool->threads[i]), NULL, stealing_thread, (void*)&pool->deques[i]) != 0) {
+	    /* errore fatale, libero le deque dei thread non lanciati e forzo l'uscita degli altri */
+	    __atomic_store_n(&pool->numthreads, i, __ATOMIC_RELAXED);
+	    for (int j = i; j < numthreads; j++) free(pool->deques[j].tasks);
+            destroyThreadPool(pool, 1);
+	    errno = EFAULT;
+            return NULL;
+        }
+    }
+    return pool;
+
+    error:
+    if (pool->deques) {
+	for (int i = 0; i < numthreads; i++) free(pool->deques[i].tasks);
+	free(pool->deques);
+    }
+    free(pool->pending_queue);
+    free(pool->threads);
+    free(pool);
+    return NULL;
+}
+
+
+/* -------------------------------- senza lock -------------------------------- */
+
+//il futex e' privato: i worker sono thread dello stesso processo
+static void futex_wait(uint32_t *addr, uint32_t val) {
+    syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+}
+
+static void futex_wake(uint32_t *addr, int n) {
+    syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, n, NULL, NULL, 0);
+}
+
+//inserimento: la CAS su enqueue prenota la cella, il numero di sequenza la pubblica ai consumatori
+static int mpmcpush(mpmcring_t *ring, void (*fun)(void *), void *arg) {
+    unsigned long pos = __atomic_load_n(&ring->enqueue, __ATOMIC_RELAXED);
+    for (;;) {
+	mpmccell_t *cell = &ring->cells[pos % ring->size];
+	unsigned long seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+	long diff = (long) (seq - pos);
+	if (diff == 0) {
+	    if (__atomic_compare_exchange_n(&ring->enqueue, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+		cell->task.fun = fun;
+		cell->task.arg = arg;
+		__atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+		return 0;
+	    }
+	} else if (diff < 0) {
+	    return 1; // la cella contiene ancora il task di un giro precedente: anello pieno
+	} else {
+	    pos = __atomic_load_n(&ring->enqueue, __ATOMIC_RELAXED);
+	}
+    }
+}
+
+//prelievo: la cella torna libera per il giro successivo dell'anello
+static int mpmcpop(mpmcring_t *ring, taskfun_t *task) {
+    unsigned long pos = __atomic_load_n(&ring->dequeue, __ATOMIC_RELAXED);
+    for (;;) {
+	mpmccell_t *cell = &ring->cells[pos % ring->size];
+	unsigned long seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+	long diff = (long) (seq - (pos + 1));
+	if (diff == 0) {
+	    if (__atomic_compare_exchange_n(&ring->dequeue, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+		*task = cell->task;
+		__atomic_store_n(&cell->seq, pos + ring->size, __ATOMIC_RELEASE);
+		return 1;
+	    }
+	} else if (diff < 0) {
+	    return 0; // vuoto, o il task della cella e' ancora in inserimento: chi lo inserisce sveglia i worker
+	} else {
+	    pos = __atomic_load_n(&ring->dequeue, __ATOMIC_RELAXED);
+	}
+    }
+}
+
+/**
+ * @function void *lockfree_thread(void *threadpool)
+ * @brief funzione eseguita dal worker di un pool senza lock: preleva i task dall'anello e, quando e' vuoto,
+ * dorme sull'eventcount
+ */
+static void *lockfree_thread(void *threadpool) {
+    threadpool_t *pool = (threadpool_t *)threadpool;
+    mpmcring_t *ring = pool->ring;
+    taskfun_t task;
+
+    for (;;) {
+	if (__atomic_load_n(&pool->exiting, __ATOMIC_RELAXED) > 1) break; // exit forzato
+	if (mpmcpop(ring, &task)) {
+	    (*(task.fun))(task.arg);
+	    continue;
+	}
+	// eventcount: si legge l'epoca, ci si dichiara addormentati e si ricontrolla l'anello. Chi inserisce
+	// pubblica il task e poi controlla sleepers, quindi o il task viene visto qui o l'epoca cambia
+	uint32_t epoch = __atomic_load_n(&ring->epoch, __ATOMIC_ACQUIRE);
+	__atomic_add_fetch(&ring->sleepers, 1, __ATOMIC_SEQ_CST);
+	if (mpmcpop(ring, &task)) {
+	    __atomic_sub_fetch(&ring->sleepers, 1, __ATOMIC_SEQ_CST);
+	    (*(task.fun))(task.arg);
+	    continue;
+	}
+	if (__atomic_load_n(&pool->exiting, __ATOMIC_SEQ_CST)) {
+	    // l'anello e' vuoto: anche un exit non forzato puo' terminare
+	    __atomic_sub_fetch(&ring->sleepers, 1, __ATOMIC_SEQ_CST);
+	    break;
+	}
+	futex_wait(&ring->epoch, epoch);
+	__atomic_sub_fetch(&ring->sleepers, 1, __ATOMIC_SEQ_CST);
+    }
+    return NULL;
+}
+
+//sveglia n worker addormentati, tutti se n e' INT_MAX
+static void lockfreeWake(mpmcring_t *ring, int n) {
+    __atomic_add_fetch(&ring->epoch, 1, __ATOMIC_RELEASE);
+    futex_wake(&ring->epoch, n);
+}
+
+static int lockfreeAdd(threadpool_t *pool, void (*f)(void *), void *arg) {
+    mpmcring_t *ring = pool->ring;
+    if (__atomic_load_n(&pool->exiting, __ATOMIC_RELAXED)) return 1;
+    if (mpmcpush(ring, f, arg) != 0) return 1; // esco con valore "coda piena"
+
+    int count = countPendingTasks(pool);
+    int maxcount = __atomic_load_n(&pool->maxcount, __ATOMIC_RELAXED);
+    while (count > maxcount &&
+	   !__atomic_compare_exchange_n(&pool->maxcount, &maxcount, count, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&ring->sleepers, __ATOMIC_SEQ_CST) > 0) lockfreeWake(ring, 1);
+    return 0;
+}
+
+threadpool_t *createLockfreePool(int numthreads, int pending_size) {
+    if (numthreads <= 0 || pending_size <= 0) {
+	errno = EINVAL;
+	return NULL;
+    }
+
+    threadpool_t *pool = (threadpool_t *)calloc(1, sizeof(threadpool_t));
+    if (pool == NULL) return NULL;
+    pool->queue_size = pending_size;
+    pool->kind = LOCKFREE_POOL;
+
+    void *ring = NULL;
+    if ((pool->threads = (pthread_t *)malloc(sizeof(pthread_t) * numthreads)) == NULL
+	|| posix_memalign(&ring, WS_CACHELINE, sizeof(mpmcring_t)) != 0)
+	goto error;
+    pool->ring = memset(ring, 0, sizeof(mpmcring_t));
+    pool->ring->size = (unsigned long) pending_size;
+    if ((pool->ring->cells = (mpmccell_t *)malloc(sizeof(mpmccell_t) * pending_size)) == NULL) goto error;
+    for (int i = 0; i < pending_size; i++) pool->ring->cells[i].seq = (unsigned long) i;
+    // lock e cond servono solo al protocollo di uscita comune agli altri pool
+    if ((pthread_mutex_init(&(pool->lock), NULL) != 0) ||
+	(pthread_cond_init(&(pool->cond), NULL) != 0))
+	goto error;
+
+    for (int i = 0; i < numthreads; i++) {
+        if (pthread_create(&(pool->threads[i]), NULL, lockfree_thread, (void*)pool) != 0) {
+	    /* errore fatale, libero tutto forzando l'uscita dei threads */
+            destroyThreadPool(pool, 1);
+	    errno = EFAULT;
+            return NULL;
+        }
+        pool->numthreads++;
+    }
+    return pool;
+
+    error:
+    if (pool->ring) free(pool->ring->cells);
+    free(pool->ring);
+    free(pool->threads);
+    free(pool);
+    return NULL;
+}
+
 
 /**
  * @function void *thread_proxy(void *argl)
@@ -0,0 +1,182 @@
+/**
+ * @file timerwheel.c
+ * @brief Implementazione della ruota dei timer gerarchica
+ */
+
+#include <stdlib.h>
+#include <errno.h>
+#include <time.h>
+
+#include <util.h>
+#include <timerwheel.h>
+
+static unsigned long now_msec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+//inserisce il timer nello slot opportuno rispetto al tick corrente, va chiamata con la mutex acquisita
+static int tw_place(timerwheel_t *tw, tw_timer_t *timer) {
+    unsigned long expire = timer->expire;
+    //timer già scaduto, lo metto nel prossimo slot da processare
+    if (expire < tw->current) expire = tw->current;
+
+    unsigned long delta = expire - tw->current;
+    int level;
+    for (level = 0; level < TW_LEVELS - 1; level++) {
+        if (delta < (1UL << (TW_SLOT_BITS * (level + 1)))) break;
+    }
+    //oltre l'orizzonte della ruota: lo parcheggio nell'ultimo livello, verrà ridistribuito al cascade
+    if (level == TW_LEVELS - 1 && delta >= (1UL << (TW_SLOT_BITS * TW_LEVELS)))
+        expire = tw->current + (1UL << (TW_SLOT_BITS * TW_LEVELS)) - 1;
+
+    int slot = (int) ((expire >> (TW_SLOT_BITS * level)) & TW_SLOT_MASK);
+    if (list_add(tw->slots[level][slot], timer) == NULL) return -1;
+    return 0;
+}
+
+//ridistribuisce lo slot del livello indicato sui livelli inferiori
+static int tw_cascade(timerwheel_t *tw, int level, int slot) {
+    list_t *toCascade = tw->slots[level][slot];
+    if ((tw->slots[level][slot] = list_init()) == NULL) {
+        tw->slots[level][slot] = toCascade;
+        return -1;
+    }
+    elem_t *elem;
+    while ((elem = list_removehead(toCascade)) != NULL) {
+        if (tw_place(tw, elem->data) == -1) {
+            free(elem);
+            list_destroy(toCascade, free);
+            return -1;
+        }
+        free(elem);
+    }
+    list_destroy(toCascade, free);
+    return 0;
+}
+
+timerwheel_t *tw_create(long tick_msec) {
+    if (tick_msec <= 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    timerwheel_t *tw = calloc(1, sizeof(timerwheel_t));
+    if (tw == NULL) return NULL;
+    for (int l = 0; l < TW_LEVELS; l++) {
+        for (int s = 0; s < TW_SLOTS; s++) {
+            if ((tw->slots[l][s] = list_init()) == NULL) {
+                tw_destroy(tw, NULL);
+                return NULL;
+            }
+        }
+    }
+    if (pthread_mutex_init(&tw->mutex, NULL) != 0) {
+        for (int l = 0; l < TW_LEVELS; l++)
+            for (int s = 0; s < TW_SLOTS; s++)
+                if (tw->slots[l][s]) list_destroy(tw->slots[l][s], free);
+        free(tw);
+        return NULL;
+    }
+    tw->tick_msec = tick_msec;
+    tw->start_msec = now_msec();
+    tw->current = 0;
+    tw->ntimers = 0;
+    return tw;
+}
+
+void tw_destroy(timerwheel_t *tw, void (*free_data)(void *)) {
+    if (!tw) return;
+
+    for (int l = 0; l < TW_LEVELS; l++) {
+        for (int s = 0; s < TW_SLOTS; s++) {
+            if (tw->slots[l][s] == NULL) continue;
+            elem_t *elem;
+            while ((elem = list_removehead(tw->slots[l][s])) != NULL) {
+                tw_timer_t *timer = elem->data;
+                if (free_data && timer->data) free_data(timer->data);
+                free(timer);
+                free(elem);
+            }
+            list_destroy(tw->slots[l][s], free);
+        }
+    }
+    pthread_mutex_destroy(&tw->mutex);
+    free(tw);
+}
+
+unsigned long tw_now(timerwheel_t *tw) {
+    return (now_msec() - tw->start_msec) / tw->tick_msec;
+}
+
+int tw_add(timerwheel_t *tw, long timeout_msec, void *data, unsigned long *expire) {
+    if (!tw || timeout_msec <= 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    tw_timer_t *timer = malloc(sizeof(tw_timer_t));
+    if (timer == NULL) return -1;
+    timer->data = data;
+
+    LOCK_RETURN(&tw->mutex, -1)
+    unsigned long now = tw_now(tw);
+    if (now < tw->current) now = tw->current;
+    //arrotondo per eccesso: il timer non scade mai prima del tempo richiesto
+    timer->expire = now + (timeout_msec + tw->tick_msec - 1) / tw->tick_msec;
+    if (tw_place(tw, timer) == -1) {
+        UNLOCK_RETURN(&tw->mutex, -1)
+        free(timer);
+        return -1;
+    }
+    tw->ntimers++;
+    if (expire) *expire = timer->expire;
+    UNLOCK_RETURN(&tw->mutex, -1)
+
+    return 0;
+}
+
+int tw_advance(timerwheel_t *tw, list_t *expired) {
+    if (!tw || !expired) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    LOCK_RETURN(&tw->mutex, -1)
+    unsigned long now = tw_now(tw);
+    //processo tutti i tick trascorsi dall'ultima chiamata
+    while (tw->current <= now) {
+        //nessun timer registrato: salto direttamente all'istante corrente
+        if (tw->ntimers == 0) {
+            tw->current = now + 1;
+            break;
+        }
+        int index = (int) (tw->current & TW_SLOT_MASK);
+        if (index == 0) {
+            for (int level = 1; level < TW_LEVELS; level++) {
+                int slot = (int) ((tw->current >> (TW_SLOT_BITS * level)) & TW_SLOT_MASK);
+                if (tw_cascade(tw, level, slot) == -1) {
+                    UNLOCK_RETURN(&tw->mutex, -1)
+                    return -1;
+                }
+                if (slot != 0) break;
+            }
+        }
+        elem_t *elem;
+        while ((elem = list_removehead(tw->slots[0][index])) != NULL) {
+            if (list_add(expired, elem->data) == NULL) {
+                list_addhead(tw->slots[0][index], elem->data);
+                free(elem);
+                UNLOCK_RETURN(&tw->mutex, -1)
+                return -1;
+            }
+            tw->ntimers--;
+            free(elem);
+        }
+        tw->current++;
+    }
+    UNLOCK_RETURN(&tw->mutex, -1)
+
+    return 0;
+}
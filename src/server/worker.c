@@ -1,25 +1,293 @@
 #include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
 
 #include <worker.h>
 #include <manager.h>
 #include <storage.h>
+#include <reactor.h>
 
 extern storage_t *storage;
-extern int fdpipe[2];
+extern reactorpool_t *rpool;
+extern configArgs confargs;
 
-void requesthandler(int *clientfd){
+//i memfd viaggiano solo sul socket AF_UNIX, non su TCP né negli anelli in memoria condivisa
+static bool fdpassing(int clientfd) {
+    return !clientRemote(rpool, clientfd) && !shmchan_lookup(clientfd);
+}
+
+//costruisce una risposta alla richiesta, etichettata con il suo id
+static msg_t *buildresponse(msg_t *request, int code, int arg, const char *pathname, size_t data_size, void *data) {
+    msg_t *response = buildmsg(request->header->username, code, arg, pathname, data_size, data);
+    if (response) response->header->id = request->header->id;
+    return response;
+}
+
+//spedisce i file della lista come risposte alla richiesta, accorpando più file per scrittura
+static int sendfiles(msg_t *request, int clientfd, int rescode, list_t *files) {
+    msgbatch_t batch;
+    initbatch(&batch, clientfd);
+    for (elem_t *node = files->head; node != NULL; node = node->next) {
+        file_t *file = node->data;
+        if (batchmsg(&batch, rescode, files->length, request->header->id, file->filename, file->size, file->content) <= 0)
+            return -1;
+    }
+    if (flushbatch(&batch) <= 0) return -1;
+    return 0;
+}
+
+//spedisce la risposta preparata con packmsg, senza pathname, in iov: il payload diviso nei buffer successivi
+//all'header viene raccolto in un unico buffer e compresso. Restituisce come writemsg
+static int sendcompressed(msg_t *request, int clientfd, const wire_header *wire, struct iovec *iov, int iovcnt) {
+    msg_t *response = NULL;
+    if ((response = buildresponse(request, wire->code, wire->arg, NULL, 0, NULL)) == NULL) return -1;
+    if ((response->data = pool_alloc(wire->data_size)) == NULL) {
+        destroymsg(response);
+        return -1;
+    }
+    response->header->flags = wire->flags;
+    response->header->data_size = wire->data_size;
+    char *payload = response->data;
+    for (int i = 1; i < iovcnt; i++) {
+        memcpy(payload, iov[i].iov_base, iov[i].iov_len);
+        payload += iov[i].iov_len;
+    }
+    pool_free(compressmsg(response));
+    int r = writemsg(clientfd, response);
+    destroymsg(response);
+    return r;
+}
+
+//spedisce i file della lista in risposte impacchettate: l'indice viene costruito a parte,
+//i contenuti vengono spediti senza copiarli con la stessa writev, o raccolti e compressi se il client lo ha chiesto
+static int sendpacked(msg_t *request, int clientfd, int rescode, list_t *files) {
+    wire_header wire;
+    struct iovec iov[PACK_FILES + 2];
+    size_t compress = clientCompress(rpool, clientfd);
+    elem_t *node = files->head;
+    while (node) {
+        //file e byte della prossima risposta
+        elem_t *last;
+        int n = 0;
+        size_t indexsize = 0, contentsize = 0;
+        for (last = node; last && n < PACK_FILES && (n == 0 || contentsize < PACK_BUDGET); last = last->next) {
+            file_t *file = last->data;
+            indexsize += entrysize(file->filename);
+            contentsize += file->size;
+            n++;
+        }
+
+        char *index = pool_alloc(indexsize);
+        if (!index) return -1;
+        int iovcnt = packmsg(&wire, iov, rescode, n, 0, request->header->id, last ? FLAG_MORE : 0, NULL, 0, NULL);
+        wire.data_size = indexsize + contentsize;
+        iov[iovcnt].iov_base = index;
+        iov[iovcnt++].iov_len = indexsize;
+        char *entry = index;
+        for (; node != last; node = node->next) {
+            file_t *file = node->data;
+            entry = packentry(entry, file->filename, file->size);
+            if (file->size == 0) continue;
+            iov[iovcnt].iov_base = file->content;
+            iov[iovcnt++].iov_len = file->size;
+        }
+        int r;
+        if (compress > 0 && contentsize >= compress)
+            r = sendcompressed(request, clientfd, &wire, iov, iovcnt);
+        else
+            r = msgwritev(clientfd, iov, iovcnt);
+        pool_free(index);
+        if (r <= 0) return -1;
+    }
+    return 0;
+}
+
+//modalità con cui il client ha chiesto di ricevere i file espulsi da una WRITE o APPEND
+static int evictmode(msg_t *request) {
+    int mode = request->header->arg;
+    return (mode == EVICT_NAMES || mode == EVICT_NONE) ? mode : EVICT_FULL;
+}
+
+//risponde a una WRITE o APPEND con l'esito e i file espulsi nella forma chiesta dal client, in *sent i byte di contenuto spediti
+static int sendvictims(msg_t *request, int clientfd, int rescode, list_t *victims, size_t *sent) {
+    msg_t *response = NULL;
+    int mode = evictmode(request);
+    *sent = 0;
+    if (victims->length > 0 && mode == EVICT_FULL) {
+        if (sendfiles(request, clientfd, rescode, victims) == -1) return -1;
+        for (elem_t *node = victims->head; node != NULL; node = node->next)
+            *sent += ((file_t *) node->data)->size;
+        return 0;
+    }
+
+    int nvictims = (mode == EVICT_NAMES ? victims->length : 0);
+    if ((response = buildresponse(request, rescode, nvictims, NULL, 0, NULL)) == NULL) return -1;
+    if (nvictims > 0) {
+        //un'unica risposta elenca nomi e dimensioni, il contenuto dei file non viene spedito
+        size_t size = 0;
+        for (elem_t *node = victims->head; node != NULL; node = node->next)
+            size += entrysize(((file_t *) node->data)->filename);
+        if ((response->data = pool_alloc(size)) == NULL) {
+            destroymsg(response);
+            return -1;
+        }
+        response->header->data_size = size;
+        char *entry = response->data;
+        for (elem_t *node = victims->head; node != NULL; node = node->next)
+            entry = packentry(entry, ((file_t *) node->data)->filename, ((file_t *) node->data)->size);
+    }
+    int r = writemsg(clientfd, response);
+    destroymsg(response);
+    return r <= 0 ? -1 : 0;
+}
 
-    int fd = *clientfd;
-    free(clientfd);
+//dà al client il via libera per passare il memfd di una WRITE e lo riceve, con lo stesso id della richiesta
+static int recvmemfd(msg_t *request, int clientfd, int *memfd) {
+    msg_t *message = NULL;
+    if ((message = buildresponse(request, EXIT_SUCCESS, 0, NULL, 0, NULL)) == NULL) return -1;
+    message->header->flags = FLAG_MEMFD;
+    int r = writemsg(clientfd, message);
+    destroymsg(message);
+    if (r <= 0) return -1;
+
+    if ((message = initmsg()) == NULL) return -1;
+    if ((r = readmsg_fd(clientfd, message, memfd, REQUEST_MAX_DATA, false)) <= 0) {
+        destroymsg(message);
+        return -1;
+    }
+    if (*memfd == -1 || message->header->id != request->header->id
+        || message->header->flags != (FLAG_MEMFD | FLAG_CHUNK) || message->header->data_size != request->header->data_size) {
+        if (*memfd != -1) close(*memfd);
+        *memfd = -1;
+        destroymsg(message);
+        errno = EPROTO;
+        return -1;
+    }
+    destroymsg(message);
+    return EXIT_SUCCESS;
+}
+
+void requesthandler(clienttask_t *task){
 
+    int fd = task->fd;
+    //byte già ricevuti dal reactor non ancora consumati
+    const char *prefetch = task->prefetch;
+    size_t prefetched = task->prefetched;
     msg_t *request = NULL;
-    if ((request = initmsg()) == NULL) goto fatal;
-    if (readmsg(fd, request) <= 0) {
-        int crashedclient = fd *(-1);
-        if (write(fdpipe[1], &crashedclient, sizeof(int)) <= 0) goto fatal;
+    int served = 0;
+
+    shmchan_t *chan = shmchan_lookup(fd);
+    if (chan) {
+        //sul socket arrivano solo i byte con cui il client sveglia la connessione, le richieste sono nell'anello
+        if (recycleBuffer(rpool, task) == -1) goto fatal;
+        prefetch = NULL;
+        prefetched = 0;
+        if (shmchan_drain(chan) != 1) {
+            if (releaseClient(rpool, fd) == -1) goto fatal;
+            free(task);
+            return;
+        }
+        if (!shmchan_pending(chan)) goto idle;
+    }
+    do {
+        if ((request = initmsg()) == NULL) goto fatal;
+        //i contenuti grandi arrivano a chunk: il client non decide quanta memoria viene allocata per una richiesta.
+        //I payload compressi sono accettati solo se la compressione è stata concordata con HELLO
+        int res = readmsg_prefetched(fd, request, &prefetch, &prefetched, REQUEST_MAX_DATA, clientCompress(rpool, fd) > 0);
+        //buffer del reactor consumato, lo restituisco subito
+        if (prefetched == 0 && recycleBuffer(rpool, task) == -1) goto fatal;
+        if (res <= 0) {
+            //il payload rifiutato è rimasto nel socket, dopo la risposta la connessione va chiusa
+            if (res == -1 && errno == EMSGSIZE) w_reject(request, fd, EMSGSIZE);
+            //il client ha chiuso la connessione, la chiusura del fd è gestita dal suo reactor
+            if (recycleBuffer(rpool, task) == -1) goto fatal;
+            if (releaseClient(rpool, fd) == -1) goto fatal;
+            destroymsg(request);
+            free(task);
+            return;
+        }
+        //l'username viene inviato una sola volta con HELLO, lo recupero dalla connessione
+        strcpy(request->header->username, clientName(rpool, fd));
+
+        int rescode = serverequest(request, fd);
+        if (rescode == ENOTRECOVERABLE) goto fatal;
+
+        if (request->header->code == LOCK && rescode == EBUSY){
+            //usiamo il campo arg per salvarci il fd da riconsiderare quando verrà unlockato il file
+            request->header->arg = fd;
+            //le richieste successive già ricevute verranno servite quando il client sarà riattivato,
+            //vanno conservate prima di mettersi in attesa perché l'unlock potrebbe arrivare subito
+            if (holdPending(rpool, fd, prefetch, prefetched) == -1) goto fatal;
+            if (client_waitlock(request) == ENOTRECOVERABLE) goto fatal;
+            if (recycleBuffer(rpool, task) == -1) goto fatal;
+            free(task);
+            return;
+        }
+
+        if (request->header->code == FIN) {
+            if (recycleBuffer(rpool, task) == -1) goto fatal;
+            if (releaseClient(rpool, fd) == -1) goto fatal;
+            destroymsg(request);
+            free(task);
+            return;
+        }
+
+        if (request->header->code == UNLOCK && rescode == EXIT_SUCCESS){
+            int client;
+            if ((client = client_completelock(request)) == ENOTRECOVERABLE) goto fatal;
+            if (client >= 0) { //trovata lock da completare, riattivo il client in attesa
+                if (rearm(client) == -1) goto fatal;
+            }
+        }
+
         destroymsg(request);
-        return;
+        request = NULL;
+        //con il pool con priorità il task serve solo le richieste della classe con cui è stato accodato: le altre già
+        //ricevute ripassano dal threadpool con la propria classe, quelle ancora nel socket vengono ricevute e
+        //classificate dal reactor. Le richieste in memoria condivisa non hanno una classe
+        if (rpool->tpool->kind == PRIORITY_POOL && !chan
+            && (prefetched == 0 || requestClass(rpool, prefetch, prefetched) != task->class)) {
+            if (holdPending(rpool, fd, prefetch, prefetched) == -1) goto fatal;
+            if (recycleBuffer(rpool, task) == -1) goto fatal;
+            goto idle;
+        }
+        //finché il client ha già inviato altre richieste continuo a servirlo senza ripassare dal reactor,
+        //quelle già ricevute dal reactor vanno comunque servite perché non verrebbero più notificate
+    } while (prefetched > 0 || (++served < REQUEST_BURST && pendingrequest(fd)));
+
+    idle:
+    free(task);
+
+    //riattivo direttamente il fd del client per la prossima richiesta
+    if (rearm(fd) == -1) goto fatal;
+    return;
+
+    fatal:
+    PRINT_ERROR("fatal error")
+    if (request) destroymsg(request);
+    exit(EXIT_FAILURE);
+}
+
+int serverequest(msg_t *request, int fd) {
+    //fino all'handshake il client non ha un username con cui operare sui file
+    if (request->header->code != HELLO && request->header->username[0] == '\0')
+        return w_reject(request, fd, EPERM);
+    //solo READ, WRITE e PUT possono avere il contenuto in un memfd, che in scrittura deve poter arrivare al server
+    if ((request->header->flags & FLAG_MEMFD) && request->header->code != READ
+        && ((request->header->code != WRITE && request->header->code != PUT) || !fdpassing(fd)))
+        return w_reject(request, fd, EINVAL);
+    //il contenuto di una PUT arriva tutto insieme: il file è già chiuso quando arriverebbero i chunk successivi.
+    //Anche le operazioni di una BATCH sono tutte nel suo payload
+    if ((request->header->code == PUT || request->header->code == BATCH)
+        && (request->header->flags & (FLAG_MORE | FLAG_CHUNK)))
+        return w_reject(request, fd, EINVAL);
+    //un chunk prosegue in append il trasferimento iniziato con lo stesso id, che non deve essere fallito
+    if ((request->header->flags & FLAG_CHUNK)
+        && (request->header->code != APPEND || clientStream(rpool, fd) != request->header->id)) {
+        if (setClientStream(rpool, fd, 0) == -1) return ENOTRECOVERABLE;
+        return w_reject(request, fd, ECANCELED);
     }
+
     int rescode;
     switch (request->header->code) {
         case OPEN:
@@ -52,67 +320,61 @@ void requesthandler(int *clientfd){
         case FIN:
             rescode = w_closeConnection(request, fd);
             break;
-        default: {
-            rescode = EBADRQC;
-            msg_t *response = NULL;
-            if ((response = buildmsg(request->header->username, rescode, request->header->code, request->header->pathname, 0, NULL)) == NULL)
-                rescode = FIN;
-            if (writemsg(fd, response) <= 0)
-                rescode = FIN;
-            if (response) destroymsg(response);
+        case HELLO:
+            rescode = w_hello(request, fd);
+            break;
+        case PUT:
+            rescode = w_putFile(request, fd);
+            break;
+        case BATCH:
+            rescode = w_batch(request, fd);
+            break;
+        default:
+            rescode = w_reject(request, fd, EBADRQC);
             break;
-        }
     }
-
-    if (rescode == ENOTRECOVERABLE) goto fatal;
-
-    if (request->header->code == LOCK && rescode == EBUSY){
-        //usiamo il campo arg per salvarci il fd da riconsiderare quando verrà unlockato il file
-        request->header->arg = fd;
-        if (client_waitlock(request) == ENOTRECOVERABLE) goto fatal;
-        return;
+    //il trasferimento a chunk prosegue finché i chunk vanno a buon fine e ne seguono altri
+    if (request->header->code == WRITE || request->header->code == APPEND) {
+        unsigned int stream = 0;
+        if (rescode == EXIT_SUCCESS && (request->header->flags & FLAG_MORE)) stream = request->header->id;
+        if (setClientStream(rpool, fd, stream) == -1) return ENOTRECOVERABLE;
     }
+    return rescode;
+}
 
-    if (request->header->code != FIN) {
-        if(write(fdpipe[1], &fd, sizeof(int)) <= 0) goto fatal;
-    } else {
-        int closing_client = fd *(-1);
-        if (write(fdpipe[1], &closing_client, sizeof(int)) <= 0) goto fatal;
-    }
+//riattiva la notifica di nuove richieste sul fd del client
+int rearm(int clientfd) {
+    return rearmClient(rpool, clientfd);
+}
 
-    if (request->header->code == UNLOCK && rescode == EXIT_SUCCESS){
-        int client;
-        if ((client = client_completelock(request)) == ENOTRECOVERABLE) goto fatal;
-        if (client >= 0) { //trovata lock da completare
-            if (write(fdpipe[1], &client, sizeof(int)) <= 0) goto fatal;
-        }
-    }
+//controlla, senza bloccarsi, se il client ha già inviato un'altra richiesta. In memoria condivisa la
+//attende per qualche microsecondo: il client che ha appena ricevuto una risposta spesso invia subito la successiva
+bool pendingrequest(int clientfd) {
+    shmchan_t *chan = shmchan_lookup(clientfd);
+    if (chan) return shmchan_poll(chan);
+    char byte;
+    return recv(clientfd, &byte, 1, MSG_PEEK | MSG_DONTWAIT) > 0;
+}
 
-    destroymsg(request);
-    return;
 
-    fatal:
-    PRINT_ERROR("fatal error")
-    if (request) destroymsg(request);
-    exit(EXIT_FAILURE);
+//nome nel log di una OPEN con i flag dati
+static const char *openop(int flags) {
+    if (flags == (O_CREATE | O_LOCK)) return "OPEN_CREATE_LOCK";
+    if (flags == O_LOCK) return "OPEN_LOCK";
+    if (flags == O_CREATE) return "OPEN_CREATE";
+    return "OPEN";
 }
 
-
 int w_openFile(msg_t *request, int clientfd) {
-    char OP[BUFSIZE] = "";
     msg_t *response = NULL;
 
-    int rescode = fs_openFile(storage, request->header->pathname, request->header->arg, request->header->username);
-    if ((response = buildmsg(request->header->username, rescode, request->header->arg, request->header->pathname, 0, NULL)) == NULL)
+    int rescode = fs_openFile(storage, request->header->pathname, request->header->arg, request->header->username, request->header->ttl);
+    if ((response = buildresponse(request, rescode, request->header->arg, NULL, 0, NULL)) == NULL)
         goto error;
     if (writemsg(clientfd, response) <= 0)
         goto error;
 
-    if(request->header->arg == (O_CREATE | O_LOCK)) strcpy(OP, "OPEN_CREATE_LOCK");
-    else if(request->header->arg == O_LOCK) strcpy(OP, "OPEN_LOCK");
-    else if(request->header->arg == O_CREATE) strcpy(OP, "OPEN_CREATE");
-    else strcpy(OP, "OPEN");
-    if (log_operation(OP, clientfd, 0, 0, 0, request->header->pathname, (rescode == 0 ? "OK" : "ERR")) == -1)
+    if (log_operation(openop(request->header->arg), clientfd, 0, 0, 0, request->header->pathname, (rescode == 0 ? "OK" : "ERR")) == -1)
         goto fatal;
 
     destroymsg(response);
@@ -130,38 +392,69 @@ int w_openFile(msg_t *request, int clientfd) {
 
 int w_readFile(msg_t *request, int clientfd) {
     msg_t *response = NULL;
-    void *file_content = NULL;
-    size_t *file_size = NULL;
-    file_size = malloc(sizeof(size_t));
-    if (file_size == NULL) goto error;
-    *file_size = 0;
-
-    int rescode = fs_readFile(storage, request->header->pathname, request->header->username, &file_content, file_size);
-    if ((response = buildmsg(request->header->username, rescode, request->header->arg, request->header->pathname,*file_size, file_content)) == NULL)
-        goto error;
-    if (writemsg(clientfd, response) <= 0)
-        goto error;
-    if (log_operation("READ", clientfd, 0, 0, *file_size, request->header->pathname, (rescode == 0 ? "OK" : "ERR")) == -1)
-        goto fatal;
+    void *chunk = NULL;
+    size_t chunk_size = 0;
+    size_t file_size = 0;
+    size_t sent = 0;
+    //se il client lo accetta il contenuto viene letto e spedito un chunk alla volta, senza copiare l'intero file
+    size_t maxchunk = (request->header->flags & FLAG_STREAM) ? STREAM_CHUNK : SIZE_MAX;
+    size_t compress = clientCompress(rpool, clientfd);
 
-    destroymsg(response);
-    if (*file_size > 0) free(file_content);
-    free(file_size);
+    int rescode;
+    if ((request->header->flags & FLAG_MEMFD) && fdpassing(clientfd)) {
+        //i file grandi vengono condivisi passando al client il memfd sigillato che li contiene
+        int memfd = -1;
+        rescode = fs_shareFile(storage, request->header->pathname, request->header->username, &memfd, &file_size);
+        if (rescode == EXIT_SUCCESS && memfd != -1) {
+            if ((response = buildresponse(request, rescode, request->header->arg, NULL, 0, NULL)) == NULL) {
+                close(memfd);
+                goto error;
+            }
+            response->header->flags |= FLAG_MEMFD;
+            response->header->data_size = file_size;
+            int r = writemsg_fd(clientfd, response, memfd);
+            close(memfd);
+            if (r <= 0)
+                goto error;
+            destroymsg(response);
+            response = NULL;
+            if (log_operation("READ", clientfd, 0, 0, file_size, request->header->pathname, "OK") == -1)
+                goto fatal;
+            return rescode;
+        }
+        file_size = 0;
+    }
+    do {
+        rescode = fs_readFileChunk(storage, request->header->pathname, request->header->username, sent, maxchunk,
+                                   &chunk, &chunk_size, &file_size);
+        if ((response = buildresponse(request, rescode, request->header->arg, NULL, 0, NULL)) == NULL)
+            goto error;
+        //il chunk letto viene spedito senza copiarlo nel messaggio, compresso se il client lo ha chiesto
+        response->header->data_size = chunk_size;
+        response->data = chunk;
+        chunk = NULL;
+        if (compress > 0 && chunk_size >= compress) pool_free(compressmsg(response));
+        if (sent > 0) response->header->flags |= FLAG_CHUNK;
+        sent += chunk_size;
+        if (rescode == EXIT_SUCCESS && chunk_size > 0 && sent < file_size) response->header->flags |= FLAG_MORE;
+        if (writemsg(clientfd, response) <= 0)
+            goto error;
+        destroymsg(response);
+        response = NULL;
+        chunk_size = 0;
+    } while (rescode == EXIT_SUCCESS && sent < file_size && sent > 0);
+
+    if (log_operation("READ", clientfd, 0, 0, sent, request->header->pathname, (rescode == 0 ? "OK" : "ERR")) == -1)
+        goto fatal;
     return rescode;
 
     error:
     PRINT_PERROR("readFile")
-    if (file_size) {
-        if (*file_size > 0) free(file_content);
-        free(file_size);
-    }
+    if (chunk) free(chunk);
     if (response) destroymsg(response);
     return FIN;
     fatal:
     PRINT_ERROR("fatal error")
-    if (*file_size > 0) free(file_content);
-    free(file_size);
-    destroymsg(response);
     return ENOTRECOVERABLE;
 }
 
@@ -177,28 +470,24 @@ int w_readNFile(msg_t *request, int clientfd) {
 
     int files_read = files->length;
     if (files_read == 0) {
-        if ((response = buildmsg(request->header->username, rescode, files_read, NULL, 0, NULL)) == NULL)
+        if ((response = buildresponse(request, rescode, files_read, NULL, 0, NULL)) == NULL)
             goto error;
         if (writemsg(clientfd, response) <= 0)
             goto error;
         if (log_operation("READ_N", clientfd, 0, 0, 0, 0, "OK") == -1)
             goto fatal;
         destroymsg(response);
+        response = NULL;
     }
-    else while(files->length > 0) {
-            node = list_removehead(files);
+    else {
+        if (sendpacked(request, clientfd, rescode, files) == -1)
+            goto error;
+        for (node = files->head; node != NULL; node = node->next) {
             file = node->data;
-            if ((response = buildmsg(request->header->username, rescode, files_read, file->filename, file->size,file->content)) == NULL)
-                goto error;
-            if (writemsg(clientfd, response) <= 0)
-                goto error;
             if (log_operation("READ_N", clientfd, 0, 0, file->size, 0, "OK") == -1)
                 goto fatal;
-
-            fs_filedestroy(file);
-            free(node);
-            destroymsg(response);
         }
+    }
 
     list_destroy(files, (void (*)(void *)) fs_filedestroy);
     return rescode;
@@ -206,114 +495,115 @@ int w_readNFile(msg_t *request, int clientfd) {
     error:
     PRINT_PERROR("readNFile")
     if (files) list_destroy(files, (void (*)(void *)) fs_filedestroy);
-    if (file) fs_filedestroy(file);
-    if (node) free(node);
     if (response) destroymsg(response);
     return FIN;
     fatal:
     PRINT_ERROR("fatal error")
-    if (file) fs_filedestroy(file);
-    if (node) free(node);
-    destroymsg(response);
+    if (response) destroymsg(response);
     list_destroy(files, (void (*)(void *)) fs_filedestroy);
     return ENOTRECOVERABLE;
 }
 
-int w_writeFile(msg_t *request, int clientfd) {
+//esegue una WRITE o una PUT, che differiscono solo per l'operazione sullo storage (store) e per il nome nel log (op)
+static int storecontent(msg_t *request, int clientfd, const char *op,
+                        int (*store)(storage_t *, char *, size_t, void **, int *, char *, long, list_t *)) {
 
     msg_t *response = NULL;
     elem_t *node = NULL;
     file_t *file = NULL;
     size_t totalbytes_ejected = 0;
+    size_t totalbytes_sent = 0;
     list_t *filesEjected = NULL;
+    void *content = NULL;
+    int memfd = -1;
     if ((filesEjected = list_init()) == NULL) goto error;
 
-    int rescode = fs_writeFile(storage, request->header->pathname, request->header->data_size, request->data,request->header->username, filesEjected);
-
-    int files_ejected = filesEjected->length;
-    if (files_ejected == 0) {
-        if ((response = buildmsg(request->header->username, rescode, files_ejected, request->header->pathname, 0,NULL)) == NULL)
-            goto error;
-        if (writemsg(clientfd, response) <= 0)
-            goto error;
-        destroymsg(response);
-
-    } else while (filesEjected->length > 0) {
-            node = list_removehead(filesEjected);
-            file = node->data;
-            if ((response = buildmsg(request->header->username, rescode, files_ejected, file->filename, file->size,file->content)) == NULL)
-                goto error;
-            if (writemsg(clientfd, response) <= 0)
-                goto error;
-            if (log_operation("VICTIM", clientfd, file->size, 0, file->size, file->filename, "OK") == -1)
-                goto fatal;
-
-            totalbytes_ejected += file->size;
-            fs_filedestroy(file);
-            free(node);
-            destroymsg(response);
-            node = NULL;
-            file = NULL;
-        }
-    if (log_operation("WRITE", clientfd, totalbytes_ejected, request->header->data_size, totalbytes_ejected,request->header->pathname, (rescode == 0 ? "OK" : "ERR")) == -1)
+    int rescode;
+    if (request->header->flags & FLAG_MEMFD) {
+        //il contenuto arriva in un memfd: do il via libera al client e ricevo il messaggio che lo trasporta
+        if ((rescode = recvmemfd(request, clientfd, &memfd)) != EXIT_SUCCESS) goto error;
+        rescode = fs_mapMemfd(memfd, request->header->data_size, &content);
+        if (rescode == EXIT_SUCCESS)
+            rescode = store(storage, request->header->pathname, request->header->data_size, &content, &memfd,
+                                   request->header->username, request->header->ttl, filesEjected);
+        //se il memfd non è stato adottato lo rilascio subito
+        if (content) munmap(content, request->header->data_size);
+        if (memfd != -1) close(memfd);
+    } else
+        rescode = store(storage, request->header->pathname, request->header->data_size, &request->data, NULL,
+                               request->header->username, request->header->ttl, filesEjected);
+
+    if (sendvictims(request, clientfd, rescode, filesEjected, &totalbytes_sent) == -1)
+        goto error;
+    for (node = filesEjected->head; node != NULL; node = node->next) {
+        file = node->data;
+        if (log_operation("VICTIM", clientfd, file->size, 0, evictmode(request) == EVICT_FULL ? file->size : 0, file->filename, "OK") == -1)
+            goto fatal;
+        totalbytes_ejected += file->size;
+    }
+    if (log_operation(op, clientfd, totalbytes_ejected, request->header->data_size, totalbytes_sent,request->header->pathname, (rescode == 0 ? "OK" : "ERR")) == -1)
         goto fatal;
 
     list_destroy(filesEjected, (void (*)(void *)) fs_filedestroy);
     return rescode;
 
     error:
-    PRINT_PERROR("writeFile")
+    PRINT_PERROR(op)
     if (filesEjected) list_destroy(filesEjected, (void (*)(void *)) fs_filedestroy);
-    if (file) fs_filedestroy(file);
-    if (node) free(node);
     if (response) destroymsg(response);
     return FIN;
     fatal:
     PRINT_ERROR("fatal error")
-    if (file) fs_filedestroy(file);
-    if (node) free(node);
-    destroymsg(response);
+    if (response) destroymsg(response);
     list_destroy(filesEjected, (void (*)(void *)) fs_filedestroy);
     return ENOTRECOVERABLE;
 }
 
+int w_writeFile(msg_t *request, int clientfd) {
+    return storecontent(request, clientfd, "WRITE", fs_writeFile);
+}
+
+//fs_putFile con e senza O_LOCK, con la firma di fs_writeFile
+static int putlocked(storage_t *storage, char *filename, size_t file_size, void **file_content, int *memfd, char *client,
+                     long ttl, list_t *filesEjected) {
+    return fs_putFile(storage, filename, file_size, file_content, memfd, client, ttl, O_LOCK, filesEjected);
+}
+
+static int putunlocked(storage_t *storage, char *filename, size_t file_size, void **file_content, int *memfd, char *client,
+                       long ttl, list_t *filesEjected) {
+    return fs_putFile(storage, filename, file_size, file_content, memfd, client, ttl, O_NORMAL, filesEjected);
+}
+
+int w_putFile(msg_t *request, int clientfd) {
+    //creazione, scrittura e chiusura in un'unica richiesta: nel log conta come una scrittura, quella che lascia il file
+    //in lock al client ha un'operazione a parte perché la lock non viene rilasciata (vedi statistiche.sh)
+    if (request->header->flags & FLAG_LOCK) return storecontent(request, clientfd, "WRITE_PUT_LOCK", putlocked);
+    return storecontent(request, clientfd, "WRITE_PUT", putunlocked);
+}
+
 int w_appendToFile(msg_t *request, int clientfd) {
 
     msg_t *response = NULL;
     elem_t *node = NULL;
     file_t *file = NULL;
     size_t totalbytes_ejected = 0;
+    size_t totalbytes_sent = 0;
     list_t *filesEjected = NULL;
     if ((filesEjected = list_init()) == NULL) goto error;
 
-    int rescode = fs_appendToFile(storage, request->header->pathname, request->header->data_size, request->data , request->header->username, filesEjected);
+    int rescode = fs_appendToFile(storage, request->header->pathname, request->header->data_size, &request->data, request->header->username, filesEjected);
 
-    int files_ejected = filesEjected->length;
-    if (files_ejected == 0) {
-        if ((response = buildmsg(request->header->username, rescode, files_ejected, request->header->pathname, 0,NULL)) == NULL)
-            goto error;
-        if (writemsg(clientfd, response) <= 0)
-            goto error;
-        destroymsg(response);
+    if (sendvictims(request, clientfd, rescode, filesEjected, &totalbytes_sent) == -1)
+        goto error;
+    for (node = filesEjected->head; node != NULL; node = node->next) {
+        file = node->data;
+        if (log_operation("VICTIM", clientfd, file->size, 0, evictmode(request) == EVICT_FULL ? file->size : 0, file->filename, "OK") == -1)
+            goto fatal;
+        totalbytes_ejected += file->size;
     }
-    else while(filesEjected->length > 0) {
-            node = list_removehead(filesEjected);
-            file = node->data;
-            if ((response = buildmsg(request->header->username, rescode, files_ejected, file->filename, file->size,file->content)) == NULL)
-                goto error;
-            if (writemsg(clientfd, response) <= 0)
-                goto error;
-            if (log_operation("VICTIM", clientfd, file->size, 0, file->size, file->filename, "OK") == -1)
-                goto fatal;
-
-            totalbytes_ejected += file->size;
-            fs_filedestroy(file);
-            free(node);
-            destroymsg(response);
-            node = NULL;
-            file = NULL;
-        }
-    if (log_operation("WRITE_APPEND", clientfd, totalbytes_ejected, rescode == 0 ? request->header->data_size : 0,totalbytes_ejected, request->header->pathname, (rescode == 0 ? "OK" : "ERR")) == -1)
+    //i chunk che proseguono una WRITE o APPEND vengono distinti dalle append vere e proprie
+    const char *op = (request->header->flags & FLAG_CHUNK) ? "WRITE_CHUNK" : "WRITE_APPEND";
+    if (log_operation(op, clientfd, totalbytes_ejected, rescode == 0 ? request->header->data_size : 0,totalbytes_sent, request->header->pathname, (rescode == 0 ? "OK" : "ERR")) == -1)
         goto fatal;
 
     list_destroy(filesEjected, (void (*)(void *)) fs_filedestroy);
@@ -322,15 +612,11 @@ int w_appendToFile(msg_t *request, int clientfd) {
     error:
     PRINT_PERROR("appendToFile")
     if (filesEjected) list_destroy(filesEjected, (void (*)(void *)) fs_filedestroy);
-    if (file) fs_filedestroy(file);
-    if (node) free(node);
     if (response) destroymsg(response);
     return FIN;
     fatal:
     PRINT_ERROR("fatal error")
-    if (file) fs_filedestroy(file);
-    if (node) free(node);
-    destroymsg(response);
+    if (response) destroymsg(response);
     list_destroy(filesEjected, (void (*)(void *)) fs_filedestroy);
     return ENOTRECOVERABLE;
 }
@@ -340,7 +626,7 @@ int w_lockFile(msg_t *request, int clientfd) {
     int rescode = fs_lockFile(storage, request->header->pathname, request->header->username);
 
     msg_t *response = NULL;
-    if ((response = buildmsg(request->header->username, rescode, request->header->arg, request->header->pathname, 0,NULL)) == NULL)
+    if ((response = buildresponse(request, rescode, request->header->arg, NULL, 0, NULL)) == NULL)
         goto error;
     if (writemsg(clientfd, response) <= 0)
         goto error;
@@ -365,7 +651,7 @@ int w_unlockFile(msg_t *request, int clientfd) {
     int rescode = fs_unlockFile(storage, request->header->pathname, request->header->username);
 
     msg_t *response = NULL;
-    if ((response = buildmsg(request->header->username, rescode, request->header->arg, request->header->pathname, 0,NULL)) == NULL)
+    if ((response = buildresponse(request, rescode, request->header->arg, NULL, 0, NULL)) == NULL)
         goto error;
     if (writemsg(clientfd, response) <= 0)
         goto error;
@@ -390,7 +676,7 @@ int w_closeFile(msg_t *request, int clientfd) {
     int rescode = fs_closeFile(storage, request->header->pathname, request->header->username);
 
     msg_t *response = NULL;
-    if ((response = buildmsg(request->header->username, rescode, request->header->arg, request->header->pathname, 0,NULL)) == NULL)
+    if ((response = buildresponse(request, rescode, request->header->arg, NULL, 0, NULL)) == NULL)
         goto error;
     if (writemsg(clientfd, response) <= 0)
         goto error;
@@ -419,7 +705,7 @@ int w_removeFile(msg_t *request, int clientfd) {
     *deleted_count = 0;
     int rescode = fs_removeFile(storage, request->header->pathname, request->header->username, deleted_count);
 
-    if ((response = buildmsg(request->header->username, rescode, request->header->arg, request->header->pathname, 0,NULL)) == NULL)
+    if ((response = buildresponse(request, rescode, request->header->arg, NULL, 0, NULL)) == NULL)
         goto error;
     if (writemsg(clientfd, response) <= 0)
         goto error;
@@ -442,10 +728,128 @@ int w_removeFile(msg_t *request, int clientfd) {
     return ENOTRECOVERABLE;
 }
 
+int w_batch(msg_t *request, int clientfd) {
+    wire_header wire;
+    struct iovec iov[BATCH_OPS + 2];
+    char *results = NULL;
+    int nops = request->header->arg;
+    int iovcnt = 0;
+    int firstcontent = 0;
+    size_t contentsize = 0;
+
+    //il payload viene controllato per intero prima di eseguire qualsiasi operazione
+    const char *end = (const char *) request->data + request->header->data_size;
+    const char *entry = request->data;
+    uint64_t op;
+    if (nops <= 0 || nops > BATCH_OPS) return w_reject(request, clientfd, EINVAL);
+    for (int i = 0; i < nops; i++) {
+        if ((entry = unpackentry(entry, end, request->header->pathname, &op)) == NULL)
+            return w_reject(request, clientfd, EPROTO);
+        int code = BATCHOP_CODE(op);
+        if (code != OPEN && code != READ && code != LOCK && code != UNLOCK && code != CLOSE && code != REMOVE)
+            return w_reject(request, clientfd, EBADRQC);
+    }
+    if (entry != end) return w_reject(request, clientfd, EPROTO);
+
+    if ((results = pool_alloc(nops * RESULT_SIZE)) == NULL) goto error;
+    iovcnt = packmsg(&wire, iov, EXIT_SUCCESS, nops, 0, request->header->id, 0, NULL, 0, NULL);
+    iov[iovcnt].iov_base = results;
+    iov[iovcnt++].iov_len = nops * RESULT_SIZE;
+    firstcontent = iovcnt;
+
+    //le operazioni vengono eseguite in ordine, ognuna sul pathname copiato nell'header della richiesta
+    //così le funzioni di supporto alla lock la trattano come una richiesta singola
+    char *result = results;
+    char *pathname = request->header->pathname;
+    char *client = request->header->username;
+    entry = request->data;
+    for (int i = 0; i < nops; i++) {
+        entry = unpackentry(entry, end, pathname, &op);
+        int arg = BATCHOP_ARG(op);
+        const char *OP = NULL;
+        void *content = NULL;
+        size_t size = 0;
+        size_t deleted = 0;
+        int rescode;
+        switch (BATCHOP_CODE(op)) {
+            case OPEN:
+                rescode = fs_openFile(storage, pathname, arg, client, request->header->ttl);
+                OP = openop(arg);
+                break;
+            case READ: {
+                //il contenuto letto viene spedito senza copiarlo con la stessa writev della risposta. Si copia al più
+                //un byte oltre il budget rimasto: se il file non ci sta lo si lascia ad una READ singola
+                size_t filesize = 0;
+                rescode = fs_readFileChunk(storage, pathname, client, 0, BATCH_READ_BUDGET - contentsize + 1,
+                                           &content, &size, &filesize);
+                if (rescode == EXIT_SUCCESS && filesize > BATCH_READ_BUDGET - contentsize) {
+                    pool_free(content);
+                    rescode = EFBIG;
+                    size = 0;
+                } else if (rescode == EXIT_SUCCESS && size > 0) {
+                    iov[iovcnt].iov_base = content;
+                    iov[iovcnt++].iov_len = size;
+                    contentsize += size;
+                } else size = 0;
+                OP = "READ";
+                break;
+            }
+            case LOCK:
+                rescode = fs_lockFile(storage, pathname, client);
+                OP = "LOCK";
+                break;
+            case UNLOCK:
+                rescode = fs_unlockFile(storage, pathname, client);
+                if (rescode == EXIT_SUCCESS) {
+                    int waiting;
+                    if ((waiting = client_completelock(request)) == ENOTRECOVERABLE) goto fatal;
+                    if (waiting >= 0 && rearm(waiting) == -1) goto fatal;
+                }
+                OP = "UNLOCK";
+                break;
+            case CLOSE:
+                rescode = fs_closeFile(storage, pathname, client);
+                OP = "CLOSE";
+                break;
+            default:
+                rescode = fs_removeFile(storage, pathname, client, &deleted);
+                OP = "REMOVE";
+                break;
+        }
+        if (rescode == ENOTRECOVERABLE) goto fatal;
+        result = packresult(result, rescode, size);
+        if (log_operation(OP, clientfd, deleted, 0, size, pathname, (rescode == 0 ? "OK" : "ERR")) == -1)
+            goto fatal;
+    }
+
+    wire.data_size = nops * RESULT_SIZE + contentsize;
+    size_t compress = clientCompress(rpool, clientfd);
+    if (compress > 0 && contentsize >= compress) {
+        if (sendcompressed(request, clientfd, &wire, iov, iovcnt) <= 0)
+            goto error;
+    } else if (msgwritev(clientfd, iov, iovcnt) <= 0)
+        goto error;
+
+    pool_free(results);
+    for (int i = firstcontent; i < iovcnt; i++) pool_free(iov[i].iov_base);
+    return EXIT_SUCCESS;
+
+    error:
+    PRINT_PERROR("batch")
+    if (results) pool_free(results);
+    for (int i = firstcontent; i < iovcnt; i++) pool_free(iov[i].iov_base);
+    return FIN;
+    fatal:
+    PRINT_ERROR("fatal error")
+    pool_free(results);
+    for (int i = firstcontent; i < iovcnt; i++) pool_free(iov[i].iov_base);
+    return ENOTRECOVERABLE;
+}
+
 int w_closeConnection(msg_t *request, int clientfd) {
 
     msg_t *response = NULL;
-    if ((response = buildmsg(request->header->username, EXIT_SUCCESS, request->header->arg, request->header->pathname,0, NULL)) == NULL)
+    if ((response = buildresponse(request, EXIT_SUCCESS, request->header->arg, NULL, 0, NULL)) == NULL)
         goto error;
     if (writemsg(clientfd, response) <= 0)
         goto error;
@@ -460,6 +864,72 @@ int w_closeConnection(msg_t *request, int clientfd) {
 }
 
 
+int w_hello(msg_t *request, int clientfd) {
+
+    //il pathname della richiesta contiene l'username con cui il client opererà sulla connessione
+    int rescode = EXIT_SUCCESS;
+    if (request->header->arg != PROTOCOL_VERSION)
+        rescode = EPROTONOSUPPORT;
+    else if (request->header->pathname[0] == '\0' || strlen(request->header->pathname) >= MAX_USERNAME)
+        rescode = EINVAL;
+    else if (setClientName(rpool, clientfd, request->header->pathname) == -1)
+        return ENOTRECOVERABLE;
+
+    msg_t *response = NULL;
+    shmchan_t *chan = NULL;
+    int memfd = -1;
+    if ((response = buildresponse(request, rescode, PROTOCOL_VERSION, NULL, 0, NULL)) == NULL)
+        goto error;
+    //la compressione serve solo sul socket: in memoria condivisa costerebbe più della copia che risparmia
+    bool shm = (rescode == EXIT_SUCCESS && (request->header->flags & FLAG_SHM) && confargs.shmringsize > 0
+                && !clientRemote(rpool, clientfd));
+    if (rescode == EXIT_SUCCESS && (request->header->flags & FLAG_LZ) && confargs.compressmin > 0 && !shm) {
+        if (setClientCompress(rpool, clientfd, confargs.compressmin) == -1)
+            goto error;
+        response->header->flags = FLAG_LZ;
+    }
+    //se il server lo consente la connessione passa alla memoria condivisa: il memfd degli anelli viaggia con la
+    //risposta, che è l'ultimo messaggio spedito sul socket. Se non si riesce a crearlo si resta sul socket
+    if (shm && (chan = shmchan_create(clientfd, confargs.shmringsize, &memfd)) != NULL) {
+        response->header->flags = FLAG_SHM;
+        if (writemsg_fd(clientfd, response, memfd) <= 0)
+            goto error;
+        close(memfd);
+        memfd = -1;
+        if (shmchan_register(clientfd, chan) == -1)
+            goto error;
+    } else if (writemsg(clientfd, response) <= 0)
+        goto error;
+
+    destroymsg(response);
+    return rescode;
+
+    error:
+    PRINT_PERROR("hello")
+    if (memfd != -1) close(memfd);
+    if (chan) shmchan_destroy(chan);
+    if (response) destroymsg(response);
+    return FIN;
+}
+
+//risponde con un errore ad una richiesta che non viene eseguita
+int w_reject(msg_t *request, int clientfd, int rescode) {
+
+    msg_t *response = NULL;
+    if ((response = buildresponse(request, rescode, request->header->code, NULL, 0, NULL)) == NULL)
+        goto error;
+    if (writemsg(clientfd, response) <= 0)
+        goto error;
+
+    destroymsg(response);
+    return rescode;
+
+    error:
+    if (response) destroymsg(response);
+    return FIN;
+}
+
+
 //funzioni di supporto alla lockFile
 int client_waitlock(msg_t *lock_request) {
     if (lock_request == NULL)
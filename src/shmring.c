@@ -0,0 +1,333 @@
+/**
+ * @file shmring.c
+ * @brief Implementazione del trasporto su memoria condivisa
+ */
+
+#define _GNU_SOURCE //memfd_create, syscall
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include <shmring.h>
+
+#define SHM_MAGIC 0x53484d31 // "SHM1"
+
+//intestazione del memfd, seguita dall'anello delle richieste e da quello delle risposte
+typedef struct shmlayout_ {
+    uint32_t magic;
+    uint32_t ringsize;
+    char pad[56];
+} shmlayout_t;
+
+#define RING_OFFSET(size, i) (sizeof(shmlayout_t) + (i) * (sizeof(shmring_t) + (size)))
+
+static shmchan_t **channels = NULL;
+static int nchannels = 0;
+
+//i futex sono condivisi tra processi diversi, non vanno usate le varianti PRIVATE
+static void futex_wait(uint32_t *addr, uint32_t val) {
+    struct timespec ts = {SHM_WAIT_MSEC / 1000, (SHM_WAIT_MSEC % 1000) * 1000000L};
+    syscall(SYS_futex, addr, FUTEX_WAIT, val, &ts, NULL, 0);
+}
+
+static void futex_wake(uint32_t *addr) {
+    syscall(SYS_futex, addr, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+static long elapsed_usec(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000000L + (now.tv_nsec - start->tv_nsec) / 1000;
+}
+
+static inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#else
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+#endif
+}
+
+//controlla, senza bloccarsi, che l'altro capo non abbia chiuso il socket, consumando gli eventuali
+//byte di risveglio che altrimenti nasconderebbero la chiusura
+static bool peer_closed(shmchan_t *chan) {
+    return shmchan_drain(chan) != 1;
+}
+
+//sveglia il consumatore dell'anello tx se si è addormentato o ha restituito la connessione al reactor
+static int wake_reader(shmchan_t *chan) {
+    if (__atomic_load_n(&chan->tx->rdwait, __ATOMIC_SEQ_CST) == SHM_ACTIVE) return 0;
+    switch (__atomic_exchange_n(&chan->tx->rdwait, SHM_ACTIVE, __ATOMIC_SEQ_CST)) {
+        case SHM_SLEEPING:
+            futex_wake(&chan->tx->tail);
+            break;
+        case SHM_PARKED: {
+            char bell = 0;
+            while (send(chan->sockfd, &bell, 1, MSG_NOSIGNAL) == -1) {
+                if (errno != EINTR) return -1;
+            }
+            break;
+        }
+        default:
+            break;
+    }
+    return 0;
+}
+
+//sveglia il produttore dell'anello rx se attende spazio
+static void wake_writer(shmchan_t *chan) {
+    if (__atomic_load_n(&chan->rx->wrwait, __ATOMIC_SEQ_CST) == 0) return;
+    if (__atomic_exchange_n(&chan->rx->wrwait, 0, __ATOMIC_SEQ_CST) != 0)
+        futex_wake(&chan->rx->head);
+}
+
+static shmchan_t *mapchan(int sockfd, int memfd, size_t len) {
+    shmchan_t *chan = malloc(sizeof(shmchan_t));
+    if (!chan) return NULL;
+    chan->base = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+    if (chan->base == MAP_FAILED) {
+        int errnosv = errno;
+        free(chan);
+        errno = errnosv;
+        return NULL;
+    }
+    chan->len = len;
+    chan->sockfd = sockfd;
+    return chan;
+}
+
+static void setrings(shmchan_t *chan, uint32_t size, bool server) {
+    shmring_t *requests = (shmring_t *) ((char *) chan->base + RING_OFFSET(size, 0));
+    shmring_t *responses = (shmring_t *) ((char *) chan->base + RING_OFFSET(size, 1));
+    chan->tx = server ? responses : requests;
+    chan->rx = server ? requests : responses;
+    chan->txdata = (char *) chan->tx + sizeof(shmring_t);
+    chan->rxdata = (char *) chan->rx + sizeof(shmring_t);
+    chan->size = size;
+}
+
+shmchan_t *shmchan_create(int sockfd, size_t ringsize, int *memfd) {
+    if (sockfd < 0 || !memfd || ringsize > SHM_RING_MAX) {
+        errno = EINVAL;
+        return NULL;
+    }
+    uint32_t size = SHM_RING_MIN;
+    while (size < ringsize) size <<= 1;
+    size_t len = RING_OFFSET(size, 2);
+
+    if ((*memfd = memfd_create("filestorage-shm", MFD_CLOEXEC | MFD_ALLOW_SEALING)) == -1) return NULL;
+    shmchan_t *chan = NULL;
+    if (ftruncate(*memfd, len) == -1) goto error;
+    //il client non può ridimensionarlo e far fallire gli accessi del server con SIGBUS
+    if (fcntl(*memfd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) == -1) goto error;
+    if ((chan = mapchan(sockfd, *memfd, len)) == NULL) goto error;
+
+    shmlayout_t *layout = chan->base;
+    layout->magic = SHM_MAGIC;
+    layout->ringsize = size;
+    setrings(chan, size, true);
+    chan->tx->size = size;
+    chan->rx->size = size;
+    //il server sta servendo la connessione che ha chiesto l'anello
+    chan->rx->rdwait = SHM_ACTIVE;
+    return chan;
+
+    error: {
+        int errnosv = errno;
+        close(*memfd);
+        *memfd = -1;
+        errno = errnosv;
+        return NULL;
+    }
+}
+
+shmchan_t *shmchan_attach(int sockfd, int memfd) {
+    struct stat st;
+    if (sockfd < 0 || memfd < 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if (fstat(memfd, &st) == -1) return NULL;
+    if ((size_t) st.st_size < sizeof(shmlayout_t)) {
+        errno = EPROTO;
+        return NULL;
+    }
+
+    shmchan_t *chan = mapchan(sockfd, memfd, st.st_size);
+    if (!chan) return NULL;
+    shmlayout_t *layout = chan->base;
+    uint32_t size = layout->ringsize;
+    if (layout->magic != SHM_MAGIC || size < SHM_RING_MIN || size > SHM_RING_MAX || (size & (size - 1)) != 0
+        || RING_OFFSET(size, 2) != (size_t) st.st_size) {
+        shmchan_destroy(chan);
+        errno = EPROTO;
+        return NULL;
+    }
+    setrings(chan, size, false);
+    return chan;
+}
+
+void shmchan_destroy(shmchan_t *chan) {
+    if (!chan) return;
+    munmap(chan->base, chan->len);
+    free(chan);
+}
+
+int shmchan_writev(shmchan_t *chan, struct iovec *iov, int iovcnt) {
+    shmring_t *ring = chan->tx;
+    uint32_t mask = chan->size - 1;
+    for (int i = 0; i < iovcnt; i++) {
+        const char *src = iov[i].iov_base;
+        size_t left = iov[i].iov_len;
+        while (left > 0) {
+            uint32_t tail = ring->tail;
+            uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+            uint32_t used = tail - head;
+            if (used > chan->size) {
+                errno = EPROTO;
+                return -1;
+            }
+            if (used == chan->size) {
+                //anello pieno: prima attendo attivamente, poi mi addormento finché il consumatore non libera spazio
+                struct timespec start;
+                clock_gettime(CLOCK_MONOTONIC, &start);
+                for (int spin = 0; __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == head; spin++) {
+                    if ((spin & 63) == 0 && elapsed_usec(&start) >= SHM_SPIN_USEC) {
+                        __atomic_store_n(&ring->wrwait, 1, __ATOMIC_SEQ_CST);
+                        if (__atomic_load_n(&ring->head, __ATOMIC_SEQ_CST) != head) break;
+                        futex_wait(&ring->head, head);
+                        if (__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == head && peer_closed(chan)) return 0;
+                    } else cpu_relax();
+                }
+                continue;
+            }
+
+            size_t n = chan->size - used;
+            if (n > left) n = left;
+            size_t offset = tail & mask;
+            size_t first = chan->size - offset < n ? chan->size - offset : n;
+            memcpy(chan->txdata + offset, src, first);
+            memcpy(chan->txdata, src + first, n - first);
+            __atomic_store_n(&ring->tail, tail + (uint32_t) n, __ATOMIC_SEQ_CST);
+            src += n;
+            left -= n;
+            if (wake_reader(chan) == -1) return -1;
+        }
+    }
+    return 1;
+}
+
+int shmchan_readn(shmchan_t *chan, void *buf, size_t size) {
+    shmring_t *ring = chan->rx;
+    uint32_t mask = chan->size - 1;
+    char *dst = buf;
+    size_t left = size;
+    while (left > 0) {
+        uint32_t head = ring->head;
+        uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+        uint32_t avail = tail - head;
+        if (avail > chan->size) {
+            errno = EPROTO;
+            return -1;
+        }
+        if (avail == 0) {
+            //anello vuoto: prima attendo attivamente, poi mi addormento finché il produttore non scrive
+            struct timespec start;
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            for (int spin = 0; __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) == tail; spin++) {
+                if ((spin & 63) == 0 && elapsed_usec(&start) >= SHM_SPIN_USEC) {
+                    __atomic_store_n(&ring->rdwait, SHM_SLEEPING, __ATOMIC_SEQ_CST);
+                    if (__atomic_load_n(&ring->tail, __ATOMIC_SEQ_CST) == tail) futex_wait(&ring->tail, tail);
+                    __atomic_store_n(&ring->rdwait, SHM_ACTIVE, __ATOMIC_SEQ_CST);
+                    if (__atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) == tail && peer_closed(chan)) return 0;
+                } else cpu_relax();
+            }
+            continue;
+        }
+
+        size_t n = avail < left ? avail : left;
+        size_t offset = head & mask;
+        size_t first = chan->size - offset < n ? chan->size - offset : n;
+        memcpy(dst, chan->rxdata + offset, first);
+        memcpy(dst + first, chan->rxdata, n - first);
+        __atomic_store_n(&ring->head, head + (uint32_t) n, __ATOMIC_SEQ_CST);
+        dst += n;
+        left -= n;
+        wake_writer(chan);
+    }
+    return (int) size;
+}
+
+bool shmchan_pending(shmchan_t *chan) {
+    return __atomic_load_n(&chan->rx->tail, __ATOMIC_ACQUIRE) != chan->rx->head;
+}
+
+bool shmchan_poll(shmchan_t *chan) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int spin = 0; !shmchan_pending(chan); spin++) {
+        if ((spin & 63) == 0 && elapsed_usec(&start) >= SHM_SPIN_USEC) return false;
+        cpu_relax();
+    }
+    return true;
+}
+
+bool shmchan_park(shmchan_t *chan) {
+    __atomic_store_n(&chan->rx->rdwait, SHM_PARKED, __ATOMIC_SEQ_CST);
+    if (!shmchan_pending(chan)) return false;
+    //se il produttore ha già visto SHM_PARKED il byte sul socket riattiverà comunque la connessione
+    return __atomic_exchange_n(&chan->rx->rdwait, SHM_ACTIVE, __ATOMIC_SEQ_CST) == SHM_PARKED;
+}
+
+int shmchan_drain(shmchan_t *chan) {
+    char bells[64];
+    ssize_t r;
+    while ((r = recv(chan->sockfd, bells, sizeof(bells), MSG_DONTWAIT)) != 0) {
+        if (r > 0) continue;
+        if (errno == EINTR) continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK) return 1;
+        return -1;
+    }
+    return 0;
+}
+
+int shmchan_reserve(int maxfd) {
+    if (maxfd <= nchannels) return 0;
+    shmchan_t **table = realloc(channels, maxfd * sizeof(shmchan_t *));
+    if (!table) return -1;
+    memset(table + nchannels, 0, (maxfd - nchannels) * sizeof(shmchan_t *));
+    channels = table;
+    nchannels = maxfd;
+    return 0;
+}
+
+int shmchan_register(int fd, shmchan_t *chan) {
+    if (fd < 0 || !chan) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (fd >= nchannels && shmchan_reserve(fd + 1) == -1) return -1;
+    channels[fd] = chan;
+    return 0;
+}
+
+shmchan_t *shmchan_unregister(int fd) {
+    if (fd < 0 || fd >= nchannels) return NULL;
+    shmchan_t *chan = channels[fd];
+    channels[fd] = NULL;
+    return chan;
+}
+
+shmchan_t *shmchan_lookup(int fd) {
+    if (fd < 0 || fd >= nchannels) return NULL;
+    return channels[fd];
+}
@@ -0,0 +1,45 @@
+/**
+ * @file sockio.c
+ * @brief Implementazione delle operazioni sostituibili sul socket delle connessioni
+ */
+
+#include <stddef.h>
+#include <errno.h>
+
+#include <conn.h>
+#include <sockio.h>
+
+//operazioni installate con sockio_set, NULL per quelle di default
+static const sockio_t *current = NULL;
+
+void sockio_set(const sockio_t *io) {
+    __atomic_store_n(&current, io, __ATOMIC_RELEASE);
+}
+
+int sockio_readn(int fd, void *buf, size_t size) {
+    const sockio_t *io = __atomic_load_n(&current, __ATOMIC_ACQUIRE);
+    if (io) return io->readn(fd, buf, size);
+    return readn(fd, buf, size);
+}
+
+int sockio_writevn(int fd, struct iovec *iov, int iovcnt) {
+    const sockio_t *io = __atomic_load_n(&current, __ATOMIC_ACQUIRE);
+    if (io) return io->writevn(fd, iov, iovcnt);
+    return writevn(fd, iov, iovcnt);
+}
+
+ssize_t sockio_sendmsg(int fd, const struct msghdr *msg, int flags) {
+    const sockio_t *io = __atomic_load_n(&current, __ATOMIC_ACQUIRE);
+    if (io) return io->sendmsg(fd, msg, flags);
+    ssize_t r;
+    while ((r = sendmsg(fd, msg, flags)) == -1 && errno == EINTR);
+    return r;
+}
+
+ssize_t sockio_recvmsg(int fd, struct msghdr *msg, int flags) {
+    const sockio_t *io = __atomic_load_n(&current, __ATOMIC_ACQUIRE);
+    if (io) return io->recvmsg(fd, msg, flags);
+    ssize_t r;
+    while ((r = recvmsg(fd, msg, flags)) == -1 && errno == EINTR);
+    return r;
+}